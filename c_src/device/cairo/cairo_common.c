@@ -1,8 +1,16 @@
+#include "bands.h"
 #include "cairo_ctx.h"
+#include "damage.h"
 #include "device.h"
 
 extern device_info_t g_device_info;
 
+// Each band draws with a copy of the context that has a cr of its own,
+// on an image surface over its rows of whichever surface the frame is
+// drawn on. The copies keep their pattern stacks and caches from frame
+// to frame.
+static scenic_cairo_ctx_t band_ctx[MAX_RENDER_BANDS];
+
 scenic_cairo_ctx_t* scenic_cairo_init(const device_opts_t* p_opts,
                                       device_info_t* p_info)
 {
@@ -16,6 +24,8 @@ scenic_cairo_ctx_t* scenic_cairo_init(const device_opts_t* p_opts,
     return NULL;
   }
 
+  p_ctx->patterns = pattern_cache_create();
+
   p_ctx->ratio = 1.0f;
   p_ctx->dist_tolerance = 0.1f * p_ctx->ratio;
 
@@ -44,13 +54,262 @@ scenic_cairo_ctx_t* scenic_cairo_init(const device_opts_t* p_opts,
 
 void scenic_cairo_fini(scenic_cairo_ctx_t* p_ctx)
 {
+  if (p_ctx->scene) cairo_surface_destroy(p_ctx->scene);
   cairo_surface_destroy(p_ctx->surface);
+  while (p_ctx->pattern_stack_depth > 0) pattern_stack_pop(p_ctx);
+  set_fill_pattern(p_ctx, NULL);
+  set_stroke_pattern(p_ctx, NULL);
+  free(p_ctx->pattern_stack);
+  pattern_cache_free(p_ctx->patterns);
+  for (int i = 0; i < MAX_RENDER_BANDS; i++) {
+    free(band_ctx[i].pattern_stack);
+    pattern_cache_free(band_ctx[i].patterns);
+    band_ctx[i] = (scenic_cairo_ctx_t){0};
+  }
   free(p_ctx);
 }
 
+// cairo draws into a surface that keeps its pixels between frames, so
+// only the damaged parts need drawing
+bool device_redraws_damage()
+{
+  return true;
+}
+
+// the scene is only kept while the cursor is shown
+bool device_keeps_scene(driver_data_t* p_data)
+{
+  scenic_cairo_ctx_t* p_ctx = (scenic_cairo_ctx_t*)p_data->v_ctx;
+  return p_ctx->scene != NULL;
+}
+
+// Clip the frame to the damage and clear just that, unless the frame
+// is going to cover all of it anyway. The clear color replaces what
+// was there, so a translucent one doesn't build up.
+static void clip_damage(scenic_cairo_ctx_t* p_ctx, bool clear)
+{
+  for (int i = 0; i < g_damage.count; i++) {
+    const box_t* p_rect = &g_damage.rects[i];
+    cairo_rectangle(p_ctx->cr, p_rect->x0, p_rect->y0,
+                    p_rect->x1 - p_rect->x0, p_rect->y1 - p_rect->y0);
+  }
+  cairo_clip(p_ctx->cr);
+  if (!clear) return;
+
+  cairo_set_operator(p_ctx->cr, CAIRO_OPERATOR_SOURCE);
+  cairo_set_source_rgba(p_ctx->cr,
+                        p_ctx->clear_color.red,
+                        p_ctx->clear_color.green,
+                        p_ctx->clear_color.blue,
+                        p_ctx->clear_color.alpha);
+  cairo_paint(p_ctx->cr);
+  cairo_set_operator(p_ctx->cr, CAIRO_OPERATOR_OVER);
+}
+
+// Copy the scene onto the surface in the damage, which takes the
+// cursor off wherever it was, and go on drawing on the surface.
+static void restore_scene(scenic_cairo_ctx_t* p_ctx)
+{
+  cairo_destroy(p_ctx->cr);
+  p_ctx->cr = cairo_create(p_ctx->surface);
+  clip_damage(p_ctx, false);
+
+  cairo_set_operator(p_ctx->cr, CAIRO_OPERATOR_SOURCE);
+  cairo_set_source_surface(p_ctx->cr, p_ctx->scene, 0, 0);
+  cairo_paint(p_ctx->cr);
+  cairo_set_operator(p_ctx->cr, CAIRO_OPERATOR_OVER);
+}
+
+// While the cursor is shown, the scene is drawn into a surface of its
+// own and copied onto the one that is presented before the cursor goes
+// on top. When only the cursor moves, putting the scene back where it
+// was is all there is to do.
+void scenic_cairo_begin_frame(scenic_cairo_ctx_t* p_ctx, const driver_data_t* p_data)
+{
+  pattern_cache_next_frame(p_ctx->patterns);
+
+  if (p_data->f_cursor_only) {
+    restore_scene(p_ctx);
+    return;
+  }
+
+  if (!p_data->f_show_cursor && p_ctx->scene) {
+    // the damage covers where the cursor was
+    cairo_surface_destroy(p_ctx->scene);
+    p_ctx->scene = NULL;
+  } else if (p_data->f_show_cursor && !p_ctx->scene) {
+    // there is no cursor on the surface yet, so it is the scene
+    cairo_surface_t* scene = cairo_image_surface_create(
+      CAIRO_FORMAT_ARGB32,
+      cairo_image_surface_get_width(p_ctx->surface),
+      cairo_image_surface_get_height(p_ctx->surface));
+    if (cairo_surface_status(scene) == CAIRO_STATUS_SUCCESS) {
+      cairo_t* cr = cairo_create(scene);
+      cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+      cairo_set_source_surface(cr, p_ctx->surface, 0, 0);
+      cairo_paint(cr);
+      cairo_destroy(cr);
+      p_ctx->scene = scene;
+    } else {
+      log_error("cairo: unable to allocate the scene surface");
+      cairo_surface_destroy(scene);
+    }
+  }
+
+  cairo_destroy(p_ctx->cr);
+  p_ctx->cr = cairo_create(p_ctx->scene ? p_ctx->scene : p_ctx->surface);
+  clip_damage(p_ctx, !p_data->f_skip_clear);
+}
+
+// Raster layers are image surfaces, and vector layers are recording
+// surfaces. While one is being drawn, cr draws into it and the frame's
+// cr waits in frame_cr.
+static void* begin_layer(scenic_cairo_ctx_t* p_ctx, cairo_surface_t* surface)
+{
+  if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(surface);
+    return NULL;
+  }
+
+  p_ctx->frame_cr = p_ctx->cr;
+  p_ctx->cr = cairo_create(surface);
+  return surface;
+}
+
+void* device_layer_begin(void* v_ctx, int x, int y, int width, int height)
+{
+  scenic_cairo_ctx_t* p_ctx = (scenic_cairo_ctx_t*)v_ctx;
+  if (p_ctx->frame_cr) return NULL;
+
+  cairo_surface_t* surface = begin_layer(p_ctx,
+    cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height));
+  if (surface) cairo_translate(p_ctx->cr, -x, -y);
+  return surface;
+}
+
+void* device_recording_begin(void* v_ctx, float x, float y,
+                             float width, float height)
+{
+  scenic_cairo_ctx_t* p_ctx = (scenic_cairo_ctx_t*)v_ctx;
+  if (p_ctx->frame_cr) return NULL;
+
+  cairo_rectangle_t extents = {x, y, width, height};
+  return begin_layer(p_ctx,
+    cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA, &extents));
+}
+
+void device_layer_end(void* v_ctx, void* p_layer)
+{
+  scenic_cairo_ctx_t* p_ctx = (scenic_cairo_ctx_t*)v_ctx;
+  if (!p_ctx->frame_cr) return;
+
+  cairo_destroy(p_ctx->cr);
+  p_ctx->cr = p_ctx->frame_cr;
+  p_ctx->frame_cr = NULL;
+  cairo_surface_flush((cairo_surface_t*)p_layer);
+}
+
+void device_layer_draw(void* v_ctx, void* p_layer, int x, int y)
+{
+  scenic_cairo_ctx_t* p_ctx = (scenic_cairo_ctx_t*)v_ctx;
+  cairo_save(p_ctx->cr);
+  cairo_identity_matrix(p_ctx->cr);
+  cairo_set_source_surface(p_ctx->cr, (cairo_surface_t*)p_layer, x, y);
+  cairo_paint(p_ctx->cr);
+  cairo_restore(p_ctx->cr);
+}
+
+void device_recording_draw(void* v_ctx, void* p_layer)
+{
+  scenic_cairo_ctx_t* p_ctx = (scenic_cairo_ctx_t*)v_ctx;
+  cairo_save(p_ctx->cr);
+  cairo_set_source_surface(p_ctx->cr, (cairo_surface_t*)p_layer, 0, 0);
+  cairo_paint(p_ctx->cr);
+  cairo_restore(p_ctx->cr);
+}
+
+void device_layer_free(void* p_layer)
+{
+  cairo_surface_destroy((cairo_surface_t*)p_layer);
+}
+
+void* device_band_begin(driver_data_t* p_data, int band, int y0, int y1)
+{
+  scenic_cairo_ctx_t* p_ctx = (scenic_cairo_ctx_t*)p_data->v_ctx;
+  if (p_ctx->frame_cr) return NULL;
+
+  // the clear is drawn before any of the bands
+  cairo_surface_t* target = cairo_get_target(p_ctx->cr);
+  if (band == 0) cairo_surface_flush(target);
+
+  int stride = cairo_image_surface_get_stride(target);
+  unsigned char* data = cairo_image_surface_get_data(target);
+  if (!data) return NULL;
+  cairo_surface_t* surface = cairo_image_surface_create_for_data(
+    data + y0 * stride, cairo_image_surface_get_format(target),
+    cairo_image_surface_get_width(target), y1 - y0, stride);
+  if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(surface);
+    return NULL;
+  }
+
+  scenic_cairo_ctx_t* p_band = &band_ctx[band];
+  pattern_stack_t* pattern_stack = p_band->pattern_stack;
+  int pattern_stack_size = p_band->pattern_stack_size;
+  pattern_cache_t* patterns = p_band->patterns;
+  if (!patterns) patterns = pattern_cache_create();
+  pattern_cache_next_frame(patterns);
+  *p_band = *p_ctx;
+  p_band->pattern_stack = pattern_stack;
+  p_band->pattern_stack_size = pattern_stack_size;
+  p_band->pattern_stack_depth = 0;
+  p_band->patterns = patterns;
+  if (p_band->pattern.fill) cairo_pattern_reference(p_band->pattern.fill);
+  if (p_band->pattern.stroke) cairo_pattern_reference(p_band->pattern.stroke);
+  p_band->scene = NULL;
+  p_band->surface = surface;
+  p_band->cr = cairo_create(surface);
+  cairo_surface_destroy(surface);
+
+  cairo_translate(p_band->cr, 0, -y0);
+  for (int i = 0; i < g_damage.count; i++) {
+    const box_t* p_rect = &g_damage.rects[i];
+    cairo_rectangle(p_band->cr, p_rect->x0, p_rect->y0,
+                    p_rect->x1 - p_rect->x0, p_rect->y1 - p_rect->y0);
+  }
+  cairo_clip(p_band->cr);
+  return p_band;
+}
+
+void device_band_end(driver_data_t* p_data, int band, void* v_band)
+{
+  scenic_cairo_ctx_t* p_ctx = (scenic_cairo_ctx_t*)p_data->v_ctx;
+  scenic_cairo_ctx_t* p_band = (scenic_cairo_ctx_t*)v_band;
+  cairo_surface_t* surface = p_band->surface;
+  cairo_surface_t* target = cairo_get_target(p_ctx->cr);
+  cairo_surface_flush(surface);
+
+  // the target's pixels changed behind its back
+  int y0 = (cairo_image_surface_get_data(surface) - cairo_image_surface_get_data(target))
+    / cairo_image_surface_get_stride(target);
+  cairo_surface_mark_dirty_rectangle(target, 0, y0,
+                                     cairo_image_surface_get_width(surface),
+                                     cairo_image_surface_get_height(surface));
+
+  cairo_destroy(p_band->cr);
+  p_band->cr = NULL;
+  p_band->surface = NULL;
+
+  // what the band was left with goes with it
+  while (p_band->pattern_stack_depth > 0) pattern_stack_pop(p_band);
+  set_fill_pattern(p_band, NULL);
+  set_stroke_pattern(p_band, NULL);
+}
+
 void device_begin_cursor_render(driver_data_t* p_data)
 {
   scenic_cairo_ctx_t* p_ctx = (scenic_cairo_ctx_t*)p_data->v_ctx;
+  if (p_ctx->scene && !p_data->f_cursor_only) restore_scene(p_ctx);
   cairo_translate(p_ctx->cr, p_data->cursor_pos[0], p_data->cursor_pos[1]);
 }
 
@@ -70,34 +329,44 @@ char* device_gl_error()
   return NULL;
 }
 
+// The stack is an array that only ever grows, so once it has been as
+// deep as the scene goes, pushing and popping never allocate.
 void pattern_stack_push(scenic_cairo_ctx_t* p_ctx)
 {
-  pattern_stack_t* ptr = (pattern_stack_t*)malloc(sizeof(pattern_stack_t));
+  if (p_ctx->pattern_stack_depth == p_ctx->pattern_stack_size) {
+    int size = p_ctx->pattern_stack_size ? p_ctx->pattern_stack_size * 2 : 32;
+    pattern_stack_t* stack = realloc(p_ctx->pattern_stack, size * sizeof(pattern_stack_t));
+    if (!stack) {
+      log_error("pattern stack overflow");
+      // keep the pushes and pops balanced
+      p_ctx->pattern_stack_depth++;
+      return;
+    }
+    p_ctx->pattern_stack = stack;
+    p_ctx->pattern_stack_size = size;
+  }
 
+  pattern_stack_t* ptr = &p_ctx->pattern_stack[p_ctx->pattern_stack_depth++];
   ptr->pattern = p_ctx->pattern;
+  if (ptr->pattern.fill) cairo_pattern_reference(ptr->pattern.fill);
+  if (ptr->pattern.stroke) cairo_pattern_reference(ptr->pattern.stroke);
   ptr->text_align = p_ctx->text_align;
   ptr->text_base = p_ctx->text_base;
-
-  if (!p_ctx->pattern_stack_head) {
-    ptr->next = NULL;
-    p_ctx->pattern_stack_head = ptr;
-  } else {
-    ptr->next = p_ctx->pattern_stack_head;
-    p_ctx->pattern_stack_head = ptr;
-  }
 }
 
 void pattern_stack_pop(scenic_cairo_ctx_t* p_ctx)
 {
-  pattern_stack_t* ptr = p_ctx->pattern_stack_head;
-
-  if (!ptr) {
+  if (p_ctx->pattern_stack_depth == 0) {
     log_error("pattern stack underflow");
-  } else {
-    p_ctx->pattern = ptr->pattern;
-    p_ctx->text_align = ptr->text_align;
-    p_ctx->text_base = ptr->text_base;
-    p_ctx->pattern_stack_head = p_ctx->pattern_stack_head->next;
-    free(ptr);
+    return;
   }
+
+  // an entry that couldn't be saved has nothing to restore
+  if (--p_ctx->pattern_stack_depth >= p_ctx->pattern_stack_size) return;
+
+  pattern_stack_t* ptr = &p_ctx->pattern_stack[p_ctx->pattern_stack_depth];
+  set_fill_pattern(p_ctx, ptr->pattern.fill);
+  set_stroke_pattern(p_ctx, ptr->pattern.stroke);
+  p_ctx->text_align = ptr->text_align;
+  p_ctx->text_base = ptr->text_base;
 }
@@ -10,11 +10,10 @@ typedef struct {
   cairo_pattern_t* stroke;
 } fill_stroke_pattern_t;
 
-typedef struct pattern_stack_t_ {
+typedef struct {
   fill_stroke_pattern_t pattern;
   text_align_t text_align;
   text_base_t text_base;
-  struct pattern_stack_t_* next;
 } pattern_stack_t;
 
 typedef struct {
@@ -28,6 +27,9 @@ typedef struct {
   cairo_font_face_t* font_face;
 } font_data_t;
 
+// solid and gradient patterns, made once for each set of parameters
+typedef struct _pattern_cache_t pattern_cache_t;
+
 typedef struct {
   color_rgba_t clear_color;
   FT_Library ft_library;
@@ -35,9 +37,14 @@ typedef struct {
   text_align_t text_align;
   text_base_t text_base;
   cairo_surface_t* surface;
+  cairo_surface_t* scene;  // the scene without the cursor, while it is shown
   cairo_t* cr;
-  pattern_stack_t* pattern_stack_head;
-  fill_stroke_pattern_t pattern;
+  cairo_t* frame_cr;      // cr, while a layer is being drawn
+  pattern_stack_t* pattern_stack;
+  int pattern_stack_depth;
+  int pattern_stack_size;
+  fill_stroke_pattern_t pattern;   // holds a reference to each
+  pattern_cache_t* patterns;
   int images_count;
   int images_used;
   int highest_image_id;
@@ -53,9 +60,28 @@ typedef struct {
 scenic_cairo_ctx_t* scenic_cairo_init(const device_opts_t* p_opts,
                                       device_info_t* p_info);
 void scenic_cairo_fini(scenic_cairo_ctx_t* p_ctx);
+void scenic_cairo_begin_frame(scenic_cairo_ctx_t* p_ctx, const driver_data_t* p_data);
 
 void pattern_stack_push(scenic_cairo_ctx_t* p_ctx);
 void pattern_stack_pop(scenic_cairo_ctx_t* p_ctx);
 
+// take over a reference to the pattern
+void set_fill_pattern(scenic_cairo_ctx_t* p_ctx, cairo_pattern_t* pattern);
+void set_stroke_pattern(scenic_cairo_ctx_t* p_ctx, cairo_pattern_t* pattern);
+
+pattern_cache_t* pattern_cache_create();
+void pattern_cache_free(pattern_cache_t* p_cache);
+void pattern_cache_next_frame(pattern_cache_t* p_cache);
+
+// each returns a reference for the caller
+cairo_pattern_t* find_rgba_pattern(scenic_cairo_ctx_t* p_ctx, color_rgba_t color);
+cairo_pattern_t* find_linear_pattern(scenic_cairo_ctx_t* p_ctx,
+                                     coordinates_t start, coordinates_t end,
+                                     color_rgba_t color_start, color_rgba_t color_end);
+cairo_pattern_t* find_radial_pattern(scenic_cairo_ctx_t* p_ctx,
+                                     coordinates_t center,
+                                     float inner_radius, float outer_radius,
+                                     color_rgba_t color_start, color_rgba_t color_end);
+
 image_pattern_data_t* find_image_pattern(scenic_cairo_ctx_t* p_ctx, int id);
 font_data_t* find_font(scenic_cairo_ctx_t* p_ctx, int id);
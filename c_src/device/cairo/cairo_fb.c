@@ -12,6 +12,7 @@
 
 #include "cairo_ctx.h"
 #include "comms.h"
+#include "damage.h"
 #include "device.h"
 #include "fontstash.h"
 #include "scenic_ops.h"
@@ -179,16 +180,7 @@ void device_begin_render(driver_data_t* p_data)
 
   scenic_cairo_ctx_t* p_ctx = (scenic_cairo_ctx_t*)p_data->v_ctx;
 
-  cairo_destroy(p_ctx->cr);
-  p_ctx->cr = cairo_create(p_ctx->surface);
-
-  // Paint surface to clear color
-  cairo_set_source_rgba(p_ctx->cr,
-                        p_ctx->clear_color.red,
-                        p_ctx->clear_color.green,
-                        p_ctx->clear_color.blue,
-                        p_ctx->clear_color.alpha);
-  cairo_paint(p_ctx->cr);
+  scenic_cairo_begin_frame(p_ctx, p_data);
 }
 
 inline static uint8_t to_8_color(uint8_t r, uint8_t g, uint8_t b)
@@ -219,42 +211,31 @@ inline static uint16_t to_16_color(uint8_t r, uint8_t g, uint8_t b)
             ((b >> 3) & 31));
 }
 
-void render_cairo_surface_to_fb(scenic_cairo_ctx_t* p_ctx)
+// convert a run of pixels from the cairo surface into rgb_buff, which
+// is laid out the same way, just with the frame buffer's pixel format
+static void convert_pixels(const uint8_t* cairo_buff, size_t first, size_t count,
+                           bool is_bgr555)
 {
-  cairo_surface_flush(p_ctx->surface);
-  uint8_t* cairo_buff = cairo_image_surface_get_data(p_ctx->surface);
-  uint32_t width = cairo_image_surface_get_width(p_ctx->surface);
-  uint32_t height = cairo_image_surface_get_height(p_ctx->surface);
-
-  bool is_bgr555 = ((g_cairo_fb.var.red.offset == 0 &&
-                     g_cairo_fb.var.green.offset == 5 &&
-                     g_cairo_fb.var.blue.offset == 10))
-                    ? true
-                    : false;
-
-  size_t pix_count = width * height;
+  size_t end = first + count;
 
-  int cpp = 0;
   switch (g_cairo_fb.var.bits_per_pixel)
   {
   case 8:
-    cpp = 1;
-    for (uint32_t i = 0, j = 0; i < pix_count; i++, j += 4) {
+    for (size_t i = first, j = first * 4; i < end; i++, j += 4) {
       g_cairo_fb.rgb_buff.c[i] = to_8_color(cairo_buff[j+2],
                                             cairo_buff[j+1],
                                             cairo_buff[j+0]);
     }
     break;
   case 15:
-    cpp = 2;
     if (is_bgr555) {
-      for (uint32_t i = 0, j = 0; i < pix_count; i++, j += 4) {
+      for (size_t i = first, j = first * 4; i < end; i++, j += 4) {
         g_cairo_fb.rgb_buff.s[i] = to_15_color_bgr(cairo_buff[j+2],
                                                    cairo_buff[j+1],
                                                    cairo_buff[j+0]);
       }
     } else {
-      for (uint32_t i = 0, j = 0; i < pix_count; i++, j += 4) {
+      for (size_t i = first, j = first * 4; i < end; i++, j += 4) {
         g_cairo_fb.rgb_buff.s[i] = to_15_color(cairo_buff[j+2],
                                                cairo_buff[j+1],
                                                cairo_buff[j+0]);
@@ -262,15 +243,14 @@ void render_cairo_surface_to_fb(scenic_cairo_ctx_t* p_ctx)
     }
     break;
   case 16:
-    cpp = 2;
     if (is_bgr555) {
-      for (uint32_t i = 0, j = 0; i < pix_count; i++, j += 4) {
+      for (size_t i = first, j = first * 4; i < end; i++, j += 4) {
         g_cairo_fb.rgb_buff.s[i] = to_15_color_bgr(cairo_buff[j+2],
                                                    cairo_buff[j+1],
                                                    cairo_buff[j+0]);
       }
     } else {
-      for (uint32_t i = 0, j = 0; i < pix_count; i++, j += 4) {
+      for (size_t i = first, j = first * 4; i < end; i++, j += 4) {
         g_cairo_fb.rgb_buff.s[i] = to_16_color(cairo_buff[j+2],
                                                cairo_buff[j+1],
                                                cairo_buff[j+0]);
@@ -278,22 +258,46 @@ void render_cairo_surface_to_fb(scenic_cairo_ctx_t* p_ctx)
     }
     break;
   case 24:
-    cpp = 3;
-    for (uint32_t i = 0, j = 0; i < (cpp * pix_count); i += 3, j += 4) {
+    for (size_t i = first * 3, j = first * 4; i < end * 3; i += 3, j += 4) {
       g_cairo_fb.rgb_buff.c[i+0] = cairo_buff[j+0];
       g_cairo_fb.rgb_buff.c[i+1] = cairo_buff[j+1];
       g_cairo_fb.rgb_buff.c[i+2] = cairo_buff[j+2];
     }
     break;
   case 32:
-    cpp = 4;
-    for (uint32_t i = 0, j = 0; i < pix_count; i++, j += 4) {
+    for (size_t i = first, j = first * 4; i < end; i++, j += 4) {
       g_cairo_fb.rgb_buff.i[i] = ((cairo_buff[j+2] << 16)) |
                                   (cairo_buff[j+1] << 8) |
                                   (cairo_buff[j+0]);
     }
     break;
   }
+}
+
+// Only the damaged parts of the surface changed, so only they are
+// converted and copied out to the frame buffer
+void render_cairo_surface_to_fb(scenic_cairo_ctx_t* p_ctx)
+{
+  if (g_damage.count == 0) return;
+
+  cairo_surface_flush(p_ctx->surface);
+  uint8_t* cairo_buff = cairo_image_surface_get_data(p_ctx->surface);
+
+  bool is_bgr555 = ((g_cairo_fb.var.red.offset == 0 &&
+                     g_cairo_fb.var.green.offset == 5 &&
+                     g_cairo_fb.var.blue.offset == 10))
+                    ? true
+                    : false;
+
+  int cpp = 0;
+  switch (g_cairo_fb.var.bits_per_pixel)
+  {
+  case 8:  cpp = 1; break;
+  case 15: cpp = 2; break;
+  case 16: cpp = 2; break;
+  case 24: cpp = 3; break;
+  case 32: cpp = 4; break;
+  }
 
   uint32_t x_stride = (g_cairo_fb.fix.line_length * 8) / g_cairo_fb.var.bits_per_pixel;
 
@@ -320,11 +324,21 @@ void render_cairo_surface_to_fb(scenic_cairo_ctx_t* p_ctx)
     return;
   }
 
-  uint8_t* p_fb = fb + (y_offs * scr_xs + x_offs) * cpp;
-  uint8_t* p_image = g_cairo_fb.rgb_buff.c;
-
-  for (uint32_t i = 0; i < yc; i++, p_fb += scr_xs * cpp, p_image += pic_xs * cpp)
-    memcpy(p_fb, p_image, xc * cpp);
+  for (int r = 0; r < g_damage.count; r++) {
+    const box_t* p_rect = &g_damage.rects[r];
+    uint32_t x0 = p_rect->x0;
+    uint32_t x1 = (p_rect->x1 > xc) ? xc : p_rect->x1;
+    uint32_t y1 = (p_rect->y1 > yc) ? yc : p_rect->y1;
+    if (x0 >= x1) continue;
+
+    for (uint32_t y = p_rect->y0; y < y1; y++) {
+      size_t first = (size_t)y * pic_xs + x0;
+      convert_pixels(cairo_buff, first, x1 - x0, is_bgr555);
+      memcpy(fb + ((y_offs + y) * scr_xs + x_offs + x0) * cpp,
+             g_cairo_fb.rgb_buff.c + first * cpp,
+             (x1 - x0) * cpp);
+    }
+  }
 
   munmap(fb, fb_size);
 }
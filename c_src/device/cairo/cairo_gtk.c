@@ -12,6 +12,7 @@
 
 #include "cairo_ctx.h"
 #include "comms.h"
+#include "damage.h"
 #include "device.h"
 #include "fontstash.h"
 #include "scenic_ops.h"
@@ -21,9 +22,10 @@ typedef struct {
   GThread* main;
   GtkWidget* window;
   GMutex render_mutex;
-  GMutex cmd_mutex;
   float last_x;
   float last_y;
+  guint input_flush_source;
+  guint input_idle_source;
 } cairo_gtk_t;
 
 cairo_gtk_t g_cairo_gtk;
@@ -56,6 +58,31 @@ static gboolean on_delete_event(GtkWidget* widget,
   return TRUE;
 }
 
+// motion and scroll are sent at most once per frame. Anything else
+// goes as soon as gtk has handled the events already waiting, so a
+// burst of them still ends up in one batch
+#define INPUT_FLUSH_MS 16
+
+static gboolean on_input_flush(gpointer data)
+{
+  *(guint*)data = 0;
+  input_flush();
+  return G_SOURCE_REMOVE;
+}
+
+static void schedule_input_flush(bool urgent)
+{
+  if (urgent) {
+    if (!g_cairo_gtk.input_idle_source) {
+      g_cairo_gtk.input_idle_source =
+        g_idle_add(on_input_flush, &g_cairo_gtk.input_idle_source);
+    }
+  } else if (!g_cairo_gtk.input_flush_source) {
+    g_cairo_gtk.input_flush_source =
+      g_timeout_add(INPUT_FLUSH_MS, on_input_flush, &g_cairo_gtk.input_flush_source);
+  }
+}
+
 static gboolean on_motion_event(GtkWidget* widget,
                                 GdkEventMotion* event,
                                 gpointer data)
@@ -63,8 +90,9 @@ static gboolean on_motion_event(GtkWidget* widget,
   float x = floorf(event->x);
   float y = floorf(event->y);
 
-  if ((g_cairo_gtk.last_x != x) && (g_cairo_gtk.last_y != y)) {
+  if ((g_cairo_gtk.last_x != x) || (g_cairo_gtk.last_y != y)) {
     send_cursor_pos(x, y);
+    schedule_input_flush(false);
     g_cairo_gtk.last_x = x;
     g_cairo_gtk.last_y = y;
   }
@@ -96,6 +124,7 @@ static gboolean on_button_event(GtkWidget* widget,
                     action,
                     event->state,
                     x, y);
+  schedule_input_flush(true);
 
   return TRUE;
 }
@@ -110,6 +139,7 @@ static gboolean on_key_event(GtkWidget* widget,
   if (!(event->keyval & 0xF000) && event->type == GDK_KEY_PRESS) {
     send_codepoint(KEYMAP_GDK, unicode, event->state);
   }
+  schedule_input_flush(true);
   return TRUE;
 }
 
@@ -122,6 +152,7 @@ static gboolean on_enter_leave_event(GtkWidget* widget,
   float y = floorf(event->y);
 
   send_cursor_enter(action, x, y);
+  schedule_input_flush(true);
 
   return TRUE;
 }
@@ -143,6 +174,7 @@ static gboolean on_scroll_event(GtkWidget* widget,
   case GDK_SCROLL_SMOOTH: return FALSE;
   }
   send_scroll(xoffset, yoffset, x, y);
+  schedule_input_flush(false);
 
   return TRUE;
 }
@@ -226,16 +258,16 @@ void device_begin_render(driver_data_t* p_data)
   // Don't allow gtk to draw while p_ctx->surface is being rendered
   g_mutex_lock(&g_cairo_gtk.render_mutex);
 
-  cairo_destroy(p_ctx->cr);
-  p_ctx->cr = cairo_create(p_ctx->surface);
+  scenic_cairo_begin_frame(p_ctx, p_data);
+}
 
-  // Paint surface to clear color
-  cairo_set_source_rgba(p_ctx->cr,
-                        p_ctx->clear_color.red,
-                        p_ctx->clear_color.green,
-                        p_ctx->clear_color.blue,
-                        p_ctx->clear_color.alpha);
-  cairo_paint(p_ctx->cr);
+static gboolean queue_draw_area(gpointer data)
+{
+  GdkRectangle* p_area = data;
+  gtk_widget_queue_draw_area(g_cairo_gtk.window,
+                             p_area->x, p_area->y, p_area->width, p_area->height);
+  free(p_area);
+  return G_SOURCE_REMOVE;
 }
 
 void device_end_render(driver_data_t* p_data)
@@ -248,7 +280,21 @@ void device_end_render(driver_data_t* p_data)
   cairo_surface_flush(p_ctx->surface);
   g_mutex_unlock(&g_cairo_gtk.render_mutex);
 
-  g_idle_add((GSourceFunc)gtk_widget_queue_draw, (void*)g_cairo_gtk.window);
+  // only the damaged part of the window needs to be drawn again
+  if (g_damage.count == 0) return;
+
+  GdkRectangle* p_area = malloc(sizeof(GdkRectangle));
+  if (!p_area) {
+    g_idle_add((GSourceFunc)gtk_widget_queue_draw, (void*)g_cairo_gtk.window);
+    return;
+  }
+  *p_area = (GdkRectangle){
+    .x = g_damage.bounds.x0,
+    .y = g_damage.bounds.y0,
+    .width = g_damage.bounds.x1 - g_damage.bounds.x0,
+    .height = g_damage.bounds.y1 - g_damage.bounds.y0
+  };
+  g_idle_add(queue_draw_area, p_area);
 }
 
 void glib_print(const gchar* string)
@@ -261,16 +307,6 @@ void glib_error(const gchar* string)
   log_error("glib: %s", string);
 }
 
-void scenic_cmd_lock()
-{
-  g_mutex_lock(&g_cairo_gtk.cmd_mutex);
-}
-
-void scenic_cmd_unlock()
-{
-  g_mutex_unlock(&g_cairo_gtk.cmd_mutex);
-}
-
 void device_loop(driver_data_t* p_data)
 {
   g_cairo_gtk.main = g_thread_new("scenic_loop", scenic_loop, p_data);
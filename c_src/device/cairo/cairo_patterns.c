@@ -0,0 +1,225 @@
+#include <cairo.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cairo_ctx.h"
+#include "comms.h"
+#include "tommyhash.h"
+#include "tommyhashlin.h"
+
+// the most patterns a cache holds on to
+#define PATTERN_CACHE_SIZE 512
+// patterns that haven't been used for this many frames are let go
+#define PATTERN_MAX_AGE 60
+
+typedef enum {
+  PATTERN_RGBA,
+  PATTERN_LINEAR,
+  PATTERN_RADIAL
+} pattern_type_t;
+
+// compared as bytes, so always zeroed before it is filled in
+typedef struct {
+  pattern_type_t type;
+  float x0, y0, x1, y1;   // the ends, or the center twice
+  float r0, r1;
+  color_rgba_t color_start;
+  color_rgba_t color_end;
+} pattern_key_t;
+
+typedef struct _cached_pattern_t {
+  pattern_key_t key;
+  cairo_pattern_t* pattern;
+  uint32_t frame;         // last used in
+  struct _cached_pattern_t* p_prev;   // more recently used
+  struct _cached_pattern_t* p_next;   // less recently used
+  tommy_hashlin_node node;
+} cached_pattern_t;
+
+struct _pattern_cache_t {
+  tommy_hashlin patterns;
+  cached_pattern_t* p_newest;
+  cached_pattern_t* p_oldest;
+  int count;
+  uint32_t frame;
+};
+
+#define HASH_KEY(p_key) tommy_hash_u32(0, p_key, sizeof(pattern_key_t))
+
+pattern_cache_t* pattern_cache_create()
+{
+  pattern_cache_t* p_cache = calloc(1, sizeof(pattern_cache_t));
+  if (p_cache) tommy_hashlin_init(&p_cache->patterns);
+  return p_cache;
+}
+
+static void unlink_pattern(pattern_cache_t* p_cache, cached_pattern_t* p_entry)
+{
+  if (p_entry->p_prev) p_entry->p_prev->p_next = p_entry->p_next;
+  else p_cache->p_newest = p_entry->p_next;
+  if (p_entry->p_next) p_entry->p_next->p_prev = p_entry->p_prev;
+  else p_cache->p_oldest = p_entry->p_prev;
+  p_entry->p_prev = p_entry->p_next = NULL;
+}
+
+static void link_newest(pattern_cache_t* p_cache, cached_pattern_t* p_entry)
+{
+  p_entry->p_prev = NULL;
+  p_entry->p_next = p_cache->p_newest;
+  if (p_cache->p_newest) p_cache->p_newest->p_prev = p_entry;
+  else p_cache->p_oldest = p_entry;
+  p_cache->p_newest = p_entry;
+}
+
+// whoever has the pattern as their fill or stroke holds a reference
+// of their own, so it lives on until they let go of it too
+static void free_pattern(pattern_cache_t* p_cache, cached_pattern_t* p_entry)
+{
+  tommy_hashlin_remove_existing(&p_cache->patterns, &p_entry->node);
+  unlink_pattern(p_cache, p_entry);
+  cairo_pattern_destroy(p_entry->pattern);
+  free(p_entry);
+  p_cache->count--;
+}
+
+void pattern_cache_free(pattern_cache_t* p_cache)
+{
+  if (!p_cache) return;
+  while (p_cache->p_oldest) free_pattern(p_cache, p_cache->p_oldest);
+  tommy_hashlin_done(&p_cache->patterns);
+  free(p_cache);
+}
+
+// let go of the patterns the last few frames didn't use
+void pattern_cache_next_frame(pattern_cache_t* p_cache)
+{
+  if (!p_cache) return;
+  p_cache->frame++;
+  while (p_cache->p_oldest
+         && p_cache->frame - p_cache->p_oldest->frame > PATTERN_MAX_AGE) {
+    free_pattern(p_cache, p_cache->p_oldest);
+  }
+}
+
+static int _comparator(const void* p_arg, const void* p_obj)
+{
+  const cached_pattern_t* p_entry = p_obj;
+  return memcmp(p_arg, &p_entry->key, sizeof(pattern_key_t));
+}
+
+static void add_color_stops(cairo_pattern_t* pattern,
+                            color_rgba_t color_start, color_rgba_t color_end)
+{
+  cairo_pattern_add_color_stop_rgba(pattern, 0.0,
+                                    color_start.red / 255.0f,
+                                    color_start.green / 255.0f,
+                                    color_start.blue / 255.0f,
+                                    color_start.alpha / 255.0f);
+  cairo_pattern_add_color_stop_rgba(pattern, 1.0,
+                                    color_end.red / 255.0f,
+                                    color_end.green / 255.0f,
+                                    color_end.blue / 255.0f,
+                                    color_end.alpha / 255.0f);
+}
+
+static cairo_pattern_t* create_pattern(const pattern_key_t* p_key)
+{
+  cairo_pattern_t* pattern = NULL;
+  switch (p_key->type) {
+    case PATTERN_RGBA:
+      return cairo_pattern_create_rgba(p_key->color_start.red / 255.0f,
+                                       p_key->color_start.green / 255.0f,
+                                       p_key->color_start.blue / 255.0f,
+                                       p_key->color_start.alpha / 255.0f);
+    case PATTERN_LINEAR:
+      pattern = cairo_pattern_create_linear(p_key->x0, p_key->y0,
+                                            p_key->x1, p_key->y1);
+      break;
+    case PATTERN_RADIAL:
+      pattern = cairo_pattern_create_radial(p_key->x0, p_key->y0, p_key->r0,
+                                            p_key->x1, p_key->y1, p_key->r1);
+      break;
+  }
+  add_color_stops(pattern, p_key->color_start, p_key->color_end);
+  return pattern;
+}
+
+// Returns a reference for the caller, on top of the one the cache
+// keeps while it can
+static cairo_pattern_t* find_pattern(scenic_cairo_ctx_t* p_ctx,
+                                     const pattern_key_t* p_key)
+{
+  pattern_cache_t* p_cache = p_ctx->patterns;
+  cached_pattern_t* p_entry = NULL;
+  if (p_cache) {
+    p_entry = tommy_hashlin_search(&p_cache->patterns, _comparator, p_key,
+                                   HASH_KEY(p_key));
+  }
+  if (p_entry) {
+    p_entry->frame = p_cache->frame;
+    unlink_pattern(p_cache, p_entry);
+    link_newest(p_cache, p_entry);
+    return cairo_pattern_reference(p_entry->pattern);
+  }
+
+  cairo_pattern_t* pattern = create_pattern(p_key);
+  if (p_cache) p_entry = malloc(sizeof(cached_pattern_t));
+  if (!p_entry) return pattern;
+
+  while (p_cache->p_oldest && p_cache->count >= PATTERN_CACHE_SIZE) {
+    free_pattern(p_cache, p_cache->p_oldest);
+  }
+
+  *p_entry = (cached_pattern_t){
+    .key = *p_key,
+    .pattern = pattern,
+    .frame = p_cache->frame
+  };
+  tommy_hashlin_insert(&p_cache->patterns, &p_entry->node, p_entry,
+                       HASH_KEY(p_key));
+  link_newest(p_cache, p_entry);
+  p_cache->count++;
+  return cairo_pattern_reference(pattern);
+}
+
+cairo_pattern_t* find_rgba_pattern(scenic_cairo_ctx_t* p_ctx, color_rgba_t color)
+{
+  pattern_key_t key;
+  memset(&key, 0, sizeof(key));
+  key.type = PATTERN_RGBA;
+  key.color_start = color;
+  return find_pattern(p_ctx, &key);
+}
+
+cairo_pattern_t* find_linear_pattern(scenic_cairo_ctx_t* p_ctx,
+                                     coordinates_t start, coordinates_t end,
+                                     color_rgba_t color_start, color_rgba_t color_end)
+{
+  pattern_key_t key;
+  memset(&key, 0, sizeof(key));
+  key.type = PATTERN_LINEAR;
+  key.x0 = start.x;
+  key.y0 = start.y;
+  key.x1 = end.x;
+  key.y1 = end.y;
+  key.color_start = color_start;
+  key.color_end = color_end;
+  return find_pattern(p_ctx, &key);
+}
+
+cairo_pattern_t* find_radial_pattern(scenic_cairo_ctx_t* p_ctx,
+                                     coordinates_t center,
+                                     float inner_radius, float outer_radius,
+                                     color_rgba_t color_start, color_rgba_t color_end)
+{
+  pattern_key_t key;
+  memset(&key, 0, sizeof(key));
+  key.type = PATTERN_RADIAL;
+  key.x0 = key.x1 = center.x;
+  key.y0 = key.y1 = center.y;
+  key.r0 = inner_radius;
+  key.r1 = outer_radius;
+  key.color_start = color_start;
+  key.color_end = color_end;
+  return find_pattern(p_ctx, &key);
+}
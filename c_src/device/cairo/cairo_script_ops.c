@@ -6,6 +6,7 @@
 #include "comms.h"
 #include "font.h"
 #include "font_ops.h"
+#include "frame_arena.h"
 #include "image.h"
 #include "script.h"
 #include "script_ops.h"
@@ -16,11 +17,13 @@ static const char* log_prefix = "cairo";
 
 void set_fill_pattern(scenic_cairo_ctx_t* p_ctx, cairo_pattern_t* pattern)
 {
+  if (p_ctx->pattern.fill) cairo_pattern_destroy(p_ctx->pattern.fill);
   p_ctx->pattern.fill = pattern;
 }
 
 void set_stroke_pattern(scenic_cairo_ctx_t* p_ctx, cairo_pattern_t* pattern)
 {
+  if (p_ctx->pattern.stroke) cairo_pattern_destroy(p_ctx->pattern.stroke);
   p_ctx->pattern.stroke = pattern;
 }
 
@@ -264,10 +267,15 @@ void script_ops_draw_text(void* v_ctx,
 
   scenic_cairo_ctx_t* p_ctx = (scenic_cairo_ctx_t*)v_ctx;
 
-  cairo_glyph_t* glyphs = NULL;
-  int glyph_count;
-  cairo_text_cluster_t* clusters = NULL;
-  int cluster_count;
+  // Offer cairo buffers from the frame arena. There is never more than
+  // one glyph or cluster per byte of text, so they are big enough that
+  // cairo won't allocate its own.
+  cairo_glyph_t* arena_glyphs = frame_alloc(size * sizeof(cairo_glyph_t));
+  cairo_text_cluster_t* arena_clusters = frame_alloc(size * sizeof(cairo_text_cluster_t));
+  cairo_glyph_t* glyphs = arena_glyphs;
+  int glyph_count = arena_glyphs ? size : 0;
+  cairo_text_cluster_t* clusters = arena_clusters;
+  int cluster_count = arena_clusters ? size : 0;
   cairo_text_cluster_flags_t cluster_flags;
 
   cairo_scaled_font_t* scaled_font = cairo_get_scaled_font(p_ctx->cr);
@@ -333,6 +341,10 @@ void script_ops_draw_text(void* v_ctx,
     log_error("%s: cairo_scaled_font_text_to_glyphs: error %d", __func__, status);
   }
   cairo_restore(p_ctx->cr);
+
+  // in case cairo needed bigger buffers after all
+  if (glyphs != arena_glyphs) cairo_glyph_free(glyphs);
+  if (clusters != arena_clusters) cairo_text_cluster_free(clusters);
 }
 
 static void draw_sprite(scenic_cairo_ctx_t* p_ctx,
@@ -353,21 +365,17 @@ static void draw_sprite(scenic_cairo_ctx_t* p_ctx,
 }
 
 void script_ops_draw_sprites(void* v_ctx,
-                             sid_t id,
+                             image_t* p_image,
                              uint32_t count,
                              const sprite_t* sprites)
 {
   if (g_opts.debug_mode) {
     log_script_ops_draw_sprites(log_prefix, __func__, log_level_info,
-                                id, count, sprites);
+                                p_image, count, sprites);
   }
 
   scenic_cairo_ctx_t* p_ctx = (scenic_cairo_ctx_t*)v_ctx;
 
-  // get the mapped image_id for this driver_id
-  image_t* p_image = get_image(id);
-  if (!p_image) return;
-
   image_pattern_data_t* image_data = find_image_pattern(p_ctx, p_image->image_id);
 
   for (uint32_t i = 0; i < count; i++) {
@@ -692,11 +700,7 @@ void script_ops_fill_color(void* v_ctx,
 
   scenic_cairo_ctx_t* p_ctx = (scenic_cairo_ctx_t*)v_ctx;
 
-  cairo_pattern_t* color_rgba = cairo_pattern_create_rgba(color.red / 255.0f,
-                                                          color.green / 255.0f,
-                                                          color.blue / 255.0f,
-                                                          color.alpha / 255.0f);
-  set_fill_pattern(p_ctx, color_rgba);
+  set_fill_pattern(p_ctx, find_rgba_pattern(p_ctx, color));
 }
 
 void script_ops_fill_linear(void* v_ctx,
@@ -710,19 +714,8 @@ void script_ops_fill_linear(void* v_ctx,
 
   scenic_cairo_ctx_t* p_ctx = (scenic_cairo_ctx_t*)v_ctx;
 
-  cairo_pattern_t* linear_gradient = cairo_pattern_create_linear(start.x, start.y,
-                                                                 end.x, end.y);
-  cairo_pattern_add_color_stop_rgba(linear_gradient, 0.0,
-                                    color_start.red / 255.0f,
-                                    color_start.green / 255.0f,
-                                    color_start.blue / 255.0f,
-                                    color_start.alpha / 255.0f);
-  cairo_pattern_add_color_stop_rgba(linear_gradient, 1.0,
-                                    color_end.red / 255.0f,
-                                    color_end.green / 255.0f,
-                                    color_end.blue / 255.0f,
-                                    color_end.alpha / 255.0f);
-  set_fill_pattern(p_ctx, linear_gradient);
+  set_fill_pattern(p_ctx, find_linear_pattern(p_ctx, start, end,
+                                                color_start, color_end));
 }
 
 void script_ops_fill_radial(void* v_ctx,
@@ -739,51 +732,35 @@ void script_ops_fill_radial(void* v_ctx,
 
   scenic_cairo_ctx_t* p_ctx = (scenic_cairo_ctx_t*)v_ctx;
 
-  cairo_pattern_t* radial_gradient = cairo_pattern_create_radial(center.x, center.y,
-                                                                 inner_radius,
-                                                                 center.x, center.y,
-                                                                 outer_radius);
-  cairo_pattern_add_color_stop_rgba(radial_gradient, 0.0,
-                                    color_start.red / 255.0f,
-                                    color_start.green / 255.0f,
-                                    color_start.blue / 255.0f,
-                                    color_start.alpha / 255.0f);
-  cairo_pattern_add_color_stop_rgba(radial_gradient, 1.0,
-                                    color_end.red / 255.0f,
-                                    color_end.green / 255.0f,
-                                    color_end.blue / 255.0f,
-                                    color_end.alpha / 255.0f);
-  set_fill_pattern(p_ctx, radial_gradient);
+  set_fill_pattern(p_ctx, find_radial_pattern(p_ctx, center,
+                                                inner_radius, outer_radius,
+                                                color_start, color_end));
 }
 
-void script_ops_fill_image(void* v_ctx, sid_t id)
+void script_ops_fill_image(void* v_ctx, image_t* p_image)
 {
   if (g_opts.debug_mode) {
     log_script_ops_fill_image(log_prefix, __func__, log_level_info,
-                              id);
+                              p_image);
   }
 
   scenic_cairo_ctx_t* p_ctx = (scenic_cairo_ctx_t*)v_ctx;
 
-  // get the mapped image_id for this image_id
-  image_t* p_image = get_image(id);
-  if (!p_image) return;
-
   image_pattern_data_t* image_data = find_image_pattern(p_ctx, p_image->image_id);
 
   cairo_set_antialias(p_ctx->cr, CAIRO_ANTIALIAS_NONE);
-  set_fill_pattern(p_ctx, image_data->pattern);
+  set_fill_pattern(p_ctx, cairo_pattern_reference(image_data->pattern));
 }
 
 void script_ops_fill_stream(void* v_ctx,
-                            sid_t id)
+                            image_t* p_image)
 {
   if (g_opts.debug_mode) {
     log_script_ops_fill_stream(log_prefix, __func__, log_level_info,
-                               id);
+                               p_image);
   }
 
-  script_ops_fill_image(v_ctx, id);
+  script_ops_fill_image(v_ctx, p_image);
 }
 
 void script_ops_stroke_width(void* v_ctx,
@@ -809,11 +786,7 @@ void script_ops_stroke_color(void* v_ctx,
 
   scenic_cairo_ctx_t* p_ctx = (scenic_cairo_ctx_t*)v_ctx;
 
-  cairo_pattern_t* color_rgba = cairo_pattern_create_rgba(color.red / 255.0f,
-                                                          color.green / 255.0f,
-                                                          color.blue / 255.0f,
-                                                          color.alpha / 255.0f);
-  set_stroke_pattern(p_ctx, color_rgba);
+  set_stroke_pattern(p_ctx, find_rgba_pattern(p_ctx, color));
 }
 
 void script_ops_stroke_linear(void* v_ctx,
@@ -827,19 +800,8 @@ void script_ops_stroke_linear(void* v_ctx,
 
   scenic_cairo_ctx_t* p_ctx = (scenic_cairo_ctx_t*)v_ctx;
 
-  cairo_pattern_t* linear_gradient = cairo_pattern_create_linear(start.x, start.y,
-                                                                 end.x, end.y);
-  cairo_pattern_add_color_stop_rgba(linear_gradient, 0.0,
-                                    color_start.red / 255.0f,
-                                    color_start.green / 255.0f,
-                                    color_start.blue / 255.0f,
-                                    color_start.alpha / 255.0f);
-  cairo_pattern_add_color_stop_rgba(linear_gradient, 1.0,
-                                    color_end.red / 255.0f,
-                                    color_end.green / 255.0f,
-                                    color_end.blue / 255.0f,
-                                    color_end.alpha / 255.0f);
-  set_stroke_pattern(p_ctx, linear_gradient);
+  set_stroke_pattern(p_ctx, find_linear_pattern(p_ctx, start, end,
+                                                color_start, color_end));
 }
 
 void script_ops_stroke_radial(void* v_ctx,
@@ -856,51 +818,35 @@ void script_ops_stroke_radial(void* v_ctx,
 
   scenic_cairo_ctx_t* p_ctx = (scenic_cairo_ctx_t*)v_ctx;
 
-  cairo_pattern_t* radial_gradient = cairo_pattern_create_radial(center.x, center.y,
-                                                                 inner_radius,
-                                                                 center.x, center.y,
-                                                                 outer_radius);
-  cairo_pattern_add_color_stop_rgba(radial_gradient, 0.0,
-                                    color_start.red / 255.0f,
-                                    color_start.green / 255.0f,
-                                    color_start.blue / 255.0f,
-                                    color_start.alpha / 255.0f);
-  cairo_pattern_add_color_stop_rgba(radial_gradient, 1.0,
-                                    color_end.red / 255.0f,
-                                    color_end.green / 255.0f,
-                                    color_end.blue / 255.0f,
-                                    color_end.alpha / 255.0f);
-  set_stroke_pattern(p_ctx, radial_gradient);
+  set_stroke_pattern(p_ctx, find_radial_pattern(p_ctx, center,
+                                                inner_radius, outer_radius,
+                                                color_start, color_end));
 }
 
-void script_ops_stroke_image(void* v_ctx, sid_t id)
+void script_ops_stroke_image(void* v_ctx, image_t* p_image)
 {
   if (g_opts.debug_mode) {
     log_script_ops_stroke_image(log_prefix, __func__, log_level_info,
-                                id);
+                                p_image);
   }
 
   scenic_cairo_ctx_t* p_ctx = (scenic_cairo_ctx_t*)v_ctx;
 
-  // get the mapped image_id for this image_id
-  image_t* p_image = get_image(id);
-  if (!p_image) return;
-
   image_pattern_data_t* image_data = find_image_pattern(p_ctx, p_image->image_id);
 
   cairo_set_antialias(p_ctx->cr, CAIRO_ANTIALIAS_NONE);
-  set_stroke_pattern(p_ctx, image_data->pattern);
+  set_stroke_pattern(p_ctx, cairo_pattern_reference(image_data->pattern));
 }
 
 void script_ops_stroke_stream(void* v_ctx,
-                              sid_t id)
+                              image_t* p_image)
 {
   if (g_opts.debug_mode) {
     log_script_ops_stroke_stream(log_prefix, __func__, log_level_info,
-                                 id);
+                                 p_image);
   }
 
-  script_ops_stroke_image(v_ctx, id);
+  script_ops_stroke_image(v_ctx, p_image);
 }
 
 void script_ops_line_cap(void* v_ctx,
@@ -960,17 +906,14 @@ void script_ops_miter_limit(void* v_ctx,
 }
 
 void script_ops_font(void* v_ctx,
-                     sid_t id)
+                     font_t* p_font)
 {
   if (g_opts.debug_mode) {
     log_script_ops_font(log_prefix, __func__, log_level_info,
-                        id);
+                        p_font);
   }
 
   scenic_cairo_ctx_t* p_ctx = (scenic_cairo_ctx_t*)v_ctx;
-  font_t* p_font = get_font(id);
-  if (!p_font) return;
-
   font_data_t* font_data = find_font(p_ctx, p_font->font_id);
   if (!font_data) return;
 
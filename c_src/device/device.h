@@ -13,8 +13,20 @@ int device_init(const device_opts_t* p_opts,
                 driver_data_t* p_data);
 int device_close(device_info_t* p_info);
 void device_poll();
+int64_t device_poll_interval();
 void device_loop(driver_data_t* p_data);
 void device_begin_render(driver_data_t* p_data);
+void device_root_transform(driver_data_t* p_data, float* p_tx);
+bool device_redraws_damage();
+bool device_keeps_scene(driver_data_t* p_data);
+void* device_layer_begin(void* v_ctx, int x, int y, int width, int height);
+void device_layer_end(void* v_ctx, void* p_layer);
+void device_layer_draw(void* v_ctx, void* p_layer, int x, int y);
+void* device_recording_begin(void* v_ctx, float x, float y, float width, float height);
+void device_recording_draw(void* v_ctx, void* p_layer);
+void device_layer_free(void* p_layer);
+void* device_band_begin(driver_data_t* p_data, int band, int y0, int y1);
+void device_band_end(driver_data_t* p_data, int band, void* v_band);
 void device_begin_cursor_render(driver_data_t* p_data);
 void device_end_render(driver_data_t* p_data);
 void device_clear_color(float red, float green, float blue, float alpha);
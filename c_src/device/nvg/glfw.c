@@ -27,6 +27,7 @@
 #include "scenic_types.h"
 #include "utils.h"
 #include "comms.h"
+#include "damage.h"
 #include "device.h"
 
 #define STDIN_FILENO 0
@@ -87,6 +88,8 @@ void reshape_window(GLFWwindow* window, int w, int h)
 
   glViewport(0, 0, fw, fh);
   glClear(GL_COLOR_BUFFER_BIT);
+  // the frame is gone, so the next one can't be skipped
+  damage_all();
 
   g_glfw_data.p_info->width = w;
   g_glfw_data.p_info->height = h;
@@ -375,6 +378,13 @@ void device_end_render(driver_data_t* p_data)
 void device_poll()
 {
   glfwPollEvents();
+  input_flush();
+}
+
+// glfw events have to be pumped from this thread
+int64_t device_poll_interval()
+{
+  return 8000;
 }
 
 //---------------------------------------------------------
@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "device.h"
 #include "scenic_ops.h"
 
@@ -5,3 +7,9 @@ void device_loop(driver_data_t* p_data)
 {
   scenic_loop(p_data);
 }
+
+// every nanovg device starts the frame with the global transform
+void device_root_transform(driver_data_t* p_data, float* p_tx)
+{
+  memcpy(p_tx, p_data->global_tx, sizeof(p_data->global_tx));
+}
@@ -244,16 +244,12 @@ void script_ops_draw_text(void* v_ctx,
 //---------------------------------------------------------
 // see: https://github.com/memononen/nanovg/issues/348
 static void draw_image(NVGcontext* p_ctx,
-                       sid_t id,
+                       const image_t* p_image,
                        const sprite_t sprite)
 {
   float ax, ay;
   NVGpaint img_pattern;
 
-  // get the mapped image_id for this driver_id
-  image_t* p_image = get_image(id);
-  if (!p_image) return;
-
   // get the dimensions of the image
   int iw,ih;
   nvgImageSize(p_ctx, p_image->image_id, &iw, &ih);
@@ -280,18 +276,18 @@ static void draw_image(NVGcontext* p_ctx,
 }
 
 void script_ops_draw_sprites(void* v_ctx,
-                             sid_t id,
+                             image_t* p_image,
                              uint32_t count,
                              const sprite_t* sprites)
 {
   if (g_opts.debug_mode) {
     log_script_ops_draw_sprites(log_prefix, __func__, log_level_info,
-                                id, count, sprites);
+                                p_image, count, sprites);
   }
 
   NVGcontext* p_ctx = (NVGcontext*)v_ctx;
   for (int i = 0; i < count; i++) {
-    draw_image(p_ctx, id, sprites[i]);
+    draw_image(p_ctx, p_image, sprites[i]);
   }
 }
 
@@ -563,18 +559,14 @@ void script_ops_fill_radial(void* v_ctx,
 }
 
 void script_ops_fill_image(void* v_ctx,
-                           sid_t id)
+                           image_t* p_image)
 {
   if (g_opts.debug_mode) {
     log_script_ops_fill_image(log_prefix, __func__, log_level_info,
-                              id);
+                              p_image);
   }
 
   NVGcontext* p_ctx = (NVGcontext*)v_ctx;
-  // get the mapped image_id for this image_id
-  image_t* p_image = get_image(id);
-  if (!p_image) return;
-
   // get the dimensions of the image
   int w,h;
   nvgImageSize(p_ctx, p_image->image_id, &w, &h);
@@ -586,14 +578,14 @@ void script_ops_fill_image(void* v_ctx,
 }
 
 void script_ops_fill_stream(void* v_ctx,
-                            sid_t id)
+                            image_t* p_image)
 {
   if (g_opts.debug_mode) {
     log_script_ops_fill_stream(log_prefix, __func__, log_level_info,
-                               id);
+                               p_image);
   }
 
-  script_ops_fill_image(v_ctx, id);
+  script_ops_fill_image(v_ctx, p_image);
 }
 
 void script_ops_stroke_width(void* v_ctx,
@@ -677,18 +669,14 @@ void script_ops_stroke_radial(void* v_ctx,
 }
 
 void script_ops_stroke_image(void* v_ctx,
-                             sid_t id)
+                             image_t* p_image)
 {
   if (g_opts.debug_mode) {
     log_script_ops_stroke_image(log_prefix, __func__, log_level_info,
-                                id);
+                                p_image);
   }
 
   NVGcontext* p_ctx = (NVGcontext*)v_ctx;
-  // get the mapped image_id for this image_id
-  image_t* p_image = get_image(id);
-  if (!p_image) return;
-
   // get the dimensions of the image
   int w,h;
   nvgImageSize(p_ctx, p_image->image_id, &w, &h);
@@ -700,14 +688,14 @@ void script_ops_stroke_image(void* v_ctx,
 }
 
 void script_ops_stroke_stream(void* v_ctx,
-                              sid_t id)
+                              image_t* p_image)
 {
   if (g_opts.debug_mode) {
     log_script_ops_stroke_stream(log_prefix, __func__, log_level_info,
-                                 id);
+                                 p_image);
   }
 
-  script_ops_stroke_image(v_ctx, id);
+  script_ops_stroke_image(v_ctx, p_image);
 }
 
 void script_ops_line_cap(void* v_ctx,
@@ -767,17 +755,15 @@ void script_ops_miter_limit(void* v_ctx,
 }
 
 void script_ops_font(void* v_ctx,
-                     sid_t id)
+                     font_t* p_font)
 {
   if (g_opts.debug_mode) {
     log_script_ops_font(log_prefix, __func__, log_level_info,
-                        id);
+                        p_font);
   }
 
   NVGcontext* p_ctx = (NVGcontext*)v_ctx;
-  font_t* p_font = get_font(id);
-  if (p_font)
-    nvgFontFaceId(p_ctx, p_font->font_id);
+  nvgFontFaceId(p_ctx, p_font->font_id);
 }
 
 void script_ops_font_size(void* v_ctx,
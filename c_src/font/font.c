@@ -100,4 +100,9 @@ void put_font(uint32_t* p_msg_length, void* v_ctx)
 
   // insert the script into the tommy hash
   tommy_hashlin_insert(&fonts, &p_font->node, p_font, HASH_ID(p_font->id));
+
+  // and make it what the id's handle refers to
+  p_font->handle = handle_intern(p_font->id);
+  handle_slot(p_font->handle)->p_font = p_font;
+  handle_touch(p_font->handle);
 }
@@ -1,12 +1,14 @@
 #pragma once
 
 #include <stdint.h>
+#include "handle.h"
 #include "scenic_types.h"
 #include "tommyhashlin.h"
 
 typedef struct {
   int font_id;
   sid_t id;
+  handle_t handle;
   data_t blob;
   tommy_hashlin_node node;
 } font_t;
@@ -12,6 +12,7 @@
 #include "image.h"
 #include "image_ops.h"
 #include "scenic_types.h"
+#include "shm.h"
 #include "utils.h"
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -56,6 +57,9 @@ void image_free(void* v_ctx, image_t* p_image)
 {
   if (p_image) {
     tommy_hashlin_remove_existing(&images, &p_image->node);
+    handle_slot(p_image->handle)->p_image = NULL;
+    handle_touch(p_image->handle);
+    handle_release(p_image->handle);
     image_ops_delete(v_ctx, p_image->image_id);
 
     free(p_image);
@@ -77,20 +81,12 @@ void reset_images(void* v_ctx)
 }
 
 //---------------------------------------------------------
-int read_pixels(void* p_pixels,
-                uint32_t width, uint32_t height,
-                image_format_t format_in,
-                uint32_t* p_msg_length)
+// convert incoming pixel data into the rgba pixel format
+int convert_pixels(void* p_pixels,
+                   uint32_t width, uint32_t height,
+                   image_format_t format_in,
+                   void* p_buffer, uint32_t buffer_size)
 {
-  // read incoming data into a temporary buffer
-  int buffer_size = *p_msg_length;
-  void* p_buffer = malloc(buffer_size);
-  if (!p_buffer) {
-    log_error("Unable to alloc temporary pixel buffer!!");
-    return -1;
-  }
-  read_bytes_down(p_buffer, buffer_size, p_msg_length);
-
   unsigned int pixel_count = width * height;
   unsigned int src_i;
   unsigned int dst_i;
@@ -149,39 +145,15 @@ int read_pixels(void* p_pixels,
     break;
   }
 
-  // clean up
-  if (p_buffer) free(p_buffer);
-
   return 0;
 }
 
 //---------------------------------------------------------
-void put_image(uint32_t* p_msg_length, void* v_ctx)
+static void do_put_image(void* v_ctx, sid_t id,
+                         uint32_t width, uint32_t height,
+                         image_format_t format,
+                         void* p_blob, uint32_t blob_size)
 {
-  // read in the fixed size data
-  uint32_t id_length;
-  uint32_t blob_size;
-  uint32_t width;
-  uint32_t height;
-  image_format_t format;
-  read_bytes_down(&id_length, sizeof(uint32_t), p_msg_length);
-  read_bytes_down(&blob_size, sizeof(uint32_t), p_msg_length);
-  read_bytes_down(&width, sizeof(uint32_t), p_msg_length);
-  read_bytes_down(&height, sizeof(uint32_t), p_msg_length);
-  read_bytes_down(&format, sizeof(uint32_t), p_msg_length);
-
-  // read the id into a temp buffer
-  void* p_temp_id = calloc(1, id_length + 1);
-  if (!p_temp_id) {
-    log_error("Unable to allocate image p_temp_id");
-    return;
-  }
-
-  read_bytes_down(p_temp_id, id_length, p_msg_length);
-  sid_t id;
-  id.size = id_length;
-  id.p_data = p_temp_id;
-
   // get the existing image record, if there is one
   image_t* p_image = get_image(id);
 
@@ -189,7 +161,6 @@ void put_image(uint32_t* p_msg_length, void* v_ctx)
   if (p_image
       && ((width != p_image->width) || (height != p_image->height))) {
     log_error("Cannot change image size");
-    free(p_temp_id);
     return;
   }
 
@@ -198,14 +169,12 @@ void put_image(uint32_t* p_msg_length, void* v_ctx)
     // initialize a record to hold the image
     int struct_size = ALIGN_UP(sizeof(image_t), 8);
     // the +1 is so the id is null terminated
-    int id_size = ALIGN_UP(id_length + 1, 8);
+    int id_size = ALIGN_UP(id.size + 1, 8);
     int pixel_size = width * height * 4;
     int alloc_size = struct_size + id_size + pixel_size;
-
     p_image = malloc(alloc_size);
     if (!p_image) {
       log_error("Unable to allocate image struct");
-      free(p_temp_id);
       return;
     }
 
@@ -216,15 +185,15 @@ void put_image(uint32_t* p_msg_length, void* v_ctx)
     p_image->format = format;
 
     // initialize the id
-    p_image->id.size = id_length;
+    p_image->id.size = id.size;
     p_image->id.p_data = ((void*)p_image) + struct_size;
-    memcpy(p_image->id.p_data, p_temp_id, id_length);
+    memcpy(p_image->id.p_data, id.p_data, id.size);
 
     // initialize the pixel pointer
     p_image->p_pixels = ((void*)p_image) + struct_size + id_size;
 
     // get the image data in pixel format
-    read_pixels(p_image->p_pixels, width, height, format, p_msg_length);
+    convert_pixels(p_image->p_pixels, width, height, format, p_blob, blob_size);
 
     // create a texture from the pixel data
     p_image->image_id = image_ops_create(v_ctx, width, height, p_image->p_pixels);
@@ -232,12 +201,104 @@ void put_image(uint32_t* p_msg_length, void* v_ctx)
     // save the image record into the tommyhash
     tommy_hashlin_insert(&images, &p_image->node, p_image, HASH_ID(p_image->id));
 
+    // and make it what the id's handle refers to
+    p_image->handle = handle_intern(p_image->id);
+    handle_slot(p_image->handle)->p_image = p_image;
+    handle_touch(p_image->handle);
   } else {
     // the image already exists and is the right size.
     // can save some bit of work by replacing the pixels of the existing image
-    read_pixels(p_image->p_pixels, width, height, format, p_msg_length);
+    convert_pixels(p_image->p_pixels, width, height, format, p_blob, blob_size);
     image_ops_update(v_ctx, p_image->image_id, p_image->p_pixels);
+    handle_touch(p_image->handle);
+  }
+}
+
+//---------------------------------------------------------
+void put_image(uint32_t* p_msg_length, void* v_ctx)
+{
+  // read in the fixed size data
+  uint32_t id_length;
+  uint32_t blob_size;
+  uint32_t width;
+  uint32_t height;
+  image_format_t format;
+  read_bytes_down(&id_length, sizeof(uint32_t), p_msg_length);
+  read_bytes_down(&blob_size, sizeof(uint32_t), p_msg_length);
+  read_bytes_down(&width, sizeof(uint32_t), p_msg_length);
+  read_bytes_down(&height, sizeof(uint32_t), p_msg_length);
+  read_bytes_down(&format, sizeof(uint32_t), p_msg_length);
+
+  if (id_length > *p_msg_length) {
+    log_error("Invalid image id length");
+    return;
+  }
+
+  // the id and pixels are the rest of the message. Work straight out of
+  // the input buffer if they fit in it, otherwise read them into a
+  // temporary buffer
+  uint32_t data_size = *p_msg_length;
+  void* p_alloc = NULL;
+  void* p_data = borrow_bytes_down(data_size, p_msg_length);
+  if (!p_data) {
+    p_data = p_alloc = malloc(data_size);
+    if (!p_data) {
+      log_error("Unable to alloc temporary pixel buffer!!");
+      return;
+    }
+    read_bytes_down(p_data, data_size, p_msg_length);
+  }
+
+  sid_t id;
+  id.size = id_length;
+  id.p_data = p_data;
+
+  do_put_image(v_ctx, id, width, height, format,
+               p_data + id_length, data_size - id_length);
+
+  if (p_alloc) free(p_alloc);
+}
+
+//---------------------------------------------------------
+// same as put_image, but the pixels are in a shared memory slot
+void put_image_shm(uint32_t* p_msg_length, void* v_ctx)
+{
+  uint32_t id_length;
+  uint32_t blob_size;
+  uint32_t width;
+  uint32_t height;
+  image_format_t format;
+  uint32_t slot;
+  uint32_t path_length;
+  read_bytes_down(&id_length, sizeof(uint32_t), p_msg_length);
+  read_bytes_down(&blob_size, sizeof(uint32_t), p_msg_length);
+  read_bytes_down(&width, sizeof(uint32_t), p_msg_length);
+  read_bytes_down(&height, sizeof(uint32_t), p_msg_length);
+  read_bytes_down(&format, sizeof(uint32_t), p_msg_length);
+  read_bytes_down(&slot, sizeof(uint32_t), p_msg_length);
+  read_bytes_down(&path_length, sizeof(uint32_t), p_msg_length);
+
+  // the id and path are small, borrow them in one go
+  void* p_names = borrow_bytes_down(id_length + path_length, p_msg_length);
+  if (!p_names) {
+    log_error("Unable to read image id");
+    shm_release(slot);
+    return;
+  }
+
+  sid_t id;
+  id.size = id_length;
+  id.p_data = p_names;
+
+  sid_t path;
+  path.size = path_length;
+  path.p_data = p_names + id_length;
+
+  // convert straight out of the shared memory
+  void* p_blob = shm_map(slot, path, blob_size);
+  if (p_blob) {
+    do_put_image(v_ctx, id, width, height, format, p_blob, blob_size);
   }
 
-  free(p_temp_id);
+  shm_release(slot);
 }
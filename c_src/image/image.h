@@ -6,11 +6,13 @@
 
 #pragma once
 
+#include "handle.h"
 #include "scenic_types.h"
 #include "tommyhashlin.h"
 
 typedef struct {
   sid_t id;
+  handle_t handle;
   int32_t image_id;
   uint32_t width;
   uint32_t height;
@@ -29,5 +31,6 @@ typedef enum {
 
 void init_images(void);
 void put_image(uint32_t* p_msg_length, void* v_ctx);
+void put_image_shm(uint32_t* p_msg_length, void* v_ctx);
 void reset_images(void* v_ctx);
 image_t* get_image(sid_t id);
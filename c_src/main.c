@@ -13,10 +13,14 @@
 #include <stdint.h>
 #include <assert.h>
 
+#include "bands.h"
+#include "capture.h"
 #include "comms.h"
 #include "scenic_types.h"
 #include "image.h"
 #include "font.h"
+#include "handle.h"
+#include "layer_cache.h"
 #include "script.h"
 
 #include "device.h"
@@ -29,8 +33,24 @@ int main(int argc, char **argv)
 {
   driver_data_t data = {0};
 
+  // Replay a capture instead of listening to the caller. The output
+  // is still the port protocol, so send stdout somewhere harmless.
+  //   scenic_driver_local --replay <file> [--fast] <the usual args> > /dev/null
+  const char* replay = NULL;
+  bool replay_fast = false;
+  if (argc > 2 && strcmp(argv[1], "--replay") == 0) {
+    replay = argv[2];
+    argv += 2;
+    argc -= 2;
+    if (argc > 1 && strcmp(argv[1], "--fast") == 0) {
+      replay_fast = true;
+      argv++;
+      argc--;
+    }
+  }
+
   // super simple arg check
-  if (argc != 12) {
+  if (argc != 15) {
     log_error("Wrong number of parameters");
     return -1;
   }
@@ -47,11 +67,24 @@ int main(int argc, char **argv)
   g_opts.resizable = atoi(argv[9]);
   g_opts.fbdev = argv[10];
   g_opts.title = argv[11];
+  g_opts.capture = argv[12];
+  g_opts.optimize_scripts = atoi(argv[13]);
+  g_opts.render_threads = atoi(argv[14]);
+
+  if (replay && !replay_start(replay, replay_fast)) {
+    return -1;
+  }
+  if (g_opts.capture[0]) {
+    capture_open(g_opts.capture);
+  }
 
   // init the hashtables
+  init_handles();
   init_scripts();
+  init_layers();
   init_fonts();
   init_images();
+  init_bands(g_opts.render_threads);
 
   // prep the driver data
   data.keep_going = true;
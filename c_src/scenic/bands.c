@@ -0,0 +1,150 @@
+/*
+#  Bands. See bands.h
+*/
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bands.h"
+#include "damage.h"
+#include "device.h"
+#include "frame_arena.h"
+#include "log.h"
+#include "script.h"
+
+band_stats_t g_band_stats = {0};
+
+typedef struct {
+  void* v_band;   // from device_band_begin
+  int y0, y1;
+} band_t;
+
+// the frame being drawn
+static band_t bands[MAX_RENDER_BANDS];
+static int band_count = 0;
+static const sid_t* p_band_root = NULL;
+static const float* p_band_tx = NULL;
+
+// worker i draws band i + 1
+static int worker_count = 0;
+static pthread_t workers[MAX_RENDER_BANDS - 1];
+
+// job goes up to start the workers on a frame, and the scenic thread
+// waits for bands_left to come down to 0
+static pthread_mutex_t band_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t start_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static uint32_t job = 0;
+static int bands_left = 0;
+
+//---------------------------------------------------------
+static int64_t usecs_now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+//---------------------------------------------------------
+static void draw_band(int band)
+{
+  int64_t start = usecs_now();
+  render_script_band(bands[band].v_band, *p_band_root, p_band_tx,
+                     band, bands[band].y0, bands[band].y1);
+  g_band_stats.usecs[band] += usecs_now() - start;
+}
+
+//---------------------------------------------------------
+static void* band_worker(void* user_data)
+{
+  int band = (int)(intptr_t)user_data;
+  uint32_t done_job = 0;
+
+  for (;;) {
+    pthread_mutex_lock(&band_mutex);
+    while (job == done_job) {
+      pthread_cond_wait(&start_cond, &band_mutex);
+    }
+    done_job = job;
+    bool drawing = band < band_count;
+    pthread_mutex_unlock(&band_mutex);
+    if (!drawing) continue;
+
+    // this thread's scratch memory from its last band is free again
+    frame_arena_reset();
+    draw_band(band);
+
+    pthread_mutex_lock(&band_mutex);
+    if (--bands_left == 0) pthread_cond_signal(&done_cond);
+    pthread_mutex_unlock(&band_mutex);
+  }
+
+  return NULL;
+}
+
+//---------------------------------------------------------
+void init_bands(int threads)
+{
+  if (threads == 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads > MAX_RENDER_BANDS) threads = MAX_RENDER_BANDS;
+
+  while (worker_count < threads - 1) {
+    int band = worker_count + 1;
+    if (pthread_create(&workers[worker_count], NULL, band_worker,
+                       (void*)(intptr_t)band)) {
+      log_error("Unable to start band thread %d", band);
+      return;
+    }
+    worker_count++;
+  }
+}
+
+//---------------------------------------------------------
+bool render_bands(driver_data_t* p_data, sid_t id, const float* p_root_tx)
+{
+  if (worker_count == 0 || box_is_empty(g_damage.bounds)) return false;
+
+  // the damage is in whole pixels
+  int top = (int)g_damage.bounds.y0;
+  int rows = (int)g_damage.bounds.y1 - top;
+  int count = rows / MIN_BAND_ROWS;
+  if (count > worker_count + 1) count = worker_count + 1;
+  if (count < 2) return false;
+
+  for (int i = 0; i < count; i++) {
+    bands[i].y0 = top + rows * i / count;
+    bands[i].y1 = top + rows * (i + 1) / count;
+    bands[i].v_band = device_band_begin(p_data, i, bands[i].y0, bands[i].y1);
+    if (!bands[i].v_band) {
+      while (i-- > 0) device_band_end(p_data, i, bands[i].v_band);
+      return false;
+    }
+  }
+
+  pthread_mutex_lock(&band_mutex);
+  band_count = count;
+  p_band_root = &id;
+  p_band_tx = p_root_tx;
+  bands_left = count - 1;
+  job++;
+  pthread_cond_broadcast(&start_cond);
+  pthread_mutex_unlock(&band_mutex);
+
+  draw_band(0);
+
+  pthread_mutex_lock(&band_mutex);
+  while (bands_left > 0) {
+    pthread_cond_wait(&done_cond, &band_mutex);
+  }
+  pthread_mutex_unlock(&band_mutex);
+
+  for (int i = 0; i < count; i++) {
+    device_band_end(p_data, i, bands[i].v_band);
+  }
+
+  g_band_stats.frames++;
+  g_band_stats.count = count;
+  return true;
+}
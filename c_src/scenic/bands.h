@@ -0,0 +1,45 @@
+/*
+# Bands
+
+A frame can be split into horizontal bands that are drawn at the same
+time on a pool of threads, for devices that rasterize on the CPU. Each
+band only covers its own rows of the damage and draws the whole scene
+through a clip, so the scene has to be walked once per band, but the
+pixels are shared out between the threads.
+
+The device says whether it can draw bands. It gets one context per
+band from device_band_begin, all of them before any band is drawn, and
+hands each back in device_band_end once all of them are done. The
+scenic thread draws the first band itself.
+
+How long each band took to draw adds up in g_band_stats until whoever
+reports it resets it.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "scenic_types.h"
+
+#define MAX_RENDER_BANDS 16
+
+// bands thinner than this aren't worth a thread
+#define MIN_BAND_ROWS 32
+
+typedef struct {
+  int64_t usecs[MAX_RENDER_BANDS];  // drawing each band, summed
+  uint32_t frames;                  // drawn in bands
+  int count;                        // bands in the last of them
+} band_stats_t;
+
+extern band_stats_t g_band_stats;
+
+// threads is how many draw at once, counting the scenic thread.
+// 0 means one for each CPU.
+void init_bands(int threads);
+
+// Draw the damage in bands. Returns false without drawing anything if
+// the frame isn't worth splitting or the device can't.
+bool render_bands(driver_data_t* p_data, sid_t id, const float* p_root_tx);
@@ -0,0 +1,221 @@
+/*
+#  Conservative bounds. See bounds.h
+*/
+
+#include <math.h>
+
+#include "bounds.h"
+
+#define SQRT_2 1.41421356f
+
+//---------------------------------------------------------
+float join_factor(float miter_limit)
+{
+  return (miter_limit > SQRT_2) ? miter_limit : SQRT_2;
+}
+
+//=============================================================================
+// transforms
+
+affine_t affine_identity()
+{
+  return (affine_t){1, 0, 0, 1, 0, 0};
+}
+
+//---------------------------------------------------------
+affine_t affine_multiply(affine_t m, affine_t t)
+{
+  return (affine_t){
+    .a = m.a * t.a + m.c * t.b,
+    .b = m.b * t.a + m.d * t.b,
+    .c = m.a * t.c + m.c * t.d,
+    .d = m.b * t.c + m.d * t.d,
+    .e = m.a * t.e + m.c * t.f + m.e,
+    .f = m.b * t.e + m.d * t.f + m.f
+  };
+}
+
+//---------------------------------------------------------
+affine_t affine_translate(affine_t m, float x, float y)
+{
+  return affine_multiply(m, (affine_t){1, 0, 0, 1, x, y});
+}
+
+//---------------------------------------------------------
+affine_t affine_scale(affine_t m, float x, float y)
+{
+  return affine_multiply(m, (affine_t){x, 0, 0, y, 0, 0});
+}
+
+//---------------------------------------------------------
+affine_t affine_rotate(affine_t m, float radians)
+{
+  float s = sinf(radians);
+  float c = cosf(radians);
+  return affine_multiply(m, (affine_t){c, s, -s, c, 0, 0});
+}
+
+//---------------------------------------------------------
+// the largest singular value of the linear part
+float affine_norm(affine_t m)
+{
+  float sum = m.a * m.a + m.b * m.b + m.c * m.c + m.d * m.d;
+  float det = m.a * m.d - m.b * m.c;
+  float disc = sum * sum - 4 * det * det;
+  return sqrtf((sum + sqrtf(disc > 0 ? disc : 0)) / 2);
+}
+
+//=============================================================================
+// boxes
+
+box_t box_empty()
+{
+  return (box_t){INFINITY, INFINITY, -INFINITY, -INFINITY};
+}
+
+//---------------------------------------------------------
+box_t box_from_corners(float x0, float y0, float x1, float y1)
+{
+  return (box_t){fminf(x0, x1), fminf(y0, y1), fmaxf(x0, x1), fmaxf(y0, y1)};
+}
+
+//---------------------------------------------------------
+bool box_is_empty(box_t box)
+{
+  return box.x0 > box.x1 || box.y0 > box.y1;
+}
+
+//---------------------------------------------------------
+bool box_is_finite(box_t box)
+{
+  return isfinite(box.x0) && isfinite(box.y0)
+    && isfinite(box.x1) && isfinite(box.y1);
+}
+
+//---------------------------------------------------------
+// the comparisons are written so that a NAN ends up in the box, where
+// box_is_finite will see it, instead of quietly being left out
+void box_add_point(box_t* p_box, affine_t m, float x, float y)
+{
+  float tx = m.a * x + m.c * y + m.e;
+  float ty = m.b * x + m.d * y + m.f;
+  if (!(tx >= p_box->x0)) p_box->x0 = tx;
+  if (!(ty >= p_box->y0)) p_box->y0 = ty;
+  if (!(tx <= p_box->x1)) p_box->x1 = tx;
+  if (!(ty <= p_box->y1)) p_box->y1 = ty;
+}
+
+//---------------------------------------------------------
+box_t box_transform(affine_t m, box_t box)
+{
+  if (box_is_empty(box)) return box;
+
+  box_t out = box_empty();
+  box_add_point(&out, m, box.x0, box.y0);
+  box_add_point(&out, m, box.x1, box.y0);
+  box_add_point(&out, m, box.x0, box.y1);
+  box_add_point(&out, m, box.x1, box.y1);
+  return out;
+}
+
+//---------------------------------------------------------
+box_t box_expand(box_t box, float distance)
+{
+  if (box_is_empty(box)) return box;
+  return (box_t){box.x0 - distance, box.y0 - distance,
+                 box.x1 + distance, box.y1 + distance};
+}
+
+//---------------------------------------------------------
+box_t box_intersect(box_t a, box_t b)
+{
+  return (box_t){fmaxf(a.x0, b.x0), fmaxf(a.y0, b.y0),
+                 fminf(a.x1, b.x1), fminf(a.y1, b.y1)};
+}
+
+//---------------------------------------------------------
+box_t box_union(box_t a, box_t b)
+{
+  return (box_t){fminf(a.x0, b.x0), fminf(a.y0, b.y0),
+                 fmaxf(a.x1, b.x1), fmaxf(a.y1, b.y1)};
+}
+
+//---------------------------------------------------------
+bool box_overlaps(box_t a, box_t b)
+{
+  return !(a.x1 < b.x0 || b.x1 < a.x0 || a.y1 < b.y0 || b.y1 < a.y0);
+}
+
+//=============================================================================
+// pads
+
+pad_t pad_max(pad_t a, pad_t b)
+{
+  return (pad_t){
+    .abs = fmaxf(a.abs, b.abs),
+    .width = fmaxf(a.width, b.width),
+    .join = fmaxf(a.join, b.join),
+    .reach = fmaxf(a.reach, b.reach),
+    .size = fmaxf(a.size, b.size)
+  };
+}
+
+//---------------------------------------------------------
+pad_t pad_scale(pad_t pad, float k)
+{
+  return (pad_t){pad.abs * k, pad.width * k, pad.join * k,
+                 pad.reach * k, pad.size * k};
+}
+
+//---------------------------------------------------------
+pad_t pad_resolve(pad_t pad, float width, float join, float size)
+{
+  if (!isnan(width)) {
+    pad.abs += pad.width * width;
+    pad.join += pad.reach * width;
+    pad.width = pad.reach = 0;
+  }
+  if (!isnan(join)) {
+    pad.abs += pad.join * join;
+    pad.width += pad.reach * join;
+    pad.join = pad.reach = 0;
+  }
+  if (!isnan(size)) {
+    pad.abs += pad.size * size;
+    pad.size = 0;
+  }
+  return pad;
+}
+
+//---------------------------------------------------------
+float pad_eval(pad_t pad, float width, float join, float size)
+{
+  return pad.abs + pad.width * width + pad.join * join
+    + pad.reach * width * join + pad.size * size;
+}
+
+//---------------------------------------------------------
+bool pad_is_finite(pad_t pad)
+{
+  return isfinite(pad.abs) && isfinite(pad.width) && isfinite(pad.join)
+    && isfinite(pad.reach) && isfinite(pad.size);
+}
+
+//---------------------------------------------------------
+void bounds_union(bounds_t* p_bounds, const bounds_t* p_add)
+{
+  if (p_add->unbounded) {
+    p_bounds->unbounded = true;
+    return;
+  }
+  if (box_is_empty(p_add->box)) return;
+
+  if (box_is_empty(p_bounds->box)) {
+    p_bounds->box = p_add->box;
+    p_bounds->pad = p_add->pad;
+    return;
+  }
+
+  p_bounds->box = box_union(p_bounds->box, p_add->box);
+  p_bounds->pad = pad_max(p_bounds->pad, p_add->pad);
+}
@@ -0,0 +1,80 @@
+/*
+# Conservative bounds
+
+Boxes that are known to hold everything a script draws, so the parts
+of a scene that can't be seen can be skipped without drawing them.
+
+How far strokes and text reach past their geometry depends on the
+stroke width, miter limit and font size, and a script that doesn't set
+those inherits them from whatever draws it. So a bounds is a box plus
+a pad around it, and the pad is part fixed and part a multiple of the
+inherited values, which are filled in once they are known.
+
+Nothing here has to be tight. Everything has to be big enough.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+
+// maps (x, y) to (a x + c y + e, b x + d y + f)
+typedef struct {
+  float a, b, c, d, e, f;
+} affine_t;
+
+// empty when x0 > x1
+typedef struct {
+  float x0, y0, x1, y1;
+} box_t;
+
+// The pad is
+//   abs + width * W + join * J + reach * W * J + size * S
+// where W is the inherited stroke width, J the inherited join factor
+// and S the inherited font size.
+typedef struct {
+  float abs;
+  float width;
+  float join;
+  float reach;
+  float size;
+} pad_t;
+
+typedef struct {
+  box_t box;
+  pad_t pad;
+  bool unbounded;     // could draw anywhere
+} bounds_t;
+
+// how far past the end of its path a stroke can reach, in stroke
+// widths. Covers square caps and miter joins.
+float join_factor(float miter_limit);
+
+affine_t affine_identity();
+affine_t affine_multiply(affine_t m, affine_t t);   // t first, then m
+affine_t affine_translate(affine_t m, float x, float y);
+affine_t affine_scale(affine_t m, float x, float y);
+affine_t affine_rotate(affine_t m, float radians);
+// how much m can stretch a distance
+float affine_norm(affine_t m);
+
+box_t box_empty();
+box_t box_from_corners(float x0, float y0, float x1, float y1);
+bool box_is_empty(box_t box);
+bool box_is_finite(box_t box);
+void box_add_point(box_t* p_box, affine_t m, float x, float y);
+box_t box_transform(affine_t m, box_t box);
+box_t box_expand(box_t box, float distance);
+box_t box_intersect(box_t a, box_t b);
+box_t box_union(box_t a, box_t b);
+// true unless the boxes are certainly apart
+bool box_overlaps(box_t a, box_t b);
+
+pad_t pad_max(pad_t a, pad_t b);
+pad_t pad_scale(pad_t pad, float k);
+// fold in whichever values are known. NAN means still inherited.
+pad_t pad_resolve(pad_t pad, float width, float join, float size);
+float pad_eval(pad_t pad, float width, float join, float size);
+bool pad_is_finite(pad_t pad);
+
+// grow p_bounds to cover p_add as well
+void bounds_union(bounds_t* p_bounds, const bounds_t* p_add);
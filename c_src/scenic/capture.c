@@ -0,0 +1,183 @@
+/*
+# Capture and replay of the inbound port stream.
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "capture.h"
+#include "comms.h"
+
+#define CAPTURE_MAGIC "SCNCAP01"
+#define CAPTURE_MAGIC_SIZE 8
+
+static FILE* capture_file = NULL;
+static int64_t capture_start;
+
+typedef struct {
+  FILE* file;
+  int fd;
+  bool fast;
+} replay_t;
+
+//---------------------------------------------------------
+static int64_t now_us()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+//---------------------------------------------------------
+static void capture_close()
+{
+  if (capture_file) {
+    fclose(capture_file);
+    capture_file = NULL;
+  }
+}
+
+//---------------------------------------------------------
+bool capture_open(const char* path)
+{
+  capture_file = fopen(path, "wb");
+  if (!capture_file) {
+    log_error("%s unable to open %s: %s", __func__, path, strerror(errno));
+    return false;
+  }
+
+  fwrite(CAPTURE_MAGIC, 1, CAPTURE_MAGIC_SIZE, capture_file);
+  capture_start = now_us();
+  atexit(capture_close);
+  return true;
+}
+
+//---------------------------------------------------------
+void capture_chunk(const void* p_data, uint32_t size)
+{
+  if (!capture_file) return;
+
+  uint64_t time = now_us() - capture_start;
+  fwrite(&time, sizeof(uint64_t), 1, capture_file);
+  fwrite(&size, sizeof(uint32_t), 1, capture_file);
+  fwrite(p_data, 1, size, capture_file);
+
+  // the end of the capture is what matters when the driver crashes or
+  // is killed, so nothing is left waiting in the buffer
+  fflush(capture_file);
+}
+
+//---------------------------------------------------------
+static bool write_all(int fd, const uint8_t* p, uint32_t size)
+{
+  while (size > 0) {
+    ssize_t wrote = write(fd, p, size);
+    if (wrote < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    p += wrote;
+    size -= wrote;
+  }
+  return true;
+}
+
+//---------------------------------------------------------
+static void* replay_feeder(void* user_data)
+{
+  replay_t* p_replay = (replay_t*)user_data;
+  int64_t start = now_us();
+  uint64_t time;
+  uint32_t size;
+  uint8_t* p_chunk = NULL;
+  uint32_t chunk_capacity = 0;
+
+  while (fread(&time, sizeof(uint64_t), 1, p_replay->file) == 1
+         && fread(&size, sizeof(uint32_t), 1, p_replay->file) == 1) {
+    if (size > chunk_capacity) {
+      free(p_chunk);
+      p_chunk = malloc(size);
+      chunk_capacity = p_chunk ? size : 0;
+      if (!p_chunk) break;
+    }
+    if (fread(p_chunk, 1, size, p_replay->file) != size) break;
+
+    if (!p_replay->fast) {
+      int64_t wait = (int64_t)time - (now_us() - start);
+      if (wait > 0) {
+        struct timespec ts = { wait / 1000000, (wait % 1000000) * 1000 };
+        nanosleep(&ts, NULL);
+      }
+    }
+
+    if (!write_all(p_replay->fd, p_chunk, size)) break;
+  }
+
+  fprintf(stderr, "replay: fed the capture in %lld ms\n",
+          (long long)(now_us() - start) / 1000);
+
+  // closing the pipe hangs up stdin, which ends the driver
+  close(p_replay->fd);
+  fclose(p_replay->file);
+  free(p_chunk);
+  free(p_replay);
+  return NULL;
+}
+
+//---------------------------------------------------------
+bool replay_start(const char* path, bool fast)
+{
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    fprintf(stderr, "replay: unable to open %s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  char magic[CAPTURE_MAGIC_SIZE];
+  if (fread(magic, 1, CAPTURE_MAGIC_SIZE, file) != CAPTURE_MAGIC_SIZE
+      || memcmp(magic, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE) != 0) {
+    fprintf(stderr, "replay: %s is not a capture file\n", path);
+    fclose(file);
+    return false;
+  }
+
+  int fds[2];
+  if (pipe(fds) != 0 || dup2(fds[0], STDIN_FILENO) < 0) {
+    fprintf(stderr, "replay: unable to set up stdin: %s\n", strerror(errno));
+    fclose(file);
+    return false;
+  }
+  close(fds[0]);
+
+  // the driver may quit before the capture is used up
+  signal(SIGPIPE, SIG_IGN);
+
+  replay_t* p_replay = malloc(sizeof(replay_t));
+  if (!p_replay) {
+    fprintf(stderr, "replay: unable to allocate the feeder\n");
+    close(fds[1]);
+    fclose(file);
+    return false;
+  }
+  p_replay->file = file;
+  p_replay->fd = fds[1];
+  p_replay->fast = fast;
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, replay_feeder, p_replay) != 0) {
+    fprintf(stderr, "replay: unable to start the feeder\n");
+    close(fds[1]);
+    fclose(file);
+    free(p_replay);
+    return false;
+  }
+  pthread_detach(thread);
+
+  return true;
+}
@@ -0,0 +1,28 @@
+/*
+# Capture and replay of the inbound port stream.
+
+A capture file is the raw bytes read from stdin, in the chunks they
+were read in, each stamped with the time since the capture started.
+
+  header: "SCNCAP01"
+  chunks: u64 microseconds, u32 size, then the bytes
+
+Replaying one feeds the chunks back in through stdin, so they go down
+exactly the same path as they did when captured.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// start writing everything read from stdin to the file at path
+bool capture_open(const char* path);
+
+// record a chunk just read from stdin. Does nothing unless capturing
+void capture_chunk(const void* p_data, uint32_t size);
+
+// Replace stdin with a pipe fed from the capture file at path. Unless
+// fast is set, chunks are fed with their original timing. stdin is
+// closed once the capture runs out, which ends the driver.
+bool replay_start(const char* path, bool fast);
@@ -8,26 +8,30 @@ The caller will typically be erlang, so use the 2-byte length indicator
 */
 
 #include "common.h"
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "bands.h"
+#include "damage.h"
 #include "device.h"
 #include "font.h"
+#include "frame_arena.h"
+#include "handle.h"
 #include "image.h"
+#include "log.h"
+#include "out_queue.h"
 #include "scenic_ops.h"
 #include "script.h"
 #include "utils.h"
 
-// handy time definitions in microseconds
-#define MILLISECONDS_8 8000
-
-// Setting the timeout too high means input will be laggy as you
-// are starving the input polling. Setting it too low means using
-// energy for no purpose.
-#define STDIO_TIMEOUT MILLISECONDS_8
+// How long to keep handling messages that are already waiting before
+// giving the device and timers a turn. Too high and input gets laggy
+// under a flood of updates.
+#define STDIO_BUDGET_MS 8
 
 extern device_info_t g_device_info;
 extern device_opts_t g_opts;
@@ -38,20 +42,12 @@ extern device_opts_t g_opts;
 // http://erlang.org/doc/tutorial/c_port.html#id64377
 
 //---------------------------------------------------------
-// the length indicator from erlang is always big-endian
+// queue a message for the writer thread. The length header is added
+// by the queue
 int write_cmd(uint8_t* buf, uint32_t len)
 {
-  int written = 0;
-
-  uint32_t cmd_len = len;
-  cmd_len = hton_ui32(cmd_len);
-
-  scenic_cmd_lock();
-  write_exact((uint8_t*) &cmd_len, sizeof(uint32_t));
-  written = write_exact(buf, len);
-  scenic_cmd_unlock();
-
-  return written;
+  out_queue_push(buf, len, NULL, 0);
+  return len;
 }
 
 //---------------------------------------------------------
@@ -76,21 +72,36 @@ bool read_bytes_down(void* p_buff, int bytes_to_read, uint32_t* p_bytes_to_remai
   return true;
 }
 
+//---------------------------------------------------------
+// like read_bytes_down, but hands back a pointer into the message
+// instead of copying. The pointer is only good until the message is
+// released at the end of its dispatch.
+// Returns NULL if the bytes can't be borrowed, in which case nothing
+// was consumed and the caller should fall back to read_bytes_down.
+void* borrow_bytes_down(int bytes_to_read, uint32_t* p_bytes_to_remaining)
+{
+  if (bytes_to_read < 0 || (uint32_t)bytes_to_read > *p_bytes_to_remaining)
+    return NULL;
+
+  void* p = borrow_exact(bytes_to_read);
+  if (p) {
+    *p_bytes_to_remaining -= bytes_to_read;
+  }
+  return p;
+}
+
 //=============================================================================
 // send messages up to caller
 
 //---------------------------------------------------------
+// format a line and send it as text
 void logv(uint32_t cmd, const char* msg, va_list args)
 {
   char* output;
-  uint32_t msg_len = vasprintf(&output, msg, args);
-  uint32_t cmd_len = ntoh_ui32(msg_len + sizeof(uint32_t));
-
-  scenic_cmd_lock();
-  write_exact((uint8_t*) &cmd_len, sizeof(uint32_t));
-  write_exact((uint8_t*) &cmd, sizeof(uint32_t));
-  write_exact((uint8_t*) output, msg_len);
-  scenic_cmd_unlock();
+  int msg_len = vasprintf(&output, msg, args);
+  if (msg_len < 0) return;
+
+  out_queue_push(&cmd, sizeof(uint32_t), output, msg_len);
   free(output);
 }
 
@@ -100,22 +111,18 @@ void send_puts(const char* msg, ...)
   va_start(args, msg);
 
   logv(MSG_OUT_PUTS, msg, args);
+  va_end(args);
 }
 
 //---------------------------------------------------------
+// the log functions send binary records, see log.h
 void log_message(log_level_t level, const char* msg, ...)
 {
   va_list args;
   va_start(args, msg);
-  uint32_t cmd = MSG_OUT_ERROR;
-  switch(level) {
-  case log_level_debug: cmd = MSG_OUT_DEBUG; break;
-  case log_level_info: cmd = MSG_OUT_INFO; break;
-  case log_level_warn: cmd = MSG_OUT_WARN; break;
-  case log_level_error: cmd = MSG_OUT_ERROR; break;
-  }
 
-  logv(cmd, msg, args);
+  log_record(level, msg, args);
+  va_end(args);
 }
 //---------------------------------------------------------
 void log_debug(const char* msg, ...)
@@ -123,7 +130,8 @@ void log_debug(const char* msg, ...)
   va_list args;
   va_start(args, msg);
 
-  logv(MSG_OUT_DEBUG, msg, args);
+  log_record(log_level_debug, msg, args);
+  va_end(args);
 }
 
 //---------------------------------------------------------
@@ -132,7 +140,8 @@ void log_info(const char* msg, ...)
   va_list args;
   va_start(args, msg);
 
-  logv(MSG_OUT_INFO, msg, args);
+  log_record(log_level_info, msg, args);
+  va_end(args);
 }
 
 //---------------------------------------------------------
@@ -141,7 +150,8 @@ void log_warn(const char* msg, ...)
   va_list args;
   va_start(args, msg);
 
-  logv(MSG_OUT_WARN, msg, args);
+  log_record(log_level_warn, msg, args);
+  va_end(args);
 }
 
 //---------------------------------------------------------
@@ -150,86 +160,57 @@ void log_error(const char* msg, ...)
   va_list args;
   va_start(args, msg);
 
-  logv(MSG_OUT_ERROR, msg, args);
+  log_record(log_level_error, msg, args);
+  va_end(args);
 }
 
 //---------------------------------------------------------
 void send_write(const char* msg)
 {
-  uint32_t msg_len = strlen(msg);
-  uint32_t cmd_len = msg_len + sizeof(uint32_t);
-  uint32_t cmd     = MSG_OUT_WRITE;
-
-  cmd_len = ntoh_ui32(cmd_len);
+  uint32_t cmd = MSG_OUT_WRITE;
 
-  scenic_cmd_lock();
-  write_exact((uint8_t*) &cmd_len, sizeof(uint32_t));
-  write_exact((uint8_t*) &cmd, sizeof(uint32_t));
-  write_exact((uint8_t*) msg, msg_len);
-  scenic_cmd_unlock();
+  out_queue_push(&cmd, sizeof(uint32_t), msg, strlen(msg));
 }
 
 //---------------------------------------------------------
 void send_inspect(void* data, int length)
 {
-  uint32_t cmd_len = length + sizeof(uint32_t);
-  uint32_t cmd     = MSG_OUT_INSPECT;
+  uint32_t cmd = MSG_OUT_INSPECT;
 
-  ntoh_ui32(cmd_len);
-
-  scenic_cmd_lock();
-  write_exact((uint8_t*) &cmd_len, sizeof(uint32_t));
-  write_exact((uint8_t*) &cmd, sizeof(uint32_t));
-  write_exact(data, length);
-  scenic_cmd_unlock();
+  out_queue_push(&cmd, sizeof(uint32_t), data, length);
 }
 
 //---------------------------------------------------------
 void send_static_texture_miss(const char* key)
 {
-  uint32_t msg_len = strlen(key);
-  uint32_t cmd_len = msg_len + sizeof(uint32_t);
-  uint32_t cmd     = MSG_OUT_STATIC_TEXTURE_MISS;
-
-  ntoh_ui32(cmd_len);
+  uint32_t cmd = MSG_OUT_STATIC_TEXTURE_MISS;
 
-  scenic_cmd_lock();
-  write_exact((uint8_t*) &cmd_len, sizeof(uint32_t));
-  write_exact((uint8_t*) &cmd, sizeof(uint32_t));
-  write_exact((uint8_t*) key, msg_len);
-  scenic_cmd_unlock();
+  out_queue_push(&cmd, sizeof(uint32_t), key, strlen(key));
 }
 
 //---------------------------------------------------------
 void send_dynamic_texture_miss(const char* key)
 {
-  uint32_t msg_len = strlen(key);
-  uint32_t cmd_len = msg_len + sizeof(uint32_t);
-  uint32_t cmd     = MSG_OUT_DYNAMIC_TEXTURE_MISS;
+  uint32_t cmd = MSG_OUT_DYNAMIC_TEXTURE_MISS;
 
-  ntoh_ui32(cmd_len);
-
-  scenic_cmd_lock();
-  write_exact((uint8_t*) &cmd_len, sizeof(uint32_t));
-  write_exact((uint8_t*) &cmd, sizeof(uint32_t));
-  write_exact((uint8_t*) key, msg_len);
-  scenic_cmd_unlock();
+  out_queue_push(&cmd, sizeof(uint32_t), key, strlen(key));
 }
 
 //---------------------------------------------------------
 void send_font_miss(const char* key)
 {
-  uint32_t msg_len = strlen(key);
-  uint32_t cmd_len = msg_len + sizeof(uint32_t);
-  uint32_t cmd     = MSG_OUT_FONT_MISS;
+  uint32_t cmd = MSG_OUT_FONT_MISS;
+
+  out_queue_push(&cmd, sizeof(uint32_t), key, strlen(key));
+}
 
-  ntoh_ui32(cmd_len);
+//---------------------------------------------------------
+// the caller's copy of the script doesn't match the one here any more
+void send_script_rejected(sid_t id)
+{
+  uint32_t cmd = MSG_OUT_SCRIPT_REJECTED;
 
-  scenic_cmd_lock();
-  write_exact((uint8_t*) &cmd_len, sizeof(uint32_t));
-  write_exact((uint8_t*) &cmd, sizeof(uint32_t));
-  write_exact((uint8_t*) key, msg_len);
-  scenic_cmd_unlock();
+  out_queue_push(&cmd, sizeof(uint32_t), id.p_data, id.size);
 }
 
 //---------------------------------------------------------
@@ -246,6 +227,147 @@ void send_reshape( int window_width, int window_height )
   write_cmd((uint8_t*) &msg, sizeof(msg_reshape_t));
 }
 
+//---------------------------------------------------------
+// Input events are collected into one MSG_OUT_INPUT_BATCH message
+//   u32 msg_id, u32 count, u64 flushed_at
+// followed, for each event, by
+//   u32 size, u64 timestamp, then the event's own message
+// Timestamps are CLOCK_MONOTONIC microseconds, so the caller can tell
+// how long each event sat here. input_flush sends the batch.
+//
+// Pointer motion and scrolling can arrive far faster than the app can
+// use it. Only the latest position and the summed scroll deltas are
+// held until the next event or flush, stamped with the time of the
+// first one they replace. The two are sent in the order they started
+// in, and a move or scroll that would be folded in across the other
+// kind sends what is held first, so a scroll still lands where the
+// cursor was when it happened.
+#define INPUT_BATCH_SIZE 2048
+
+PACK(typedef struct input_batch_header_t
+{
+  uint32_t msg_id;
+  uint32_t count;
+  uint64_t flushed_at;
+}) input_batch_header_t;
+
+PACK(typedef struct input_event_header_t
+{
+  uint32_t size;
+  uint64_t timestamp;
+}) input_event_header_t;
+
+PACK(typedef struct msg_cursor_pos_t
+{
+  uint32_t msg_id;
+  float    x;
+  float    y;
+}) msg_cursor_pos_t;
+
+PACK(typedef struct msg_scroll_t
+{
+  uint32_t msg_id;
+  float    x_offset;
+  float    y_offset;
+  float    x;
+  float    y;
+}) msg_scroll_t;
+
+static pthread_mutex_t input_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t input_batch[INPUT_BATCH_SIZE];
+static uint32_t input_batch_used = sizeof(input_batch_header_t);
+static uint32_t input_batch_count = 0;
+
+static uint32_t motion_seq = 0;   // orders the held motion
+static bool cursor_pending = false;
+static uint64_t cursor_time;
+static uint32_t cursor_seq;
+static msg_cursor_pos_t pending_cursor;
+static bool scroll_pending = false;
+static uint64_t scroll_time;
+static uint32_t scroll_seq;
+static msg_scroll_t pending_scroll;
+
+static uint64_t monotonic_us()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// input_mutex must be held
+static void send_input_batch()
+{
+  if (input_batch_count == 0) return;
+
+  input_batch_header_t header = {
+    MSG_OUT_INPUT_BATCH, input_batch_count, monotonic_us()
+  };
+  memcpy(input_batch, &header, sizeof(input_batch_header_t));
+  write_cmd(input_batch, input_batch_used);
+
+  input_batch_used = sizeof(input_batch_header_t);
+  input_batch_count = 0;
+}
+
+// input_mutex must be held
+static void add_input(const void* p_msg, uint32_t size, uint64_t timestamp)
+{
+  if (input_batch_used + sizeof(input_event_header_t) + size > INPUT_BATCH_SIZE) {
+    send_input_batch();
+  }
+
+  input_event_header_t header = { size, timestamp };
+  memcpy(input_batch + input_batch_used, &header, sizeof(input_event_header_t));
+  input_batch_used += sizeof(input_event_header_t);
+  memcpy(input_batch + input_batch_used, p_msg, size);
+  input_batch_used += size;
+  input_batch_count++;
+}
+
+// true if a was handed out before b, allowing for motion_seq wrapping
+static bool seq_before(uint32_t a, uint32_t b)
+{
+  return (int32_t)(a - b) < 0;
+}
+
+// move held motion into the batch, in the order it started in.
+// input_mutex must be held
+static void add_pending_motion()
+{
+  if (scroll_pending && (!cursor_pending || seq_before(scroll_seq, cursor_seq))) {
+    add_input(&pending_scroll, sizeof(msg_scroll_t), scroll_time);
+    scroll_pending = false;
+  }
+  if (cursor_pending) {
+    add_input(&pending_cursor, sizeof(msg_cursor_pos_t), cursor_time);
+    cursor_pending = false;
+  }
+  if (scroll_pending) {
+    add_input(&pending_scroll, sizeof(msg_scroll_t), scroll_time);
+    scroll_pending = false;
+  }
+}
+
+// queue a discrete event behind any motion that came before it
+static void add_event(const void* p_msg, uint32_t size)
+{
+  uint64_t now = monotonic_us();
+  pthread_mutex_lock(&input_mutex);
+  add_pending_motion();
+  add_input(p_msg, size, now);
+  pthread_mutex_unlock(&input_mutex);
+}
+
+//---------------------------------------------------------
+void input_flush()
+{
+  pthread_mutex_lock(&input_mutex);
+  add_pending_motion();
+  send_input_batch();
+  pthread_mutex_unlock(&input_mutex);
+}
+
 //---------------------------------------------------------
 PACK(typedef struct msg_key_t
 {
@@ -260,7 +382,7 @@ PACK(typedef struct msg_key_t
 void send_key(keymap_t keymap, int key, int scancode, int action, int mods)
 {
   msg_key_t msg = { MSG_OUT_KEY, keymap, key, scancode, action, mods };
-  write_cmd((uint8_t*) &msg, sizeof(msg_key_t));
+  add_event(&msg, sizeof(msg_key_t));
 }
 
 //---------------------------------------------------------
@@ -275,21 +397,25 @@ PACK(typedef struct msg_codepoint_t
 void send_codepoint(keymap_t keymap, unsigned int codepoint, int mods)
 {
   msg_codepoint_t msg = { MSG_OUT_CODEPOINT, keymap, codepoint, mods };
-  write_cmd((uint8_t*) &msg, sizeof(msg_codepoint_t));
+  add_event(&msg, sizeof(msg_codepoint_t));
 }
 
 //---------------------------------------------------------
-PACK(typedef struct msg_cursor_pos_t
-{
-  uint32_t msg_id;
-  float    x;
-  float    y;
-}) msg_cursor_pos_t;
-
 void send_cursor_pos(float xpos, float ypos)
 {
-  msg_cursor_pos_t msg = { MSG_OUT_CURSOR_POS, xpos, ypos };
-  write_cmd((uint8_t*) &msg, sizeof(msg_cursor_pos_t));
+  uint64_t now = monotonic_us();
+  pthread_mutex_lock(&input_mutex);
+  // a scroll came in after the held position, so keep them apart
+  if (cursor_pending && scroll_pending && seq_before(cursor_seq, scroll_seq)) {
+    add_pending_motion();
+  }
+  if (!cursor_pending) {
+    cursor_time = now;
+    cursor_seq = motion_seq++;
+    cursor_pending = true;
+  }
+  pending_cursor = (msg_cursor_pos_t){ MSG_OUT_CURSOR_POS, xpos, ypos };
+  pthread_mutex_unlock(&input_mutex);
 }
 
 //---------------------------------------------------------
@@ -315,23 +441,30 @@ void send_mouse_button(keymap_t keymap, int button, int action, int mods, float
     xpos,
     ypos
   };
-  write_cmd((uint8_t*) &msg, sizeof(msg_mouse_button_t));
+  add_event(&msg, sizeof(msg_mouse_button_t));
 }
 
 //---------------------------------------------------------
-PACK(typedef struct msg_scroll_t
-{
-  uint32_t msg_id;
-  float    x_offset;
-  float    y_offset;
-  float    x;
-  float    y;
-}) msg_scroll_t;
-
 void send_scroll(float xoffset, float yoffset, float xpos, float ypos)
 {
-  msg_scroll_t msg = { MSG_OUT_MOUSE_SCROLL, xoffset, yoffset, xpos, ypos };
-  write_cmd((uint8_t*) &msg, sizeof(msg_scroll_t));
+  uint64_t now = monotonic_us();
+  pthread_mutex_lock(&input_mutex);
+  // a move came in after the held scroll, so keep them apart
+  if (scroll_pending && cursor_pending && seq_before(scroll_seq, cursor_seq)) {
+    add_pending_motion();
+  }
+  if (scroll_pending) {
+    pending_scroll.x_offset += xoffset;
+    pending_scroll.y_offset += yoffset;
+  } else {
+    pending_scroll = (msg_scroll_t){ MSG_OUT_MOUSE_SCROLL, xoffset, yoffset, 0, 0 };
+    scroll_time = now;
+    scroll_seq = motion_seq++;
+    scroll_pending = true;
+  }
+  pending_scroll.x = xpos;
+  pending_scroll.y = ypos;
+  pthread_mutex_unlock(&input_mutex);
 }
 
 //---------------------------------------------------------
@@ -346,7 +479,7 @@ PACK(typedef struct msg_cursor_enter_t
 void send_cursor_enter(int entered, float xpos, float ypos)
 {
   msg_cursor_enter_t msg = { MSG_OUT_CURSOR_ENTER, entered, xpos, ypos };
-  write_cmd((uint8_t*) &msg, sizeof(msg_cursor_enter_t));
+  add_event(&msg, sizeof(msg_cursor_enter_t));
 }
 
 //---------------------------------------------------------
@@ -395,10 +528,20 @@ void receive_quit(driver_data_t* p_data)
 void receive_crash()
 {
   log_error("receive_crash - exit");
+  // the queued messages are flushed by the atexit handler
   exit(EXIT_FAILURE);
 }
 
 
+//---------------------------------------------------------
+// Goes up whenever the global transform or clear color changes.
+// Together with the handle epoch, which covers the scripts, images and
+// fonts, it says whether the scene would come out the same as in the
+// last frame.
+static uint32_t scene_generation = 0;
+// and whenever the cursor changes
+static uint32_t cursor_generation = 0;
+
 //---------------------------------------------------------
 void render(driver_data_t* p_data)
 {
@@ -408,6 +551,28 @@ void render(driver_data_t* p_data)
   static clock_t render_fps = 0;
   static uint32_t frames = 0;
 
+  // if nothing changed, the last frame is still on the screen
+  static bool presented = false;
+  static uint32_t presented_generation = 0;
+  static uint32_t presented_cursor = 0;
+  uint32_t generation = scene_generation + g_handle_epoch;
+  bool same_scene = presented && generation == presented_generation
+    && !damage_pending();
+  if (same_scene && cursor_generation == presented_cursor) {
+    if (g_opts.debug_mode) {
+      log_debug("%s skipped, nothing changed", __func__);
+    }
+    send_ready();
+    return;
+  }
+  presented = true;
+  presented_generation = generation;
+  presented_cursor = cursor_generation;
+
+  // if only the cursor moved, devices that kept the scene without it
+  // put that back where the cursor was instead of drawing it again
+  p_data->f_cursor_only = same_scene && device_keeps_scene(p_data);
+
   clock_t begin_frame = clock();
 
   // prep the id to the root scene
@@ -415,19 +580,39 @@ void render(driver_data_t* p_data)
   id.p_data = "_root_";
   id.size = strlen(id.p_data);
 
+  // scratch memory from the last frame is free again
+  frame_arena_reset();
+
+  // work out what has to be drawn again
+  sid_t cursor_id;
+  cursor_id.p_data = "_cursor_";
+  cursor_id.size = strlen(cursor_id.p_data);
+
+  float root_tx[6];
+  device_root_transform(p_data, root_tx);
+  const float* p_cursor_pos = p_data->f_show_cursor ? p_data->cursor_pos : NULL;
+  if (p_data->f_cursor_only) {
+    plan_cursor_frame(id, cursor_id, root_tx, p_cursor_pos);
+  } else {
+    plan_frame(id, cursor_id, root_tx, p_cursor_pos);
+  }
+  if (!device_redraws_damage()) damage_all();
+  damage_next_frame((box_t){0, 0, g_device_info.width, g_device_info.height});
+  p_data->f_skip_clear = !p_data->f_cursor_only && frame_covers_damage();
+
   // render the scene
   device_begin_render(p_data);
 
-  // render the root script
-  render_script(p_data->v_ctx, id);
+  // render the root script, in bands when there are threads for them
+  if (!p_data->f_cursor_only && !render_bands(p_data, id, root_tx)) {
+    render_script(p_data->v_ctx, id, root_tx);
+  }
 
-  // render the cursor if one is provided
+  // render the cursor if one is provided. It is small enough that
+  // there's nothing to gain from culling it.
   if (p_data->f_show_cursor) {
     device_begin_cursor_render(p_data);
-
-    id.p_data = "_cursor_";
-    id.size = strlen(id.p_data);
-    render_script(p_data->v_ctx, id);
+    render_script(p_data->v_ctx, cursor_id, NULL);
   }
 
   device_end_render(p_data);
@@ -448,6 +633,13 @@ void render(driver_data_t* p_data)
 
   if ((g_opts.debug_fps > 0) && (time_remaining <= 0)) {
     log_info("real_fps: %d", frames);
+    if (g_band_stats.frames > 0) {
+      for (int i = 0; i < g_band_stats.count; i++) {
+        log_info("band %d: %d us", i,
+                 (int)(g_band_stats.usecs[i] / g_band_stats.frames));
+      }
+      g_band_stats = (band_stats_t){0};
+    }
     start_real = monotonic_time();
     time_remaining = 1000;
     frames = 0;
@@ -457,12 +649,97 @@ void render(driver_data_t* p_data)
   send_ready();
 }
 
+//---------------------------------------------------------
+// The transform device_begin_render leaves in place. Devices that
+// apply the global transform say so.
+__attribute__((weak))
+void device_root_transform(driver_data_t* p_data, float* p_tx)
+{
+  static const float identity[6] = {1, 0, 0, 1, 0, 0};
+  memcpy(p_tx, identity, sizeof(identity));
+}
+
+//---------------------------------------------------------
+// Devices that keep the scene as it was last drawn, without the cursor
+// on it, say so. A frame where only the cursor moved then has
+// f_cursor_only set, and device_begin_render puts the scene back in
+// the damage instead of the scene being drawn again.
+__attribute__((weak))
+bool device_keeps_scene(driver_data_t* p_data)
+{
+  return false;
+}
+
+//---------------------------------------------------------
+// Devices that keep the last frame's pixels, and only draw the damaged
+// parts of it again, say so.
+__attribute__((weak))
+bool device_redraws_damage()
+{
+  return false;
+}
+
+//---------------------------------------------------------
+// Offscreen layers. See layer_cache.h
+//
+// device_layer_begin sends all drawing into a new surface covering
+// width by height device pixels from (x, y), with the transform
+// reset to where those pixels are, until device_layer_end. Devices
+// that can't do that return NULL and everything is drawn directly.
+__attribute__((weak))
+void* device_layer_begin(void* v_ctx, int x, int y, int width, int height)
+{
+  return NULL;
+}
+
+__attribute__((weak))
+void device_layer_end(void* v_ctx, void* p_layer) {}
+
+// composite a layer with its corner at device pixel (x, y)
+__attribute__((weak))
+void device_layer_draw(void* v_ctx, void* p_layer, int x, int y) {}
+
+// Vector layers record the drawing in the current space, clipped to
+// width by height from (x, y), and are finished with device_layer_end.
+// Drawing one plays it back under the current transform.
+__attribute__((weak))
+void* device_recording_begin(void* v_ctx, float x, float y,
+                             float width, float height)
+{
+  return NULL;
+}
+
+__attribute__((weak))
+void device_recording_draw(void* v_ctx, void* p_layer) {}
+
+__attribute__((weak))
+void device_layer_free(void* p_layer) {}
+
+//---------------------------------------------------------
+// Bands. See bands.h
+//
+// device_band_begin returns a context that draws rows y0 up to y1 of
+// the frame, clipped to the damage, which the device's script ops get
+// as v_ctx. It can be used from another thread, along with the other
+// bands. Devices that can't do that return NULL and the frame is drawn
+// in one piece.
+__attribute__((weak))
+void* device_band_begin(driver_data_t* p_data, int band, int y0, int y1)
+{
+  return NULL;
+}
+
+__attribute__((weak))
+void device_band_end(driver_data_t* p_data, int band, void* v_band) {}
+
 //---------------------------------------------------------
 void set_global_tx(uint32_t* p_msg_length, driver_data_t* p_data)
 {
   for (int i = 0; i < 6; i++) {
     read_bytes_down(&p_data->global_tx[i], sizeof(float), p_msg_length);
   }
+  scene_generation++;
+  damage_all();
 }
 
 //---------------------------------------------------------
@@ -471,15 +748,26 @@ void set_cursor_tx(uint32_t* p_msg_length, driver_data_t* p_data)
   for (int i = 0; i < 6; i++) {
     read_bytes_down(&p_data->cursor_tx[i], sizeof(float), p_msg_length);
   }
+  cursor_generation++;
 }
 
 //---------------------------------------------------------
 void update_cursor(uint32_t* p_msg_length, driver_data_t* p_data)
 {
+  uint32_t show = p_data->f_show_cursor;
+  float x = p_data->cursor_pos[0];
+  float y = p_data->cursor_pos[1];
+
   read_bytes_down(&p_data->f_show_cursor, sizeof(uint32_t), p_msg_length);
   for (int i = 0; i < 2; i++) {
     read_bytes_down(&p_data->cursor_pos[i], sizeof(float), p_msg_length);
   }
+
+  // it is sent again even when it hasn't moved
+  if (p_data->f_show_cursor != show || p_data->cursor_pos[0] != x
+      || p_data->cursor_pos[1] != y) {
+    cursor_generation++;
+  }
 }
 
 //---------------------------------------------------------
@@ -491,6 +779,8 @@ void clear_color(uint32_t* p_msg_length)
   read_bytes_down(&b, 1, p_msg_length);
   read_bytes_down(&a, 1, p_msg_length);
   device_clear_color(r / 255.0f, g / 255.0f, b / 255.0f, a / 255.0f);
+  scene_generation++;
+  damage_all();
 }
 
 //=============================================================================
@@ -506,24 +796,18 @@ int64_t monotonic_time()
     return mt_msecs;
 }
 
-// read from the stdio in buffer and act on one message.
+// act on the messages the reader thread has queued up. Never blocks
+// waiting for more, the reactor calls back when there are some.
 void handle_stdio_in(driver_data_t* p_data)
 {
   int64_t start = monotonic_time();
-  int64_t time_remaining = STDIO_TIMEOUT;
-
-  struct timeval tv;
-  while (time_remaining > 0) {
-    tv.tv_sec  = 0;
-    tv.tv_usec = time_remaining;
 
-    int len = read_msg_length(&tv);
-    if (len <= 0) break;
+  uint32_t len;
+  do {
+    if (!take_msg(&len)) break;
 
     // process the message
     dispatch_scenic_ops(len, p_data);
-
-    // see if time is remaining, so we can process another one
-    time_remaining -= monotonic_time() - start;
-  }
+    release_msg();
+  } while (p_data->keep_going && (monotonic_time() - start) < STDIO_BUDGET_MS);
 }
@@ -74,19 +74,24 @@ typedef enum {
   MSG_OUT_MOUSE_SCROLL = 0X0E,
   MSG_OUT_CURSOR_ENTER = 0X0F,
   MSG_OUT_DROP_PATHS = 0X10,
+  MSG_OUT_INPUT_BATCH = 0X11,
   MSG_OUT_STATIC_TEXTURE_MISS = 0X20,
   MSG_OUT_DYNAMIC_TEXTURE_MISS = 0X21,
 
   MSG_OUT_FONT_MISS = 0X22,
   MSG_OUT_IMG_MISS = 0X23,
 
+  MSG_OUT_SHM_RELEASE = 0X30,
   MSG_OUT_NEW_TX_ID = 0X31,
   MSG_OUT_NEW_FONT_ID = 0X32,
+  MSG_OUT_SCRIPT_REJECTED = 0X33,
 
   MSG_OUT_INFO = 0XA0,
   MSG_OUT_WARN = 0XA1,
   MSG_OUT_ERROR = 0XA2,
   MSG_OUT_DEBUG = 0XA3,
+  MSG_OUT_LOG_FORMAT = 0XA4,
+  MSG_OUT_LOG_BATCH = 0XA5,
 } msg_out_t;
 
 typedef enum {
@@ -95,12 +100,19 @@ typedef enum {
 } keymap_t;
 
 int read_exact(uint8_t* buf, int len);
+uint8_t* borrow_exact(int len);
 int write_exact(uint8_t* buf, int len);
-int read_msg_length(struct timeval * ptv);
+int write_cmd(uint8_t* buf, uint32_t len);
+int start_reader();
+void clear_reader_wake();
+bool take_msg(uint32_t* p_len);
+void release_msg();
+bool has_buffered_input();
 bool isCallerDown();
 
 bool read_bytes_down(void* p_buff, int bytes_to_read,
                      uint32_t* p_bytes_to_remaining);
+void* borrow_bytes_down(int bytes_to_read, uint32_t* p_bytes_to_remaining);
 
 // basic events to send up to the caller
 void send_puts(const char* msg, ...);
@@ -114,6 +126,7 @@ typedef enum {
   log_level_error,
 } log_level_t;
 
+void logv(uint32_t cmd, const char* msg, va_list args);
 void log_message(log_level_t level, const char* msg, ...);
 void log_debug(const char* msg, ...);
 void log_info(const char* msg, ...);
@@ -131,6 +144,7 @@ void render(driver_data_t* p_data);
 void send_image_miss(unsigned int img_id);
 
 void send_reshape(int window_width, int window_height);
+void send_script_rejected(sid_t id);
 void send_key(keymap_t keymap, int key, int scancode, int action, int mods);
 void send_codepoint(keymap_t keymap, unsigned int codepoint, int mods);
 void send_cursor_pos(float xpos, float ypos);
@@ -138,6 +152,8 @@ void send_mouse_button(keymap_t keymap, int button, int action, int mods, float
                        float ypos);
 void send_scroll(float xoffset, float yoffset, float xpos, float ypos);
 void send_cursor_enter(int entered, float xpos, float ypos);
+// input events are batched until this is called
+void input_flush();
 void send_close( int reason );
 void send_ready();
 void handle_stdio_in(driver_data_t* p_data);
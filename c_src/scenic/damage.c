@@ -0,0 +1,88 @@
+/*
+#  Damage. See damage.h
+*/
+
+#include <math.h>
+
+#include "damage.h"
+
+damage_t g_damage = {0};
+
+// the first frame has nothing to keep
+static bool pending_all = true;
+static int pending_count = 0;
+static box_t pending[DAMAGE_MAX_RECTS];
+
+//---------------------------------------------------------
+static float box_area(box_t box)
+{
+  return (box.x1 - box.x0) * (box.y1 - box.y0);
+}
+
+//---------------------------------------------------------
+// When the list is full, the new box is merged into whichever box that
+// grows the least, so a few small changes far apart stay small.
+void damage_add(box_t box)
+{
+  if (pending_all || box_is_empty(box)) return;
+  if (!box_is_finite(box)) {
+    pending_all = true;
+    return;
+  }
+
+  for (int i = 0; i < pending_count; i++) {
+    box_t merged = box_union(pending[i], box);
+    if (box_area(merged) <= box_area(pending[i])) return;
+  }
+
+  if (pending_count < DAMAGE_MAX_RECTS) {
+    pending[pending_count++] = box;
+    return;
+  }
+
+  int best = 0;
+  float best_growth = INFINITY;
+  for (int i = 0; i < pending_count; i++) {
+    float growth = box_area(box_union(pending[i], box)) - box_area(pending[i]);
+    if (growth < best_growth) {
+      best = i;
+      best_growth = growth;
+    }
+  }
+  pending[best] = box_union(pending[best], box);
+}
+
+//---------------------------------------------------------
+void damage_all()
+{
+  pending_all = true;
+}
+
+//---------------------------------------------------------
+bool damage_pending()
+{
+  return pending_all || pending_count > 0;
+}
+
+//---------------------------------------------------------
+void damage_next_frame(box_t viewport)
+{
+  if (pending_all) {
+    pending[0] = viewport;
+    pending_count = 1;
+  }
+
+  g_damage.count = 0;
+  g_damage.bounds = box_empty();
+  for (int i = 0; i < pending_count; i++) {
+    box_t box = box_intersect(pending[i], viewport);
+    if (box_is_empty(box) || box.x0 == box.x1 || box.y0 == box.y1) continue;
+
+    box = (box_t){floorf(box.x0), floorf(box.y0), ceilf(box.x1), ceilf(box.y1)};
+    g_damage.rects[g_damage.count++] = box;
+    g_damage.bounds = box_union(g_damage.bounds, box);
+  }
+
+  pending_all = false;
+  pending_count = 0;
+}
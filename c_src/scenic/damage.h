@@ -0,0 +1,38 @@
+/*
+# Damage
+
+The parts of the screen that have to be drawn again for the next frame
+to come out right. Anything that changes what is on the screen adds
+the device space box it covered before and the one it covers after.
+Just before a frame is drawn, what has built up is closed off into
+g_damage for the device, and collecting starts over for the frame
+after it.
+
+Only devices that keep the last frame's pixels can make use of it.
+The rest draw everything, every frame.
+*/
+
+#pragma once
+
+#include "bounds.h"
+
+#define DAMAGE_MAX_RECTS 16
+
+typedef struct {
+  int count;
+  box_t rects[DAMAGE_MAX_RECTS];  // in whole pixels, inside the viewport
+  box_t bounds;                   // of all the rects. Empty if none.
+} damage_t;
+
+// the damage of the frame being drawn
+extern damage_t g_damage;
+
+void damage_add(box_t box);
+
+// everything has to be drawn again
+void damage_all();
+
+// true if anything has been damaged since the last frame
+bool damage_pending();
+
+void damage_next_frame(box_t viewport);
@@ -0,0 +1,73 @@
+/*
+#  Scratch memory that lives for one frame. See frame_arena.h
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "frame_arena.h"
+#include "utils.h"
+
+#define FRAME_ARENA_ALIGN 16
+#define FRAME_ARENA_MIN_SIZE (64 * 1024)
+
+// allocations that didn't fit in the block this frame
+typedef struct overflow_t {
+  struct overflow_t* p_next;
+  uint8_t pad[FRAME_ARENA_ALIGN - sizeof(void*)];
+} overflow_t;
+
+// each thread has its own
+static __thread uint8_t* p_block = NULL;
+static __thread size_t block_size = 0;
+static __thread size_t block_used = 0;
+
+static __thread overflow_t* p_overflow = NULL;
+static __thread size_t overflow_size = 0;
+
+//---------------------------------------------------------
+void* frame_alloc(size_t size)
+{
+  size = ALIGN_UP(size, FRAME_ARENA_ALIGN);
+
+  if (size <= block_size - block_used) {
+    void* p = p_block + block_used;
+    block_used += size;
+    return p;
+  }
+
+  overflow_t* p_node = malloc(sizeof(overflow_t) + size);
+  if (!p_node) return NULL;
+  p_node->p_next = p_overflow;
+  p_overflow = p_node;
+  overflow_size += size;
+
+  return p_node + 1;
+}
+
+//---------------------------------------------------------
+void frame_arena_reset()
+{
+  while (p_overflow) {
+    overflow_t* p_next = p_overflow->p_next;
+    free(p_overflow);
+    p_overflow = p_next;
+  }
+
+  // grow the block to hold everything the last frame needed
+  if (overflow_size > 0 || !p_block) {
+    size_t size = block_used + overflow_size;
+    if (size < FRAME_ARENA_MIN_SIZE) size = FRAME_ARENA_MIN_SIZE;
+    size = ALIGN_UP(size + size / 4, FRAME_ARENA_ALIGN);
+
+    uint8_t* p = malloc(size);
+    if (p) {
+      free(p_block);
+      p_block = p;
+      block_size = size;
+    }
+  }
+
+  block_used = 0;
+  overflow_size = 0;
+}
@@ -0,0 +1,23 @@
+/*
+# Scratch memory that lives for one frame.
+
+frame_alloc hands out memory by bumping a pointer through one block,
+and all of it is given back at once when the next frame starts. If a
+frame needs more than the block holds, the extra comes from malloc and
+the block is grown to cover it at the next reset, so a scene that
+renders the same way every frame settles into no mallocs at all.
+
+Each thread has an arena of its own, which it resets at the start of
+whatever it does each frame.
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+// Returns 16 byte aligned memory that is good until the next
+// frame_arena_reset, or NULL if it can't be had.
+void* frame_alloc(size_t size);
+
+// Give back everything handed out since the last reset
+void frame_arena_reset();
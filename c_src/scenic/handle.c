@@ -0,0 +1,157 @@
+/*
+#  Interned ids. See handle.h
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "comms.h"
+#include "handle.h"
+#include "tommyhashlin.h"
+#include "utils.h"
+
+#define HASH_ID(id) tommy_hash_u32( 0, id.p_data, id.size )
+
+// the entry in the id hash. The id bytes follow it in the same block
+typedef struct {
+  handle_t handle;
+  sid_t id;
+  tommy_hashlin_node node;
+} handle_entry_t;
+
+handle_slot_t* g_handle_slots = NULL;
+uint32_t g_handle_epoch = 1;
+
+static uint32_t slot_count = 0;
+static uint32_t slots_used = 0;
+
+// handles whose slots can be reused
+static handle_t* p_free = NULL;
+static uint32_t free_count = 0;
+
+static tommy_hashlin ids = {0};
+
+//---------------------------------------------------------
+void init_handles(void)
+{
+  tommy_hashlin_init(&ids);
+
+  // slot zero is HANDLE_NONE. It is never handed out, and since it is
+  // always empty, following it finds nothing
+  slot_count = 64;
+  g_handle_slots = calloc(slot_count, sizeof(handle_slot_t));
+  p_free = calloc(slot_count, sizeof(handle_t));
+  slots_used = 1;
+}
+
+//---------------------------------------------------------
+static int _comparator(const void* p_arg, const void* p_obj)
+{
+  const sid_t* p_id = p_arg;
+  const handle_entry_t* p_entry = p_obj;
+  return (p_id->size != p_entry->id.size)
+    || memcmp(p_id->p_data, p_entry->id.p_data, p_id->size);
+}
+
+//---------------------------------------------------------
+static handle_entry_t* find_entry(sid_t id)
+{
+  return tommy_hashlin_search(&ids, _comparator, &id, HASH_ID(id));
+}
+
+//---------------------------------------------------------
+handle_t handle_find(sid_t id)
+{
+  handle_entry_t* p_entry = find_entry(id);
+  return p_entry ? p_entry->handle : HANDLE_NONE;
+}
+
+//---------------------------------------------------------
+static handle_t alloc_slot()
+{
+  if (free_count > 0) {
+    return p_free[--free_count];
+  }
+
+  if (slots_used == slot_count) {
+    uint32_t count = slot_count * 2;
+    handle_slot_t* p_slots = realloc(g_handle_slots, count * sizeof(handle_slot_t));
+    if (!p_slots) return HANDLE_NONE;
+    g_handle_slots = p_slots;
+
+    handle_t* p_new_free = realloc(p_free, count * sizeof(handle_t));
+    if (!p_new_free) return HANDLE_NONE;
+    p_free = p_new_free;
+
+    memset(g_handle_slots + slot_count, 0, (count - slot_count) * sizeof(handle_slot_t));
+    slot_count = count;
+  }
+
+  return slots_used++;
+}
+
+//---------------------------------------------------------
+handle_t handle_intern(sid_t id)
+{
+  handle_entry_t* p_entry = find_entry(id);
+  if (p_entry) {
+    handle_slot(p_entry->handle)->ref_count++;
+    return p_entry->handle;
+  }
+
+  int struct_size = ALIGN_UP(sizeof(handle_entry_t), 8);
+  p_entry = malloc(struct_size + id.size);
+  if (!p_entry) {
+    log_error("%s unable to allocate id", __func__);
+    return HANDLE_NONE;
+  }
+
+  handle_t handle = alloc_slot();
+  if (handle == HANDLE_NONE) {
+    log_error("%s unable to allocate handle", __func__);
+    free(p_entry);
+    return HANDLE_NONE;
+  }
+
+  p_entry->handle = handle;
+  p_entry->id.size = id.size;
+  p_entry->id.p_data = ((void*)p_entry) + struct_size;
+  memcpy(p_entry->id.p_data, id.p_data, id.size);
+  tommy_hashlin_insert(&ids, &p_entry->node, p_entry, HASH_ID(p_entry->id));
+
+  // keep the generation counting up across reuse of the slot
+  handle_slot_t* p_slot = handle_slot(handle);
+  uint32_t generation = p_slot->generation;
+  memset(p_slot, 0, sizeof(handle_slot_t));
+  p_slot->id = p_entry->id;
+  p_slot->generation = generation + 1;
+  p_slot->ref_count = 1;
+
+  return handle;
+}
+
+//---------------------------------------------------------
+void handle_release(handle_t handle)
+{
+  if (handle == HANDLE_NONE) return;
+
+  handle_slot_t* p_slot = handle_slot(handle);
+  if (--p_slot->ref_count > 0) return;
+
+  handle_entry_t* p_entry = find_entry(p_slot->id);
+  if (p_entry) {
+    tommy_hashlin_remove_existing(&ids, &p_entry->node);
+    free(p_entry);
+  }
+
+  p_slot->id.p_data = NULL;
+  p_slot->id.size = 0;
+  p_free[free_count++] = handle;
+}
+
+//---------------------------------------------------------
+void handle_touch(handle_t handle)
+{
+  handle_slot(handle)->generation++;
+  g_handle_epoch++;
+}
@@ -0,0 +1,56 @@
+/*
+# Interned ids
+
+Scripts, images and fonts are all named by id strings. Each id that is
+in use is interned once, when it arrives, into a small integer handle
+that indexes a slot. The slot holds whatever script, image and font
+currently go by that id, so compiled scripts can hold handles and
+follow them at render time without hashing any strings.
+
+A slot stays alive while anything holds its handle. The generation
+counter goes up every time something in the slot is replaced, removed
+or changes content, so anything caching work derived from the target
+can tell when it went stale.
+*/
+
+#pragma once
+
+#include "scenic_types.h"
+
+typedef uint32_t handle_t;
+
+#define HANDLE_NONE 0
+
+typedef struct {
+  sid_t id;
+  void* p_script;
+  void* p_image;
+  void* p_font;
+  uint32_t generation;
+  uint32_t ref_count;
+} handle_slot_t;
+
+extern handle_slot_t* g_handle_slots;
+
+// goes up whenever any generation does
+extern uint32_t g_handle_epoch;
+
+void init_handles(void);
+
+// Find or create the handle for an id and take a reference on it.
+// Returns HANDLE_NONE if it can't be allocated.
+handle_t handle_intern(sid_t id);
+
+// Find the handle for an id without creating it or taking a reference.
+handle_t handle_find(sid_t id);
+
+// Drop a reference taken by handle_intern. HANDLE_NONE is ignored.
+void handle_release(handle_t handle);
+
+// note that the target(s) of a handle changed
+void handle_touch(handle_t handle);
+
+static inline handle_slot_t* handle_slot(handle_t handle)
+{
+  return &g_handle_slots[handle];
+}
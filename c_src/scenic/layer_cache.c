@@ -0,0 +1,132 @@
+/*
+#  Layer cache. See layer_cache.h
+*/
+
+#include <stdlib.h>
+
+#include "comms.h"
+#include "device.h"
+#include "layer_cache.h"
+
+#define HASH_KEY(p_key) tommy_hash_u32(0, p_key, sizeof(layer_key_t))
+
+static tommy_hashlin layers = {0};
+
+// most recently used first
+static layer_t* p_newest = NULL;
+static layer_t* p_oldest = NULL;
+
+static size_t bytes_used = 0;
+
+//---------------------------------------------------------
+void init_layers()
+{
+  tommy_hashlin_init(&layers);
+}
+
+//---------------------------------------------------------
+static void unlink_layer(layer_t* p_layer)
+{
+  if (p_layer->p_prev) p_layer->p_prev->p_next = p_layer->p_next;
+  else p_newest = p_layer->p_next;
+  if (p_layer->p_next) p_layer->p_next->p_prev = p_layer->p_prev;
+  else p_oldest = p_layer->p_prev;
+  p_layer->p_prev = p_layer->p_next = NULL;
+}
+
+//---------------------------------------------------------
+static void link_newest(layer_t* p_layer)
+{
+  p_layer->p_prev = NULL;
+  p_layer->p_next = p_newest;
+  if (p_newest) p_newest->p_prev = p_layer;
+  else p_oldest = p_layer;
+  p_newest = p_layer;
+}
+
+//---------------------------------------------------------
+static void free_layer(layer_t* p_layer)
+{
+  tommy_hashlin_remove_existing(&layers, &p_layer->node);
+  unlink_layer(p_layer);
+  bytes_used -= p_layer->bytes;
+  device_layer_free(p_layer->p_surface);
+  free(p_layer);
+}
+
+//---------------------------------------------------------
+static int _comparator(const void* p_arg, const void* p_obj)
+{
+  const layer_key_t* p_key = p_arg;
+  const layer_t* p_layer = p_obj;
+  return p_key->handle != p_layer->key.handle
+    || p_key->scale != p_layer->key.scale
+    || p_key->phase_x != p_layer->key.phase_x
+    || p_key->phase_y != p_layer->key.phase_y;
+}
+
+//---------------------------------------------------------
+layer_t* layer_find(const layer_key_t* p_key, uint32_t stamp)
+{
+  layer_t* p_layer = tommy_hashlin_search(&layers, _comparator, p_key,
+                                          HASH_KEY(p_key));
+  if (!p_layer) return NULL;
+
+  if (p_layer->stamp != stamp) {
+    free_layer(p_layer);
+    return NULL;
+  }
+
+  unlink_layer(p_layer);
+  link_newest(p_layer);
+  return p_layer;
+}
+
+//---------------------------------------------------------
+layer_t* layer_add(const layer_key_t* p_key, uint32_t stamp, void* p_surface,
+                   size_t bytes)
+{
+  layer_t* p_layer = NULL;
+  if (bytes <= LAYER_CACHE_BUDGET) p_layer = malloc(sizeof(layer_t));
+  if (!p_layer) {
+    device_layer_free(p_surface);
+    return NULL;
+  }
+
+  // there is only ever one layer for a key
+  layer_t* p_old = tommy_hashlin_search(&layers, _comparator, p_key,
+                                        HASH_KEY(p_key));
+  if (p_old) free_layer(p_old);
+
+  while (p_oldest && bytes_used + bytes > LAYER_CACHE_BUDGET) {
+    free_layer(p_oldest);
+  }
+
+  *p_layer = (layer_t){
+    .key = *p_key,
+    .stamp = stamp,
+    .p_surface = p_surface,
+    .bytes = bytes
+  };
+  tommy_hashlin_insert(&layers, &p_layer->node, p_layer, HASH_KEY(p_key));
+  link_newest(p_layer);
+  bytes_used += bytes;
+  return p_layer;
+}
+
+//---------------------------------------------------------
+void layer_drop(handle_t handle)
+{
+  layer_t* p_layer = p_newest;
+  while (p_layer) {
+    layer_t* p_next = p_layer->p_next;
+    if (p_layer->key.handle == handle) free_layer(p_layer);
+    p_layer = p_next;
+  }
+}
+
+//---------------------------------------------------------
+void layer_clear()
+{
+  while (p_oldest) free_layer(p_oldest);
+}
@@ -0,0 +1,71 @@
+/*
+# Layer cache
+
+Scripts that have stopped changing can be drawn once into an offscreen
+surface on the device and composited from there on later frames, so a
+complicated widget costs one blit instead of all of its drawing.
+
+A raster layer is only good for the exact pixels it was drawn at, so
+it is found by the script's handle, the scale it was drawn at and
+where in a pixel its origin fell, both rounded to a few steps. A
+vector layer is a recording of the drawing itself, which can be played
+back under any transform. Its key has a scale of 0. The stamp says
+what the script tree looked like when the layer was drawn. A layer
+whose stamp doesn't match any more is stale and is dropped when it is
+found.
+
+The surfaces belong to the device. The cache only holds on to them,
+and frees the least recently used ones when they take up more than
+the budget.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "handle.h"
+#include "tommyhashlin.h"
+
+// the most memory the layers can hold on to, in bytes
+#define LAYER_CACHE_BUDGET (32 * 1024 * 1024)
+
+#define LAYER_SCALE_STEPS 1024
+#define LAYER_PHASE_STEPS 4
+
+typedef struct {
+  handle_t handle;
+  int32_t scale;      // in 1/LAYER_SCALE_STEPS. 0 for a vector layer
+  int32_t phase_x;    // where in a pixel the origin falls,
+  int32_t phase_y;    // in 1/LAYER_PHASE_STEPS
+} layer_key_t;
+
+typedef struct _layer_t {
+  layer_key_t key;
+  uint32_t stamp;
+  void* p_surface;
+  size_t bytes;
+  int x, y;           // raster layers: the corner, from the pixel the
+                      // origin is in
+  struct _layer_t* p_prev;  // more recently used
+  struct _layer_t* p_next;  // less recently used
+  tommy_hashlin_node node;
+} layer_t;
+
+void init_layers();
+
+// NULL if there isn't one, or it is stale
+layer_t* layer_find(const layer_key_t* p_key, uint32_t stamp);
+
+// Take over a surface the device has drawn, which takes up about
+// bytes. Frees it again and returns NULL if it doesn't fit in the
+// budget.
+layer_t* layer_add(const layer_key_t* p_key, uint32_t stamp, void* p_surface,
+                   size_t bytes);
+
+// free the layers of a script that is gone
+void layer_drop(handle_t handle);
+
+// free all of them
+void layer_clear();
@@ -0,0 +1,270 @@
+/*
+# Binary log records.
+
+Records from any thread are appended to one buffer under a mutex.
+Warnings and errors are sent straight away, everything else goes out
+when the buffer fills or the scenic loop calls log_flush.
+*/
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "out_queue.h"
+
+// must be a power of two
+#define LOG_MAX_FORMATS 1024
+
+#define LOG_BATCH_SIZE (32 * 1024)
+#define LOG_RECORD_SIZE 2048
+
+typedef struct {
+  const char* format;
+  uint32_t id;
+} log_format_t;
+
+PACK(typedef struct log_record_header_t
+{
+  uint32_t size;
+  uint32_t level;
+  uint32_t format_id;
+}) log_record_header_t;
+
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static log_level_t log_level = log_level_debug;
+
+// format strings are identified by address
+static log_format_t formats[LOG_MAX_FORMATS];
+static uint32_t format_count = 0;
+
+static uint8_t batch[LOG_BATCH_SIZE];
+static uint32_t batch_used = sizeof(uint32_t);
+static bool exit_registered = false;
+
+//---------------------------------------------------------
+static uint32_t level_msg_id(log_level_t level)
+{
+  switch(level) {
+  case log_level_debug: return MSG_OUT_DEBUG;
+  case log_level_info: return MSG_OUT_INFO;
+  case log_level_warn: return MSG_OUT_WARN;
+  default: return MSG_OUT_ERROR;
+  }
+}
+
+//---------------------------------------------------------
+void log_set_level(log_level_t level)
+{
+  log_level = level;
+}
+
+//---------------------------------------------------------
+// log_mutex must be held
+static void send_batch()
+{
+  if (batch_used <= sizeof(uint32_t)) return;
+
+  uint32_t msg_id = MSG_OUT_LOG_BATCH;
+  memcpy(batch, &msg_id, sizeof(uint32_t));
+  out_queue_push(batch, batch_used, NULL, 0);
+  batch_used = sizeof(uint32_t);
+}
+
+//---------------------------------------------------------
+void log_flush()
+{
+  pthread_mutex_lock(&log_mutex);
+  send_batch();
+  pthread_mutex_unlock(&log_mutex);
+}
+
+static void log_exit()
+{
+  log_flush();
+  out_queue_flush();
+}
+
+//---------------------------------------------------------
+// Find the id for a format, sending its definition the first time it is
+// seen. Returns false if the table is full. log_mutex must be held.
+static bool format_id(const char* format, uint32_t* p_id)
+{
+  uint32_t slot = ((uintptr_t)format >> 3) & (LOG_MAX_FORMATS - 1);
+  for (uint32_t i = 0; i < LOG_MAX_FORMATS; i++) {
+    log_format_t* p_format = &formats[(slot + i) & (LOG_MAX_FORMATS - 1)];
+    if (p_format->format == format) {
+      *p_id = p_format->id;
+      return true;
+    }
+    if (!p_format->format) {
+      // keep one slot free so lookups always terminate
+      if (format_count >= LOG_MAX_FORMATS - 1) return false;
+      p_format->format = format;
+      p_format->id = format_count++;
+
+      uint32_t head[2] = { MSG_OUT_LOG_FORMAT, p_format->id };
+      out_queue_push(head, sizeof(head), format, strlen(format));
+
+      *p_id = p_format->id;
+      return true;
+    }
+  }
+  return false;
+}
+
+//---------------------------------------------------------
+static uint8_t* put_int(uint8_t* p, uint8_t* p_end, int64_t value)
+{
+  if (p_end - p < 1 + (int)sizeof(int64_t)) return p_end;
+  *p++ = 'i';
+  memcpy(p, &value, sizeof(int64_t));
+  return p + sizeof(int64_t);
+}
+
+static uint8_t* put_double(uint8_t* p, uint8_t* p_end, double value)
+{
+  if (p_end - p < 1 + (int)sizeof(double)) return p_end;
+  *p++ = 'f';
+  memcpy(p, &value, sizeof(double));
+  return p + sizeof(double);
+}
+
+static uint8_t* put_string(uint8_t* p, uint8_t* p_end, const char* str, int max)
+{
+  if (!str) str = "(null)";
+
+  // long strings are cut to fit the record
+  uint32_t len = (max >= 0) ? strnlen(str, max) : strlen(str);
+  int room = p_end - p - 1 - (int)sizeof(uint32_t);
+  if (room < 0) return p_end;
+  if (len > (uint32_t)room) len = room;
+
+  *p++ = 's';
+  memcpy(p, &len, sizeof(uint32_t));
+  p += sizeof(uint32_t);
+  memcpy(p, str, len);
+  return p + len;
+}
+
+//---------------------------------------------------------
+// walk the format and encode each argument it consumes. Returns the end
+// of the encoded arguments.
+static uint8_t* encode_args(uint8_t* p, uint8_t* p_end, const char* f, va_list args)
+{
+  while ((f = strchr(f, '%'))) {
+    f++;
+    if (*f == '%') {
+      f++;
+      continue;
+    }
+
+    while (*f && strchr("-+ #0", *f)) f++;
+
+    if (*f == '*') {
+      p = put_int(p, p_end, va_arg(args, int));
+      f++;
+    }
+    while (*f >= '0' && *f <= '9') f++;
+
+    int precision = -1;
+    if (*f == '.') {
+      f++;
+      if (*f == '*') {
+        precision = va_arg(args, int);
+        p = put_int(p, p_end, precision);
+        f++;
+      } else {
+        precision = atoi(f);
+      }
+      while (*f >= '0' && *f <= '9') f++;
+    }
+
+    int longs = 0;
+    while (*f && strchr("hlLqjzt", *f)) {
+      if (*f == 'l' || *f == 'q' || *f == 'j' || *f == 'z' || *f == 't') longs++;
+      f++;
+    }
+
+    switch (*f) {
+    case 'd': case 'i':
+      if (longs > 1) p = put_int(p, p_end, va_arg(args, long long));
+      else if (longs) p = put_int(p, p_end, va_arg(args, long));
+      else p = put_int(p, p_end, va_arg(args, int));
+      break;
+    case 'u': case 'x': case 'X': case 'o': case 'c':
+      if (longs > 1) p = put_int(p, p_end, va_arg(args, unsigned long long));
+      else if (longs) p = put_int(p, p_end, va_arg(args, unsigned long));
+      else p = put_int(p, p_end, va_arg(args, unsigned int));
+      break;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+      p = put_double(p, p_end, va_arg(args, double));
+      break;
+    case 's':
+      p = put_string(p, p_end, va_arg(args, const char*), precision);
+      break;
+    case 'p':
+      p = put_int(p, p_end, (int64_t)(uintptr_t)va_arg(args, void*));
+      break;
+    case '\0':
+      return p;
+    default:
+      // not a conversion (the script op logs use "%{"), so printf
+      // leaves it as is and takes no argument for it
+      continue;
+    }
+    f++;
+  }
+
+  return p;
+}
+
+//---------------------------------------------------------
+void log_record(log_level_t level, const char* format, va_list args)
+{
+  if (level < log_level) return;
+
+  // kept in case the line has to be sent as text after all
+  va_list text_args;
+  va_copy(text_args, args);
+
+  uint8_t record[LOG_RECORD_SIZE];
+  uint8_t* p_args = record + sizeof(log_record_header_t);
+  uint8_t* p_end = encode_args(p_args, record + LOG_RECORD_SIZE, format, args);
+  uint32_t id;
+
+  pthread_mutex_lock(&log_mutex);
+
+  if (!exit_registered) {
+    exit_registered = true;
+    atexit(log_exit);
+  }
+
+  if (!format_id(format, &id)) {
+    // out of format ids. Keep the order and fall back to plain text
+    send_batch();
+    logv(level_msg_id(level), format, text_args);
+    pthread_mutex_unlock(&log_mutex);
+    va_end(text_args);
+    return;
+  }
+  log_record_header_t header = {
+    p_end - record - sizeof(uint32_t), level_msg_id(level), id
+  };
+  memcpy(record, &header, sizeof(log_record_header_t));
+
+  uint32_t size = p_end - record;
+  if (batch_used + size > LOG_BATCH_SIZE) {
+    send_batch();
+  }
+  memcpy(batch + batch_used, record, size);
+  batch_used += size;
+
+  if (level >= log_level_warn) {
+    send_batch();
+  }
+
+  pthread_mutex_unlock(&log_mutex);
+  va_end(text_args);
+}
@@ -0,0 +1,30 @@
+/*
+# Binary log records.
+
+Log lines are not formatted here. Each one is sent as the id of its
+format string plus the raw arguments, and the caller formats them only
+if its logger is going to use the line. A format string is sent once,
+in a MSG_OUT_LOG_FORMAT message, the first time it is used. Records are
+collected into MSG_OUT_LOG_BATCH messages.
+
+  MSG_OUT_LOG_FORMAT: u32 msg_id, u32 format_id, format bytes
+  MSG_OUT_LOG_BATCH:  u32 msg_id, then records of
+                      u32 size, u32 level msg_id, u32 format_id, args
+
+Each argument is a one byte tag followed by its value, native-endian:
+'i' int64, 'f' double, 's' u32 length then the bytes.
+*/
+
+#pragma once
+
+#include <stdarg.h>
+
+#include "comms.h"
+
+// lines below this level are dropped before anything is encoded
+void log_set_level(log_level_t level);
+
+void log_record(log_level_t level, const char* format, va_list args);
+
+// send whatever has been collected so far
+void log_flush();
@@ -0,0 +1,262 @@
+/*
+# Lock-free multi-producer, single-consumer queue of outbound messages.
+
+Slots are claimed with a compare-and-swap on the enqueue position and
+published through a per-slot sequence number (the bounded queue design
+by Dmitry Vyukov). Small messages are encoded inline in the slot,
+bigger ones are copied to the heap. The writer thread is the only
+consumer and the only thing that ever writes to stdout.
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "comms.h"
+#include "out_queue.h"
+
+// must be a power of two
+#define OUT_QUEUE_SIZE 1024
+#define OUT_QUEUE_MASK (OUT_QUEUE_SIZE - 1)
+
+// the input events all fit inline with room to spare
+#define OUT_MSG_INLINE_SIZE 48
+
+// the most messages handed to one writev call
+#define OUT_WRITEV_MAX 64
+
+// how long out_queue_flush waits for a stuck pipe before giving up
+#define OUT_FLUSH_TIMEOUT_MS 1000
+
+// the positions, sequences and writer_sleeping are only touched
+// through the __atomic builtins
+typedef struct {
+  uint32_t sequence;
+  uint32_t size;          // total size, including the length header
+  uint8_t* p_heap;        // set when the message didn't fit inline
+  uint8_t data[OUT_MSG_INLINE_SIZE];
+} out_slot_t;
+
+static out_slot_t slots[OUT_QUEUE_SIZE];
+static uint32_t enqueue_pos = 0;
+static uint32_t dequeue_pos = 0;
+
+// the writer only sleeps on the condition when the queue is empty, so
+// producers touch the mutex only when they have to wake it up
+static bool writer_sleeping = false;
+static bool writer_woken = false;
+static pthread_mutex_t writer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writer_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_once_t writer_once = PTHREAD_ONCE_INIT;
+static pthread_t writer_thread;
+
+//---------------------------------------------------------
+static inline bool slot_ready(uint32_t pos)
+{
+  return __atomic_load_n(&slots[pos & OUT_QUEUE_MASK].sequence, __ATOMIC_SEQ_CST)
+    == pos + 1;
+}
+
+//---------------------------------------------------------
+// write the whole iovec out, picking up where partial writes leave off
+static void writev_all(struct iovec* iov, int count)
+{
+  while (count > 0) {
+    ssize_t wrote = writev(STDOUT_FILENO, iov, count);
+    if (wrote < 0) {
+      if (errno == EINTR) continue;
+      // the caller is gone. Nothing useful to do but drop the messages
+      return;
+    }
+
+    while (count > 0 && (size_t)wrote >= iov->iov_len) {
+      wrote -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = (uint8_t*)iov->iov_base + wrote;
+      iov->iov_len -= wrote;
+    }
+  }
+}
+
+//---------------------------------------------------------
+// write out every message that is ready. Returns the number written.
+static int drain()
+{
+  struct iovec iov[OUT_WRITEV_MAX];
+  uint32_t pos = __atomic_load_n(&dequeue_pos, __ATOMIC_RELAXED);
+  int total = 0;
+
+  for (;;) {
+    int count = 0;
+    int iov_count = 0;
+    while (count < OUT_WRITEV_MAX && slot_ready(pos + count)) {
+      out_slot_t* p_slot = &slots[(pos + count) & OUT_QUEUE_MASK];
+      // a message that was dropped still has its slot, with nothing in it
+      if (p_slot->size > 0) {
+        iov[iov_count].iov_base = p_slot->p_heap ? p_slot->p_heap : p_slot->data;
+        iov[iov_count].iov_len = p_slot->size;
+        iov_count++;
+      }
+      count++;
+    }
+    if (count == 0) break;
+
+    writev_all(iov, iov_count);
+
+    // hand the slots back to the producers
+    for (int i = 0; i < count; i++) {
+      out_slot_t* p_slot = &slots[(pos + i) & OUT_QUEUE_MASK];
+      if (p_slot->p_heap) {
+        free(p_slot->p_heap);
+        p_slot->p_heap = NULL;
+      }
+      __atomic_store_n(&p_slot->sequence, pos + i + OUT_QUEUE_SIZE,
+                       __ATOMIC_RELEASE);
+    }
+    pos += count;
+    __atomic_store_n(&dequeue_pos, pos, __ATOMIC_SEQ_CST);
+    total += count;
+  }
+
+  return total;
+}
+
+//---------------------------------------------------------
+static void* writer_loop(void* user_data)
+{
+  for (;;) {
+    if (drain() > 0) continue;
+
+    // announce the intent to sleep, then look again so a message
+    // published in between isn't missed
+    __atomic_store_n(&writer_sleeping, true, __ATOMIC_SEQ_CST);
+    if (slot_ready(__atomic_load_n(&dequeue_pos, __ATOMIC_SEQ_CST))
+        && __atomic_exchange_n(&writer_sleeping, false, __ATOMIC_SEQ_CST)) {
+      continue;
+    }
+
+    pthread_mutex_lock(&writer_mutex);
+    while (!writer_woken) {
+      pthread_cond_wait(&writer_cond, &writer_mutex);
+    }
+    writer_woken = false;
+    pthread_mutex_unlock(&writer_mutex);
+  }
+
+  return NULL;
+}
+
+//---------------------------------------------------------
+static void start_writer()
+{
+  for (uint32_t i = 0; i < OUT_QUEUE_SIZE; i++) {
+    __atomic_store_n(&slots[i].sequence, i, __ATOMIC_RELAXED);
+  }
+
+  pthread_create(&writer_thread, NULL, writer_loop, NULL);
+
+  // make sure the last words before an exit() make it out
+  atexit(out_queue_flush);
+}
+
+//---------------------------------------------------------
+static void wake_writer()
+{
+  if (!__atomic_load_n(&writer_sleeping, __ATOMIC_SEQ_CST)) return;
+  if (!__atomic_exchange_n(&writer_sleeping, false, __ATOMIC_SEQ_CST)) return;
+
+  pthread_mutex_lock(&writer_mutex);
+  writer_woken = true;
+  pthread_cond_signal(&writer_cond);
+  pthread_mutex_unlock(&writer_mutex);
+}
+
+//---------------------------------------------------------
+void out_queue_push(const void* p_head, uint32_t head_size,
+                    const void* p_body, uint32_t body_size)
+{
+  pthread_once(&writer_once, start_writer);
+
+  uint32_t msg_len = head_size + body_size;
+  uint32_t size = sizeof(uint32_t) + msg_len;
+
+  // claim a slot
+  out_slot_t* p_slot;
+  uint32_t pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+  for (;;) {
+    p_slot = &slots[pos & OUT_QUEUE_MASK];
+    uint32_t seq = __atomic_load_n(&p_slot->sequence, __ATOMIC_ACQUIRE);
+    int32_t dif = (int32_t)(seq - pos);
+    if (dif == 0) {
+      if (__atomic_compare_exchange_n(&enqueue_pos, &pos, pos + 1, true,
+                                                __ATOMIC_RELAXED,
+                                                __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (dif < 0) {
+      // full. The caller isn't keeping up with us, so there is nothing
+      // better to do than wait for the writer to make some room
+      wake_writer();
+      sched_yield();
+      pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+    } else {
+      pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+    }
+  }
+
+  // encode the message into it. The length from erlang is always big-endian
+  uint8_t* p = p_slot->data;
+  p_slot->p_heap = NULL;
+  if (size > OUT_MSG_INLINE_SIZE) {
+    p = p_slot->p_heap = malloc(size);
+  }
+
+  if (p) {
+    uint32_t len = hton_ui32(msg_len);
+    memcpy(p, &len, sizeof(uint32_t));
+    if (head_size) memcpy(p + sizeof(uint32_t), p_head, head_size);
+    if (body_size) memcpy(p + sizeof(uint32_t) + head_size, p_body, body_size);
+    p_slot->size = size;
+  } else {
+    // the slot still has to be published, but with nothing in it. An
+    // empty message would be more than the caller can take apart.
+    p_slot->size = 0;
+  }
+
+  // publish it
+  __atomic_store_n(&p_slot->sequence, pos + 1, __ATOMIC_SEQ_CST);
+  wake_writer();
+
+  // Not through log_error, which pushes its batches while it holds the
+  // log lock, and may be what is pushing this one.
+  if (!p) {
+    fprintf(stderr, "out_queue: dropped a %u byte message, out of memory\n",
+            msg_len);
+  }
+}
+
+//---------------------------------------------------------
+void out_queue_flush()
+{
+  uint32_t target = __atomic_load_n(&enqueue_pos, __ATOMIC_SEQ_CST);
+  struct timespec ts = {0, 1000000};
+
+  for (int ms = 0; ms < OUT_FLUSH_TIMEOUT_MS; ms++) {
+    uint32_t done = __atomic_load_n(&dequeue_pos, __ATOMIC_SEQ_CST);
+    if ((int32_t)(done - target) >= 0) return;
+    wake_writer();
+    nanosleep(&ts, NULL);
+  }
+}
@@ -0,0 +1,19 @@
+/*
+# Queue of messages on their way up to the caller.
+
+Any thread can push a message without taking a lock or touching the
+pipe. A single writer thread drains the queue and hands as many
+messages as are ready to one writev call.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// Queue one framed message. The 4 byte length header is added here, and
+// the message body is p_head followed by p_body (which may be NULL).
+void out_queue_push(const void* p_head, uint32_t head_size,
+                    const void* p_body, uint32_t body_size);
+
+// Wait (briefly) for everything queued so far to reach the pipe
+void out_queue_flush();
@@ -0,0 +1,178 @@
+/*
+# Event loop for the scenic thread.
+
+Timers are kept as absolute deadlines. The poll timeout is the time to
+the nearest one, so with nothing to do the thread sleeps until there is.
+*/
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "comms.h"
+#include "reactor.h"
+
+typedef struct {
+  reactor_fd_fn fn;
+  void* user_data;
+} fd_handler_t;
+
+typedef struct {
+  bool active;
+  int64_t interval;
+  int64_t deadline;
+  reactor_timer_fn fn;
+  void* user_data;
+} reactor_timer_t;
+
+static struct pollfd poll_fds[REACTOR_MAX_FDS];
+static fd_handler_t fd_handlers[REACTOR_MAX_FDS];
+static int fd_count = 0;
+
+static reactor_timer_t timers[REACTOR_MAX_TIMERS];
+
+// time spent sleeping in poll, for the idle stats
+static int64_t idle_us = 0;
+static int64_t idle_start = 0;
+
+//---------------------------------------------------------
+static int64_t now_us()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+//---------------------------------------------------------
+bool reactor_add_fd(int fd, short events, reactor_fd_fn fn, void* user_data)
+{
+  if (fd_count >= REACTOR_MAX_FDS) {
+    log_error("%s too many fds", __func__);
+    return false;
+  }
+
+  poll_fds[fd_count].fd = fd;
+  poll_fds[fd_count].events = events;
+  poll_fds[fd_count].revents = 0;
+  fd_handlers[fd_count].fn = fn;
+  fd_handlers[fd_count].user_data = user_data;
+  fd_count++;
+  return true;
+}
+
+//---------------------------------------------------------
+void reactor_remove_fd(int fd)
+{
+  for (int i = 0; i < fd_count; i++) {
+    if (poll_fds[i].fd == fd) {
+      fd_count--;
+      poll_fds[i] = poll_fds[fd_count];
+      fd_handlers[i] = fd_handlers[fd_count];
+      return;
+    }
+  }
+}
+
+//---------------------------------------------------------
+int reactor_add_timer(int64_t interval_us, reactor_timer_fn fn, void* user_data)
+{
+  if (interval_us <= 0) return -1;
+
+  for (int i = 0; i < REACTOR_MAX_TIMERS; i++) {
+    if (!timers[i].active) {
+      timers[i].active = true;
+      timers[i].interval = interval_us;
+      timers[i].deadline = now_us() + interval_us;
+      timers[i].fn = fn;
+      timers[i].user_data = user_data;
+      return i;
+    }
+  }
+
+  log_error("%s too many timers", __func__);
+  return -1;
+}
+
+//---------------------------------------------------------
+void reactor_remove_timer(int id)
+{
+  if (id >= 0 && id < REACTOR_MAX_TIMERS) {
+    timers[id].active = false;
+  }
+}
+
+//---------------------------------------------------------
+// milliseconds until the nearest timer, rounded up. -1 if there are none
+static int next_timeout(int64_t now)
+{
+  int64_t nearest = -1;
+  for (int i = 0; i < REACTOR_MAX_TIMERS; i++) {
+    if (!timers[i].active) continue;
+    int64_t wait = timers[i].deadline - now;
+    if (wait < 0) wait = 0;
+    if (nearest < 0 || wait < nearest) nearest = wait;
+  }
+
+  if (nearest < 0) return -1;
+  return (int)((nearest + 999) / 1000);
+}
+
+//---------------------------------------------------------
+static void run_timers()
+{
+  int64_t now = now_us();
+  for (int i = 0; i < REACTOR_MAX_TIMERS; i++) {
+    if (!timers[i].active || timers[i].deadline > now) continue;
+
+    // skip any ticks that were missed instead of firing them in a burst
+    timers[i].deadline += timers[i].interval;
+    if (timers[i].deadline <= now) {
+      timers[i].deadline = now + timers[i].interval;
+    }
+    timers[i].fn(timers[i].user_data);
+  }
+}
+
+//---------------------------------------------------------
+void reactor_run_once(bool block)
+{
+  int64_t before = now_us();
+  if (idle_start == 0) idle_start = before;
+
+  int timeout = block ? next_timeout(before) : 0;
+  int ready = poll(poll_fds, fd_count, timeout);
+  idle_us += now_us() - before;
+
+  if (ready < 0 && errno != EINTR) {
+    log_error("%s poll failed: %s", __func__, strerror(errno));
+  }
+
+  if (ready > 0) {
+    // handlers may add or remove fds, so work from a snapshot
+    struct pollfd fds[REACTOR_MAX_FDS];
+    fd_handler_t handlers[REACTOR_MAX_FDS];
+    int count = fd_count;
+    memcpy(fds, poll_fds, sizeof(struct pollfd) * count);
+    memcpy(handlers, fd_handlers, sizeof(fd_handler_t) * count);
+
+    for (int i = 0; i < count; i++) {
+      if (fds[i].revents) {
+        handlers[i].fn(fds[i].fd, fds[i].revents, handlers[i].user_data);
+      }
+    }
+  }
+
+  run_timers();
+}
+
+//---------------------------------------------------------
+int reactor_idle_percent()
+{
+  int64_t now = now_us();
+  int64_t elapsed = now - idle_start;
+  int percent = (elapsed > 0) ? (int)(idle_us * 100 / elapsed) : 100;
+
+  idle_start = now;
+  idle_us = 0;
+  return percent;
+}
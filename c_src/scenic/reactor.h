@@ -0,0 +1,35 @@
+/*
+# Event loop for the scenic thread.
+
+Waits on file descriptors and timers together and only wakes up when
+one of them needs attention. Plain poll() is used rather than epoll so
+the same loop runs on macOS; with a handful of descriptors there is no
+difference in cost.
+*/
+
+#pragma once
+
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define REACTOR_MAX_FDS 8
+#define REACTOR_MAX_TIMERS 8
+
+typedef void (*reactor_fd_fn)(int fd, short revents, void* user_data);
+typedef void (*reactor_timer_fn)(void* user_data);
+
+// Call fn whenever poll reports one of "events" (or an error/hangup) on fd
+bool reactor_add_fd(int fd, short events, reactor_fd_fn fn, void* user_data);
+void reactor_remove_fd(int fd);
+
+// Call fn every interval_us microseconds. Returns a timer id or -1.
+int reactor_add_timer(int64_t interval_us, reactor_timer_fn fn, void* user_data);
+void reactor_remove_timer(int id);
+
+// Wait for the next fd event or timer and dispatch it. If block is
+// false, only handles whatever is ready right now.
+void reactor_run_once(bool block);
+
+// Percent of the time since the last call spent asleep in poll
+int reactor_idle_percent();
@@ -2,11 +2,15 @@
 #include "device.h"
 #include "font.h"
 #include "image.h"
+#include "log.h"
+#include "reactor.h"
 #include "scenic_ops.h"
 #include "script.h"
+#include "shm.h"
 #include "utils.h"
 
 extern device_info_t g_device_info;
+extern device_opts_t g_opts;
 
 inline
 void scenic_ops_put_script(uint32_t* p_msg_length, const driver_data_t* p_data)
@@ -17,6 +21,24 @@ void scenic_ops_put_script(uint32_t* p_msg_length, const driver_data_t* p_data)
   put_script(p_msg_length);
 }
 
+inline
+void scenic_ops_put_script_shm(uint32_t* p_msg_length, const driver_data_t* p_data)
+{
+  if (p_data->debug_mode) {
+    log_info("%s", __func__);
+  }
+  put_script_shm(p_msg_length);
+}
+
+inline
+void scenic_ops_patch_script(uint32_t* p_msg_length, const driver_data_t* p_data)
+{
+  if (p_data->debug_mode) {
+    log_info("%s", __func__);
+  }
+  patch_script(p_msg_length);
+}
+
 inline
 void scenic_ops_del_script(uint32_t* p_msg_length, const driver_data_t* p_data)
 {
@@ -107,6 +129,15 @@ void scenic_ops_put_image(uint32_t* p_msg_length, driver_data_t* p_data)
   put_image(p_msg_length, p_data->v_ctx);
 }
 
+inline
+void scenic_ops_put_image_shm(uint32_t* p_msg_length, driver_data_t* p_data)
+{
+  if (p_data->debug_mode) {
+    log_info("%s(*%d,%p)", __func__, *p_msg_length, p_data->v_ctx);
+  }
+  put_image_shm(p_msg_length, p_data->v_ctx);
+}
+
 inline
 void scenic_ops_screenshot(uint32_t* p_msg_length, driver_data_t* p_data)
 {
@@ -122,7 +153,44 @@ void scenic_ops_crash()
   receive_crash();
 }
 
-void dispatch_scenic_ops(uint32_t msg_length, driver_data_t* p_data)
+//---------------------------------------------------------
+static void scenic_ops_log_level(uint32_t* p_msg_length)
+{
+  uint32_t level;
+  read_bytes_down(&level, sizeof(uint32_t), p_msg_length);
+  log_set_level(level);
+}
+
+static void dispatch_op(uint32_t msg_length, driver_data_t* p_data, bool in_batch);
+
+//---------------------------------------------------------
+// a batch is a count followed by that many length-prefixed messages.
+// They are all applied before the next message is read, so an update
+// that ends with a render is never seen half done.
+static void scenic_ops_batch(uint32_t* p_msg_length, driver_data_t* p_data)
+{
+  uint32_t count;
+  read_bytes_down(&count, sizeof(uint32_t), p_msg_length);
+
+  if (p_data->debug_mode) {
+    log_info("%s count: %d", __func__, count);
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t sub_length;
+    read_bytes_down(&sub_length, sizeof(uint32_t), p_msg_length);
+    if (sub_length < sizeof(uint32_t) || sub_length > *p_msg_length) {
+      log_error("%s bad message length: %d, item %d of %d",
+                __func__, sub_length, i, count);
+      return;
+    }
+    *p_msg_length -= sub_length;
+    dispatch_op(sub_length, p_data, true);
+  }
+}
+
+//---------------------------------------------------------
+static void dispatch_op(uint32_t msg_length, driver_data_t* p_data, bool in_batch)
 {
   scenic_op_t op;
   read_bytes_down(&op, sizeof(uint32_t), &msg_length);
@@ -132,6 +200,12 @@ void dispatch_scenic_ops(uint32_t msg_length, driver_data_t* p_data)
   case scenic_op_put_script:
     scenic_ops_put_script(&msg_length, p_data);
     break;
+  case scenic_op_put_script_shm:
+    scenic_ops_put_script_shm(&msg_length, p_data);
+    break;
+  case scenic_op_patch_script:
+    scenic_ops_patch_script(&msg_length, p_data);
+    break;
   case scenic_op_del_script:
     scenic_ops_del_script(&msg_length, p_data);
     break;
@@ -162,12 +236,25 @@ void dispatch_scenic_ops(uint32_t msg_length, driver_data_t* p_data)
   case scenic_op_put_image:
     scenic_ops_put_image(&msg_length, p_data);
     break;
+  case scenic_op_put_image_shm:
+    scenic_ops_put_image_shm(&msg_length, p_data);
+    break;
   case scenic_op_screenshot:
     scenic_ops_screenshot(&msg_length, p_data);
     break;
   case scenic_op_crash:
     scenic_ops_crash();
     break;
+  case scenic_op_log_level:
+    scenic_ops_log_level(&msg_length);
+    break;
+  case scenic_op_batch:
+    if (in_batch) {
+      log_error("Batches can't be nested");
+      break;
+    }
+    scenic_ops_batch(&msg_length, p_data);
+    break;
   }
 
   // if there are any bytes left to read in the message, need to get rid of them
@@ -176,36 +263,79 @@ void dispatch_scenic_ops(uint32_t msg_length, driver_data_t* p_data)
   {
     log_error("Excess message bytes: %d", msg_length);
     log_error("|      op code: %d", op);
-    void* p = malloc(msg_length);
-    read_bytes_down(p, msg_length, &msg_length);
-    free(p);
+    // the message is already in memory, so just step over them
+    borrow_bytes_down(msg_length, &msg_length);
   }
+}
 
+//---------------------------------------------------------
+void dispatch_scenic_ops(uint32_t msg_length, driver_data_t* p_data)
+{
+  dispatch_op(msg_length, p_data, false);
   check_gl_error();
 }
 
+//---------------------------------------------------------
+// How often, in microseconds, device_poll needs to be called. Devices
+// that get their events some other way don't need it at all.
+__attribute__((weak))
+int64_t device_poll_interval()
+{
+  return 0;
+}
+
+static void on_stdin(int fd, short revents, void* user_data)
+{
+  clear_reader_wake();
+  handle_stdio_in((driver_data_t*)user_data);
+}
+
+static void on_device_poll(void* user_data)
+{
+  device_poll();
+}
+
+static void on_idle_stats(void* user_data)
+{
+  log_info("idle: %d%%", reactor_idle_percent());
+  if (g_opts.optimize_scripts) {
+    log_info("optimized out: %llu of %llu script ops",
+             (unsigned long long)g_optimize_stats.removed,
+             (unsigned long long)g_optimize_stats.ops);
+  }
+}
+
 void* scenic_loop(void* user_data)
 {
   driver_data_t* p_data = (driver_data_t*)user_data;
+
+  int wake_fd = start_reader();
+  if (wake_fd < 0) {
+    return NULL;
+  }
+  reactor_add_fd(wake_fd, POLLIN, on_stdin, p_data);
+  reactor_add_timer(device_poll_interval(), on_device_poll, NULL);
+  if (g_opts.debug_fps > 0) {
+    reactor_add_timer(1000000, on_idle_stats, NULL);
+  }
+
   // signal the app that the window is ready
   send_ready();
 
   /* Loop until the calling app closes the window */
   while (p_data->keep_going && !isCallerDown()) {
-    // check for incoming messages - blocks with a timeout
-    handle_stdio_in(p_data);
-    device_poll();
+    // messages left over from a busy frame won't wake poll again
+    if (has_buffered_input()) {
+      handle_stdio_in(p_data);
+    }
+    reactor_run_once(!has_buffered_input());
+    log_flush();
   }
 
   reset_images(p_data->v_ctx);
+  shm_reset();
 
   device_close(&g_device_info);
 
   return NULL;
 }
-
-__attribute__((weak))
-void scenic_cmd_lock() { }
-
-__attribute__((weak))
-void scenic_cmd_unlock() { }
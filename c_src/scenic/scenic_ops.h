@@ -11,6 +11,10 @@ typedef enum {
   scenic_op_render = 0x06,
   scenic_op_update_cursor = 0x07,
   scenic_op_clear_color = 0x08,
+  scenic_op_put_script_shm = 0x09,
+  scenic_op_patch_script = 0x0B,
+  scenic_op_batch = 0x0C,
+  scenic_op_log_level = 0x0D,
 
   //scenic_op_input = 0x0a,
 
@@ -18,6 +22,7 @@ typedef enum {
 
   scenic_op_put_font = 0x40,
   scenic_op_put_image = 0x41,
+  scenic_op_put_image_shm = 0x42,
 
   scenic_op_screenshot = 0x50,
 
@@ -44,6 +49,8 @@ typedef enum {
 } scenic_op_t;
 
 void scenic_ops_put_script(uint32_t* p_msg_length, const driver_data_t* p_data);
+void scenic_ops_put_script_shm(uint32_t* p_msg_length, const driver_data_t* p_data);
+void scenic_ops_patch_script(uint32_t* p_msg_length, const driver_data_t* p_data);
 void scenic_ops_del_script(uint32_t* p_msg_length, const driver_data_t* p_data);
 void scenic_ops_reset(const driver_data_t* p_data);
 void scenic_ops_global_tx(uint32_t* p_msg_length, driver_data_t* p_data);
@@ -54,11 +61,9 @@ void scenic_ops_clear_color(uint32_t* p_msg_length, const driver_data_t* p_data)
 void scenic_ops_quit(driver_data_t* p_data);
 void scenic_ops_put_font(uint32_t* p_msg_length, driver_data_t* p_data);
 void scenic_ops_put_image(uint32_t* p_msg_length, driver_data_t* p_data);
+void scenic_ops_put_image_shm(uint32_t* p_msg_length, driver_data_t* p_data);
 void scenic_ops_screenshot(uint32_t* p_msg_length, driver_data_t* p_data);
 void scenic_ops_crash();
 
 void dispatch_scenic_ops(uint32_t msg_length, driver_data_t* p_data);
 void* scenic_loop(void* user_data);
-
-void scenic_cmd_lock();
-void scenic_cmd_unlock();
@@ -46,6 +46,8 @@ typedef struct {
   float cursor_tx[6];
   float cursor_pos[2];
   uint32_t f_show_cursor;
+  uint32_t f_skip_clear;    // the frame covers everything it draws over (cairo only)
+  uint32_t f_cursor_only;   // only the cursor moved since the last frame
   int debug_mode;
 } driver_data_t;
 
@@ -71,6 +73,9 @@ typedef struct {
   int resizable;
   char* fbdev;
   char* title;
+  char* capture;
+  int optimize_scripts;
+  int render_threads;
 } device_opts_t;
 
 //---------------------------------------------------------
@@ -4,25 +4,179 @@
 #
 */
 
+#include <math.h>
 #include <string.h>
 
+#include "bands.h"
+#include "bounds.h"
 #include "common.h"
 #include "comms.h"
+#include "damage.h"
+#include "device.h"
 #include "font.h"
+#include "handle.h"
 #include "image.h"
+#include "layer_cache.h"
 #include "script_ops.h"
 #include "script.h"
+#include "shm.h"
 #include "utils.h"
 
 extern device_opts_t g_opts;
+extern device_info_t g_device_info;
 
 //---------------------------------------------------------
+// Scripts arrive as big-endian byte streams. When a script is put, the
+// stream is compiled once into an array of instructions whose arguments
+// are already in host order, so rendering it every frame is a walk down
+// the array calling each instruction's handler. The raw bytes are kept
+// because patches are expressed as offsets into them, and because text
+// is used straight out of them. References to other scripts, images and
+// fonts are interned into handles when the script is compiled.
+//
+// Compiling also works out the bounds of what the script draws itself.
+// The bounds of everything it draws, including the scripts it draws,
+// are put together from those when they are needed, and are used to
+// skip drawing the scripts that would land entirely out of view.
+//
+// Before a frame is drawn, the scene is walked to work out what
+// changed, and to find the opaque rects that hide whatever is drawn
+// under them. The scripts that would be hidden are skipped too.
+//
+// Scripts that have stopped changing, and don't depend on any style
+// they inherit, can be drawn once into a layer and composited from
+// there. See layer_cache.h
+
+typedef union {
+  float f;
+  uint32_t u;
+  color_rgba_t c;
+} word_t;
+
+// What the interpreter knows about where drawing is going to land. It
+// mirrors the transform and the few styles that change how far drawing
+// reaches, and is saved and restored along with the device state.
+typedef struct {
+  affine_t tx;      // script space to device space
+  box_t clip;       // device space
+  float width;      // stroke width
+  float join;       // stroke join factor
+  float size;       // font size
+} view_t;
+
+typedef struct {
+  view_t view;
+  view_t* p_saved;  // grows as needed, never shrinks
+  int depth;
+  int size;
+  box_t viewport;
+  bool culling;
+  bool layering;    // layers can be used
+  bool recording;   // drawing into a layer
+  uint32_t step;    // steps taken so far, as plan_frame counts them
+} view_stack_t;
+
+typedef struct {
+  void* v_ctx;
+  int push_count;
+  int depth;
+  view_stack_t* p_views;
+} render_state_t;
+
+// the deepest nesting of draw_script that is followed
+#define MAX_SCRIPT_DEPTH 256
+
+struct _instr_t;
+typedef void (*op_fn_t)(render_state_t* p_state, const struct _instr_t* p_instr);
+
+typedef struct _instr_t {
+  op_fn_t fn;
+  uint16_t op;
+  uint16_t param;
+  handle_t handle;          // what the op refers to, if anything
+  const word_t* p_args;     // host-order arguments
+  const uint8_t* p_bytes;   // text and ids, in the raw script
+} instr_t;
+
 typedef struct _script_t {
   sid_t id;
+  handle_t handle;
   data_t script;
+  instr_t* p_code;          // instructions, followed by their arguments
+  uint32_t instr_count;
+  uint32_t visit_epoch;     // for walking the script graph
+  bounds_t bounds;          // of what the script draws itself
+  bounds_t tree_bounds;     // including the scripts it draws
+  uint32_t tree_epoch;      // tree_bounds is good while this is current
+  bool leaks;               // changes state it doesn't restore
+  uint32_t inherits;        // STYLE_ bits it uses without setting
+  uint32_t tree_inherits;   // including the scripts it draws
+  uint32_t tree_size;       // instructions, including the scripts it draws
+  uint32_t tree_steps;      // steps drawing it takes, as plan_frame counts them
+  box_t* p_occluders;       // opaque rects it fills, in its own space
+  uint32_t* p_occluder_sites; // and how many sites come before each
+  uint32_t occluder_count;
+  uint32_t tree_stamp;      // changes when anything in the tree does
+  uint32_t stamp_epoch;     // tree_stamp is good while this is current
+  uint32_t layer_stamp;     // the tree_stamp it was last drawn with
+  uint32_t layer_visits;    // draws since the tree last changed
+  layer_key_t layer_key;    // the raster layer it would last have used
+  bool has_media;           // refers to images or fonts
+  box_t landing;            // device space, where it was drawn
+  box_t last_landing;       // and where it was the frame before
+  uint32_t landing_epoch;   // the frame landing is for. 0 if never drawn.
+  uint32_t media_stamp;     // changes when the images or fonts do
+  bool damaged;             // has to be drawn again this frame
+  bool rejected;            // an update to it was refused, so the caller's
+                            // copy differs and patches don't apply to it
   tommy_hashlin_node  node;
 } script_t;
 
+// Every draw_script instruction has a site as its arguments, filled in
+// when the script is measured. It says what is known, from inside the
+// drawing script, about the state the drawn script will start with.
+typedef struct {
+  affine_t tx;              // from the drawing script's space
+  float width;              // NAN when inherited
+  float join;               // NAN when inherited
+  float size;               // NAN when inherited
+  uint32_t styles;          // STYLE_ bits set by then
+  uint32_t flags;
+} site_t;
+
+// the state is restored right after the script is drawn, so whatever
+// it changes doesn't matter
+#define SITE_CONTAINED 0x01
+// the drawing script goes on to use the path, which drawing the
+// script might have changed
+#define SITE_PATH_USED 0x02
+// the drawing script has set a scissor by then
+#define SITE_CLIPPED 0x04
+
+// The styles a script can inherit from whatever draws it. A script
+// that doesn't use any of them before setting them draws the same
+// wherever it is drawn from.
+#define STYLE_FILL          0x0001
+#define STYLE_STROKE        0x0002
+#define STYLE_STROKE_WIDTH  0x0004
+#define STYLE_LINE_CAP      0x0008
+#define STYLE_LINE_JOIN     0x0010
+#define STYLE_MITER_LIMIT   0x0020
+#define STYLE_FONT          0x0040
+#define STYLE_FONT_SIZE     0x0080
+#define STYLE_TEXT_ALIGN    0x0100
+#define STYLE_TEXT_BASE     0x0200
+#define STYLE_COUNT         10
+#define STYLES_ALL          ((1 << STYLE_COUNT) - 1)
+
+#define STYLES_STROKING (STYLE_STROKE | STYLE_STROKE_WIDTH | STYLE_LINE_CAP \
+                         | STYLE_LINE_JOIN | STYLE_MITER_LIMIT)
+#define STYLES_TEXT (STYLE_FILL | STYLE_FONT | STYLE_FONT_SIZE \
+                     | STYLE_TEXT_ALIGN | STYLE_TEXT_BASE)
+
+// the bounds of every script whose tree_epoch isn't this are stale
+static uint32_t bounds_epoch = 1;
+
 
 // #define HASH_ID(id)  tommy_inthash_u32(id)
 #define HASH_ID(id)  tommy_hash_u32( 0, id.p_data, id.size )
@@ -59,6 +213,27 @@ script_t* get_script(sid_t id)
                               HASH_ID(id));
 }
 
+//---------------------------------------------------------
+static void free_script(void* v_script)
+{
+  script_t* p_script = v_script;
+  for (uint32_t i = 0; i < p_script->instr_count; i++) {
+    handle_release(p_script->p_code[i].handle);
+  }
+  free(p_script->p_code);
+  free(p_script->p_occluders);
+  free(p_script);
+}
+
+//---------------------------------------------------------
+// detach a script from its handle
+static void unbind_script(script_t* p_script)
+{
+  handle_slot(p_script->handle)->p_script = NULL;
+  handle_touch(p_script->handle);
+  handle_release(p_script->handle);
+}
+
 //---------------------------------------------------------
 void do_delete_script(sid_t id)
 {
@@ -71,607 +246,2208 @@ void do_delete_script(sid_t id)
 
     tommy_hashlin_remove_existing(&scripts,
                                   &p_script->node);
-    free(p_script);
+    // what it drew has to be drawn over
+    if (p_script->landing_epoch) damage_add(p_script->landing);
+    layer_drop(p_script->handle);
+    unbind_script(p_script);
+    free_script(p_script);
+    bounds_epoch++;
   }
 }
 
-//---------------------------------------------------------
-void put_script(uint32_t* p_msg_length)
+//=============================================================================
+// compiling
+
+int padded_advance(int size)
 {
-  // read in the length of the id, which is in the first four bytes
-  uint32_t id_length;
-  read_bytes_down(&id_length, sizeof(uint32_t), p_msg_length);
+  switch( size % 4 ) {
+    case 0: return size;
+    case 1: return size + 3;
+    case 2: return size + 2;
+    case 3: return size + 1;
+    default: return size;
+  };
+}
 
-  // initialize a record to hold the script
-  int struct_size = ALIGN_UP(sizeof(script_t), 8);
-  int id_size = ALIGN_UP(id_length, 8);
-  int alloc_size = struct_size + id_size + *p_msg_length;
-  script_t *p_script = malloc(alloc_size);
-  if ( !p_script ) {
-    log_error("Unable to allocate script");
-    return;
+//---------------------------------------------------------
+// byte swap a run of big-endian words into host order. Written as a
+// plain loop over independent words so the compiler vectorizes it.
+static void swap_words(word_t* p_dst, const uint8_t* p_src, uint32_t count)
+{
+  for (uint32_t n = 0; n < count; n++) {
+    uint32_t w;
+    memcpy(&w, p_src + n * 4, sizeof(uint32_t));
+    p_dst[n].u = ntoh_ui32(w);
   }
+}
 
-  // initialize the id
-  p_script->id.size = id_length;
-  p_script->id.p_data = ((void*)p_script) + struct_size;
-  read_bytes_down(p_script->id.p_data, id_length, p_msg_length);
+//---------------------------------------------------------
+static inline coordinates_t arg_point(const word_t* p_args, int n)
+{
+  return (coordinates_t){p_args[n].f, p_args[n + 1].f};
+}
 
-  // initialize the data
-  p_script->script.size = *p_msg_length;
-  p_script->script.p_data = ((void*)p_script) + struct_size + id_size;
-  read_bytes_down(p_script->script.p_data, *p_msg_length, p_msg_length);
+static inline image_t* instr_image(const instr_t* p_instr)
+{
+  return handle_slot(p_instr->handle)->p_image;
+}
 
-  // if there is already is a script with the same id, delete it
-  do_delete_script(p_script->id);
+//---------------------------------------------------------
+// instruction handlers
 
-  if (g_opts.debug_mode) {
-    log_debug("%s id:'%.*s'", __func__,
-              p_script->id.size, p_script->id.p_data);
+static void op_draw_line(render_state_t* p_state, const instr_t* p_instr)
+{
+  const word_t* a = p_instr->p_args;
+  script_ops_draw_line(p_state->v_ctx, arg_point(a, 0), arg_point(a, 2),
+                       (p_instr->param & FLAG_STROKE));
+}
+
+static void op_draw_triangle(render_state_t* p_state, const instr_t* p_instr)
+{
+  const word_t* a = p_instr->p_args;
+  script_ops_draw_triangle(p_state->v_ctx,
+                           arg_point(a, 0), arg_point(a, 2), arg_point(a, 4),
+                           (p_instr->param & FLAG_FILL), (p_instr->param & FLAG_STROKE));
+}
+
+static void op_draw_quad(render_state_t* p_state, const instr_t* p_instr)
+{
+  const word_t* a = p_instr->p_args;
+  script_ops_draw_quad(p_state->v_ctx,
+                       arg_point(a, 0), arg_point(a, 2), arg_point(a, 4), arg_point(a, 6),
+                       (p_instr->param & FLAG_FILL), (p_instr->param & FLAG_STROKE));
+}
+
+static void op_draw_rect(render_state_t* p_state, const instr_t* p_instr)
+{
+  const word_t* a = p_instr->p_args;
+  script_ops_draw_rect(p_state->v_ctx, a[0].f, a[1].f,
+                       (p_instr->param & FLAG_FILL), (p_instr->param & FLAG_STROKE));
+}
+
+static void op_draw_rrect(render_state_t* p_state, const instr_t* p_instr)
+{
+  const word_t* a = p_instr->p_args;
+  script_ops_draw_rrect(p_state->v_ctx, a[0].f, a[1].f, a[2].f,
+                        (p_instr->param & FLAG_FILL), (p_instr->param & FLAG_STROKE));
+}
+
+static void op_draw_rrectv(render_state_t* p_state, const instr_t* p_instr)
+{
+  const word_t* a = p_instr->p_args;
+  script_ops_draw_rrectv(p_state->v_ctx, a[0].f, a[1].f, a[2].f, a[3].f, a[4].f, a[5].f,
+                         (p_instr->param & FLAG_FILL), (p_instr->param & FLAG_STROKE));
+}
+
+static void op_draw_arc(render_state_t* p_state, const instr_t* p_instr)
+{
+  const word_t* a = p_instr->p_args;
+  script_ops_draw_arc(p_state->v_ctx, a[0].f, a[1].f,
+                      (p_instr->param & FLAG_FILL), (p_instr->param & FLAG_STROKE));
+}
+
+static void op_draw_sector(render_state_t* p_state, const instr_t* p_instr)
+{
+  const word_t* a = p_instr->p_args;
+  script_ops_draw_sector(p_state->v_ctx, a[0].f, a[1].f,
+                         (p_instr->param & FLAG_FILL), (p_instr->param & FLAG_STROKE));
+}
+
+static void op_draw_circle(render_state_t* p_state, const instr_t* p_instr)
+{
+  script_ops_draw_circle(p_state->v_ctx, p_instr->p_args[0].f,
+                         (p_instr->param & FLAG_FILL), (p_instr->param & FLAG_STROKE));
+}
+
+static void op_draw_ellipse(render_state_t* p_state, const instr_t* p_instr)
+{
+  const word_t* a = p_instr->p_args;
+  script_ops_draw_ellipse(p_state->v_ctx, a[0].f, a[1].f,
+                          (p_instr->param & FLAG_FILL), (p_instr->param & FLAG_STROKE));
+}
+
+static void op_draw_text(render_state_t* p_state, const instr_t* p_instr)
+{
+  script_ops_draw_text(p_state->v_ctx, p_instr->param, (const char*)p_instr->p_bytes);
+}
+
+static void op_draw_sprites(render_state_t* p_state, const instr_t* p_instr)
+{
+  image_t* p_image = instr_image(p_instr);
+  if (!p_image) return;
+
+  // the count is followed by the sprites, already laid out as sprite_t
+  script_ops_draw_sprites(p_state->v_ctx, p_image, p_instr->p_args[0].u,
+                          (const sprite_t*)(p_instr->p_args + 1));
+}
+
+static void run_script(render_state_t* p_parent, script_t* p_script);
+static bool out_of_view(const view_stack_t* p_views, const site_t* p_site,
+                        script_t* p_script);
+static bool occluded(const view_stack_t* p_views, const site_t* p_site,
+                     script_t* p_script, uint32_t after);
+static bool draw_layer(render_state_t* p_state, const site_t* p_site,
+                       script_t* p_script);
+
+static void op_draw_script(render_state_t* p_state, const instr_t* p_instr)
+{
+  script_t* p_script = handle_slot(p_instr->handle)->p_script;
+  if (!p_script) return;
+
+  // cycles are refused when scripts are put, so this only stops
+  // absurdly deep graphs from running off the end of the stack
+  if (p_state->depth >= MAX_SCRIPT_DEPTH) return;
+
+  // going in and coming back out are a step each
+  view_stack_t* p_views = p_state->p_views;
+  uint32_t after = p_views->step + p_script->tree_steps + 2;
+  p_views->step++;
+
+  if (out_of_view(p_views, (const site_t*)p_instr->p_args, p_script)) {
+    if (g_opts.debug_mode) {
+      log_debug("%s culled id: '%.*s'", __func__,
+                p_script->id.size, p_script->id.p_data);
+    }
+  } else if (occluded(p_views, (const site_t*)p_instr->p_args, p_script, after)) {
+    if (g_opts.debug_mode) {
+      log_debug("%s occluded id: '%.*s'", __func__,
+                p_script->id.size, p_script->id.p_data);
+    }
+  } else if (draw_layer(p_state, (const site_t*)p_instr->p_args, p_script)) {
+    if (g_opts.debug_mode) {
+      log_debug("%s layer id: '%.*s'", __func__,
+                p_script->id.size, p_script->id.p_data);
+    }
+  } else {
+    if (g_opts.debug_mode) {
+      log_debug("%s id: '%.*s'", __func__,
+                p_script->id.size, p_script->id.p_data);
+    }
+    run_script(p_state, p_script);
   }
 
-  // insert the script into the tommy hash
-  tommy_hashlin_insert(&scripts,
-                       &p_script->node,
-                       p_script,
-                       HASH_ID(p_script->id));
+  p_views->step = after;
 }
 
-//---------------------------------------------------------
-void delete_script(uint32_t* p_msg_length)
+static void op_begin_path(render_state_t* p_state, const instr_t* p_instr)
 {
-  sid_t id;
+  script_ops_begin_path(p_state->v_ctx);
+}
 
-  // read in the length of the id, which is in the first four bytes
-  read_bytes_down(&id.size, sizeof(uint32_t), p_msg_length);
+static void op_close_path(render_state_t* p_state, const instr_t* p_instr)
+{
+  script_ops_close_path(p_state->v_ctx);
+}
 
-  // create a temporary buffer and read the id into it
-  id.p_data = malloc(id.size);
-  if (!id.p_data) {
-    log_error("Unable to allocate buffer for the id");
-    return;
+static void op_fill_path(render_state_t* p_state, const instr_t* p_instr)
+{
+  script_ops_fill_path(p_state->v_ctx);
+}
+
+static void op_stroke_path(render_state_t* p_state, const instr_t* p_instr)
+{
+  script_ops_stroke_path(p_state->v_ctx);
+}
+
+static void op_move_to(render_state_t* p_state, const instr_t* p_instr)
+{
+  script_ops_move_to(p_state->v_ctx, arg_point(p_instr->p_args, 0));
+}
+
+static void op_line_to(render_state_t* p_state, const instr_t* p_instr)
+{
+  script_ops_line_to(p_state->v_ctx, arg_point(p_instr->p_args, 0));
+}
+
+static void op_arc_to(render_state_t* p_state, const instr_t* p_instr)
+{
+  const word_t* a = p_instr->p_args;
+  script_ops_arc_to(p_state->v_ctx, arg_point(a, 0), arg_point(a, 2), a[4].f);
+}
+
+static void op_bezier_to(render_state_t* p_state, const instr_t* p_instr)
+{
+  const word_t* a = p_instr->p_args;
+  script_ops_bezier_to(p_state->v_ctx, arg_point(a, 0), arg_point(a, 2), arg_point(a, 4));
+}
+
+static void op_quadratic_to(render_state_t* p_state, const instr_t* p_instr)
+{
+  const word_t* a = p_instr->p_args;
+  script_ops_quadratic_to(p_state->v_ctx, arg_point(a, 0), arg_point(a, 2));
+}
+
+static void op_arc(render_state_t* p_state, const instr_t* p_instr)
+{
+  const word_t* a = p_instr->p_args;
+  script_ops_arc(p_state->v_ctx, arg_point(a, 0), a[2].f, a[3].f, a[4].f,
+                 (sweep_dir_t)a[5].u);
+}
+
+static void push_view(view_stack_t* p_views);
+static void pop_view(view_stack_t* p_views);
+
+static void op_pop_state(render_state_t* p_state, const instr_t* p_instr)
+{
+  if (p_state->push_count > 0) {
+    p_state->push_count--;
+    pop_view(p_state->p_views);
+    script_ops_pop_state(p_state->v_ctx);
   }
+}
 
-  // read in the body of the id
-  read_bytes_down(id.p_data, id.size, p_msg_length);
+static void op_push_state(render_state_t* p_state, const instr_t* p_instr)
+{
+  p_state->push_count++;
+  push_view(p_state->p_views);
+  script_ops_push_state(p_state->v_ctx);
+}
 
-  // delete and free
-  do_delete_script(id);
+static void op_pop_push_state(render_state_t* p_state, const instr_t* p_instr)
+{
+  op_pop_state(p_state, p_instr);
+  op_push_state(p_state, p_instr);
+}
 
-  free(id.p_data);
+static void op_scissor(render_state_t* p_state, const instr_t* p_instr)
+{
+  const word_t* a = p_instr->p_args;
+  view_stack_t* p_views = p_state->p_views;
+  // some devices intersect the clip and some replace it. Replacing it
+  // here is right for both, as it can only make it bigger.
+  p_views->view.clip = box_intersect(p_views->viewport,
+                                     box_transform(p_views->view.tx,
+                                                   box_from_corners(0, 0, a[0].f, a[1].f)));
+  script_ops_scissor(p_state->v_ctx, a[0].f, a[1].f);
 }
 
-//---------------------------------------------------------
-void reset_scripts() {
-  // deallocates all the objects iterating the hashtable
-  tommy_hashlin_foreach( &scripts, free );
+static void op_transform(render_state_t* p_state, const instr_t* p_instr)
+{
+  const word_t* a = p_instr->p_args;
+  view_t* p_view = &p_state->p_views->view;
+  p_view->tx = affine_multiply(p_view->tx, (affine_t){a[0].f, a[1].f, a[2].f,
+                                                      a[3].f, a[4].f, a[5].f});
+  script_ops_transform(p_state->v_ctx, a[0].f, a[1].f, a[2].f, a[3].f, a[4].f, a[5].f);
+}
 
-  // deallocates the hashtable
-  tommy_hashlin_done( &scripts );
+static void op_scale(render_state_t* p_state, const instr_t* p_instr)
+{
+  const word_t* a = p_instr->p_args;
+  view_t* p_view = &p_state->p_views->view;
+  p_view->tx = affine_scale(p_view->tx, a[0].f, a[1].f);
+  script_ops_scale(p_state->v_ctx, a[0].f, a[1].f);
+}
 
-  // re-init the hash table
-  tommy_hashlin_init( &scripts );
+static void op_rotate(render_state_t* p_state, const instr_t* p_instr)
+{
+  view_t* p_view = &p_state->p_views->view;
+  p_view->tx = affine_rotate(p_view->tx, p_instr->p_args[0].f);
+  script_ops_rotate(p_state->v_ctx, p_instr->p_args[0].f);
 }
 
+static void op_translate(render_state_t* p_state, const instr_t* p_instr)
+{
+  const word_t* a = p_instr->p_args;
+  view_t* p_view = &p_state->p_views->view;
+  p_view->tx = affine_translate(p_view->tx, a[0].f, a[1].f);
+  script_ops_translate(p_state->v_ctx, a[0].f, a[1].f);
+}
 
-//=============================================================================
-// rendering
+static void op_fill_color(render_state_t* p_state, const instr_t* p_instr)
+{
+  script_ops_fill_color(p_state->v_ctx, p_instr->p_args[0].c);
+}
 
-static inline uint8_t get_byte(void* p, uint32_t offset)
+static void op_fill_linear(render_state_t* p_state, const instr_t* p_instr)
 {
-  return *((uint8_t*)(p + offset));
+  const word_t* a = p_instr->p_args;
+  script_ops_fill_linear(p_state->v_ctx, arg_point(a, 0), arg_point(a, 2), a[4].c, a[5].c);
 }
 
-static inline uint16_t get_uint16(void* p, uint32_t offset)
+static void op_fill_radial(render_state_t* p_state, const instr_t* p_instr)
 {
-  return ntoh_ui16(*((uint16_t*)(p + offset)));
+  const word_t* a = p_instr->p_args;
+  script_ops_fill_radial(p_state->v_ctx, arg_point(a, 0), a[2].f, a[3].f, a[4].c, a[5].c);
 }
 
-static inline uint32_t get_uint32(void* p, uint32_t offset)
+static void op_fill_image(render_state_t* p_state, const instr_t* p_instr)
 {
-  return ntoh_ui32(*((uint32_t*)(p + offset)));
+  image_t* p_image = instr_image(p_instr);
+  if (p_image) script_ops_fill_image(p_state->v_ctx, p_image);
 }
 
-static inline float get_float(void* p, uint32_t offset)
+static void op_fill_stream(render_state_t* p_state, const instr_t* p_instr)
 {
-  return ntoh_f32(*((float*)(p + offset)));
+  image_t* p_image = instr_image(p_instr);
+  if (p_image) script_ops_fill_stream(p_state->v_ctx, p_image);
 }
 
+static void op_stroke_width(render_state_t* p_state, const instr_t* p_instr)
+{
+  p_state->p_views->view.width = p_instr->param / 4.0;
+  script_ops_stroke_width(p_state->v_ctx, p_instr->param / 4.0);
+}
 
-int padded_advance(int size)
+static void op_stroke_color(render_state_t* p_state, const instr_t* p_instr)
 {
-  switch( size % 4 ) {
-    case 0: return size;
-    case 1: return size + 3;
-    case 2: return size + 2;
-    case 3: return size + 1;
-    default: return size;
-  };
+  script_ops_stroke_color(p_state->v_ctx, p_instr->p_args[0].c);
+}
+
+static void op_stroke_linear(render_state_t* p_state, const instr_t* p_instr)
+{
+  const word_t* a = p_instr->p_args;
+  script_ops_stroke_linear(p_state->v_ctx, arg_point(a, 0), arg_point(a, 2), a[4].c, a[5].c);
 }
 
+static void op_stroke_radial(render_state_t* p_state, const instr_t* p_instr)
+{
+  const word_t* a = p_instr->p_args;
+  script_ops_stroke_radial(p_state->v_ctx, arg_point(a, 0), a[2].f, a[3].f, a[4].c, a[5].c);
+}
+
+static void op_stroke_image(render_state_t* p_state, const instr_t* p_instr)
+{
+  image_t* p_image = instr_image(p_instr);
+  if (p_image) script_ops_stroke_image(p_state->v_ctx, p_image);
+}
+
+static void op_stroke_stream(render_state_t* p_state, const instr_t* p_instr)
+{
+  image_t* p_image = instr_image(p_instr);
+  if (p_image) script_ops_stroke_stream(p_state->v_ctx, p_image);
+}
+
+static void op_line_cap(render_state_t* p_state, const instr_t* p_instr)
+{
+  script_ops_line_cap(p_state->v_ctx, (line_cap_t)p_instr->param);
+}
+
+static void op_line_join(render_state_t* p_state, const instr_t* p_instr)
+{
+  script_ops_line_join(p_state->v_ctx, (line_join_t)p_instr->param);
+}
+
+static void op_miter_limit(render_state_t* p_state, const instr_t* p_instr)
+{
+  p_state->p_views->view.join = join_factor(p_instr->param);
+  script_ops_miter_limit(p_state->v_ctx, p_instr->param);
+}
+
+static void op_font(render_state_t* p_state, const instr_t* p_instr)
+{
+  font_t* p_font = handle_slot(p_instr->handle)->p_font;
+  if (p_font) script_ops_font(p_state->v_ctx, p_font);
+}
+
+static void op_font_size(render_state_t* p_state, const instr_t* p_instr)
+{
+  p_state->p_views->view.size = p_instr->param / 4.0;
+  script_ops_font_size(p_state->v_ctx, p_instr->param / 4.0);
+}
+
+static void op_text_align(render_state_t* p_state, const instr_t* p_instr)
+{
+  script_ops_text_align(p_state->v_ctx, (text_align_t)p_instr->param);
+}
+
+static void op_text_base(render_state_t* p_state, const instr_t* p_instr)
+{
+  script_ops_text_base(p_state->v_ctx, (text_base_t)p_instr->param);
+}
+
+//---------------------------------------------------------
+// How each op is compiled. Fixed arguments are "swap" big-endian words
+// that are byte swapped, followed by "raw" words (colors) that are
+// copied as they are. Ops that carry text or an id have "bytes" set and
+// are followed by param bytes, padded to a word. Ops that name another
+// script, image or font have "ref" set.
+typedef struct {
+  op_fn_t fn;
+  uint8_t swap;
+  uint8_t raw;
+  bool bytes;
+  bool ref;
+} op_info_t;
+
+static const op_info_t op_info[256] = {
+  [SCRIPT_OP_DRAW_LINE] = {op_draw_line, 4, 0, false, false},
+  [SCRIPT_OP_DRAW_TRIANGLE] = {op_draw_triangle, 6, 0, false, false},
+  [SCRIPT_OP_DRAW_QUAD] = {op_draw_quad, 8, 0, false, false},
+  [SCRIPT_OP_DRAW_RECT] = {op_draw_rect, 2, 0, false, false},
+  [SCRIPT_OP_DRAW_RRECT] = {op_draw_rrect, 3, 0, false, false},
+  [SCRIPT_OP_DRAW_RRECTV] = {op_draw_rrectv, 6, 0, false, false},
+  [SCRIPT_OP_DRAW_ARC] = {op_draw_arc, 2, 0, false, false},
+  [SCRIPT_OP_DRAW_SECTOR] = {op_draw_sector, 2, 0, false, false},
+  [SCRIPT_OP_DRAW_CIRCLE] = {op_draw_circle, 1, 0, false, false},
+  [SCRIPT_OP_DRAW_ELLIPSE] = {op_draw_ellipse, 2, 0, false, false},
+  [SCRIPT_OP_DRAW_TEXT] = {op_draw_text, 0, 0, true, false},
+  [SCRIPT_OP_DRAW_SPRITES] = {op_draw_sprites, 0, 0, true, true},
+  [SCRIPT_OP_DRAW_SCRIPT] = {op_draw_script, 0, 0, true, true},
+
+  [SCRIPT_OP_BEGIN_PATH] = {op_begin_path, 0, 0, false, false},
+  [SCRIPT_OP_CLOSE_PATH] = {op_close_path, 0, 0, false, false},
+  [SCRIPT_OP_FILL_PATH] = {op_fill_path, 0, 0, false, false},
+  [SCRIPT_OP_STROKE_PATH] = {op_stroke_path, 0, 0, false, false},
+  [SCRIPT_OP_MOVE_TO] = {op_move_to, 2, 0, false, false},
+  [SCRIPT_OP_LINE_TO] = {op_line_to, 2, 0, false, false},
+  [SCRIPT_OP_ARC_TO] = {op_arc_to, 5, 0, false, false},
+  [SCRIPT_OP_BEZIER_TO] = {op_bezier_to, 6, 0, false, false},
+  [SCRIPT_OP_QUADRATIC_TO] = {op_quadratic_to, 4, 0, false, false},
+  [SCRIPT_OP_ARC] = {op_arc, 6, 0, false, false},
+
+  [SCRIPT_OP_PUSH_STATE] = {op_push_state, 0, 0, false, false},
+  [SCRIPT_OP_POP_STATE] = {op_pop_state, 0, 0, false, false},
+  [SCRIPT_OP_POP_PUSH_STATE] = {op_pop_push_state, 0, 0, false, false},
+  [SCRIPT_OP_SCISSOR] = {op_scissor, 2, 0, false, false},
+
+  [SCRIPT_OP_TRANSFORM] = {op_transform, 6, 0, false, false},
+  [SCRIPT_OP_SCALE] = {op_scale, 2, 0, false, false},
+  [SCRIPT_OP_ROTATE] = {op_rotate, 1, 0, false, false},
+  [SCRIPT_OP_TRANSLATE] = {op_translate, 2, 0, false, false},
+
+  [SCRIPT_OP_FILL_COLOR] = {op_fill_color, 0, 1, false, false},
+  [SCRIPT_OP_FILL_LINEAR] = {op_fill_linear, 4, 2, false, false},
+  [SCRIPT_OP_FILL_RADIAL] = {op_fill_radial, 4, 2, false, false},
+  [SCRIPT_OP_FILL_IMAGE] = {op_fill_image, 0, 0, true, true},
+  [SCRIPT_OP_FILL_STREAM] = {op_fill_stream, 0, 0, true, true},
+
+  [SCRIPT_OP_STROKE_WIDTH] = {op_stroke_width, 0, 0, false, false},
+  [SCRIPT_OP_STROKE_COLOR] = {op_stroke_color, 0, 1, false, false},
+  [SCRIPT_OP_STROKE_LINEAR] = {op_stroke_linear, 4, 2, false, false},
+  [SCRIPT_OP_STROKE_RADIAL] = {op_stroke_radial, 4, 2, false, false},
+  [SCRIPT_OP_STROKE_IMAGE] = {op_stroke_image, 0, 0, true, true},
+  [SCRIPT_OP_STROKE_STREAM] = {op_stroke_stream, 0, 0, true, true},
+
+  [SCRIPT_OP_LINE_CAP] = {op_line_cap, 0, 0, false, false},
+  [SCRIPT_OP_LINE_JOIN] = {op_line_join, 0, 0, false, false},
+  [SCRIPT_OP_MITER_LIMIT] = {op_miter_limit, 0, 0, false, false},
+
+  [SCRIPT_OP_FONT] = {op_font, 0, 0, true, true},
+  [SCRIPT_OP_FONT_SIZE] = {op_font_size, 0, 0, false, false},
+  [SCRIPT_OP_TEXT_ALIGN] = {op_text_align, 0, 0, false, false},
+  [SCRIPT_OP_TEXT_BASE] = {op_text_base, 0, 0, false, false},
+};
+
+// words in a sprite_t
+#define SPRITE_WORDS (sizeof(sprite_t) / sizeof(word_t))
+// words in a site_t
+#define SITE_WORDS (sizeof(site_t) / sizeof(word_t))
+
 //---------------------------------------------------------
-void render_script(void* v_ctx, sid_t id)
+// check the parts of an op that the handlers trust
+static const char* check_op(uint16_t op, uint16_t param,
+                            const uint8_t* p_args)
 {
-  // get the script
-  script_t* p_script = get_script(id);
-  if ( !p_script ) {
-    return;
+  switch (op) {
+  case SCRIPT_OP_LINE_CAP:
+    return (param > LINE_CAP_SQUARE) ? "invalid line cap" : NULL;
+  case SCRIPT_OP_LINE_JOIN:
+    return (param > LINE_JOIN_MITER) ? "invalid line join" : NULL;
+  case SCRIPT_OP_TEXT_ALIGN:
+    return (param > TEXT_ALIGN_RIGHT) ? "invalid text align" : NULL;
+  case SCRIPT_OP_TEXT_BASE:
+    return (param > TEXT_BASE_BOTTOM) ? "invalid text base" : NULL;
+  case SCRIPT_OP_ARC:
+    {
+      uint32_t sweep_dir;
+      memcpy(&sweep_dir, p_args + 20, sizeof(uint32_t));
+      sweep_dir = ntoh_ui32(sweep_dir);
+      if (sweep_dir != SWEEP_DIR_CCW && sweep_dir != SWEEP_DIR_CW)
+        return "invalid sweep direction";
+    }
+    return NULL;
+  case SCRIPT_OP_DRAW_SCRIPT:
+  case SCRIPT_OP_DRAW_SPRITES:
+  case SCRIPT_OP_FILL_IMAGE:
+  case SCRIPT_OP_FILL_STREAM:
+  case SCRIPT_OP_STROKE_IMAGE:
+  case SCRIPT_OP_STROKE_STREAM:
+  case SCRIPT_OP_FONT:
+    return (param == 0) ? "empty id" : NULL;
+  default:
+    return NULL;
   }
+}
 
-  // track the state pushes
-  int push_count = 0;
+//---------------------------------------------------------
+// Walk the raw script. With p_code NULL this validates it and counts
+// the instructions and argument words needed, otherwise it fills them
+// in. Returns NULL if the script is good, or a description of the
+// first problem, and where it is, if not.
+#define WALK_FAIL(msg) do { *p_offset = op_start; return (msg); } while (0)
+
+static const char* walk_script(const script_t* p_script,
+                               uint32_t* p_instr_count, uint32_t* p_word_count,
+                               uint32_t* p_offset,
+                               instr_t* p_code, word_t* p_words)
+{
+  const uint8_t* p = p_script->script.p_data;
+  uint32_t size = p_script->script.size;
+  uint32_t i = 0;
+  uint32_t instr_count = 0;
+  uint32_t word_count = 0;
 
-  // setup
-  void* p = p_script->script.p_data;
-  int i = 0;
+  while (i < size) {
+    uint32_t op_start = i;
+    if (size - i < 4) WALK_FAIL("trailing bytes");
 
-  while (i < p_script->script.size) {
-    script_op_t op = (script_op_t)get_uint16(p, i);
-    uint16_t param = get_uint16(p, i + 2);
+    uint16_t op;
+    uint16_t param;
+    memcpy(&op, p + i, sizeof(uint16_t));
+    memcpy(&param, p + i + 2, sizeof(uint16_t));
+    op = ntoh_ui16(op);
+    param = ntoh_ui16(param);
     i += 4;
 
-    switch(op) {
-      case SCRIPT_OP_DRAW_LINE:
-        {
-          coordinates_t a = {get_float(p, i), get_float(p, i + 4)};
-          coordinates_t b = {get_float(p, i + 8), get_float(p, i + 12)};
-          script_ops_draw_line(v_ctx, a, b, (param & FLAG_STROKE));
-        }
-        i += 16;
-        break;
-      case SCRIPT_OP_DRAW_TRIANGLE:
-        {
-          coordinates_t a = {get_float(p, i), get_float(p, i + 4)};
-          coordinates_t b = {get_float(p, i + 8), get_float(p, i + 12)};
-          coordinates_t c = {get_float(p, i + 16), get_float(p, i + 20)};
-          script_ops_draw_triangle(v_ctx, a, b, c, (param & FLAG_FILL), (param & FLAG_STROKE));
-        }
-        i += 24;
-        break;
-      case SCRIPT_OP_DRAW_QUAD:
-        {
-          coordinates_t a = {get_float(p, i), get_float(p, i + 4)};
-          coordinates_t b = {get_float(p, i + 8), get_float(p, i + 12)};
-          coordinates_t c = {get_float(p, i + 16), get_float(p, i + 20)};
-          coordinates_t d = {get_float(p, i + 24), get_float(p, i + 28)};
-          script_ops_draw_quad(v_ctx, a, b, c, d, (param & FLAG_FILL), (param & FLAG_STROKE));
-        }
-        i += 32;
-        break;
-      case SCRIPT_OP_DRAW_RECT:
-        {
-          float w = get_float(p, i);
-          float h = get_float(p, i + 4);
-          script_ops_draw_rect(v_ctx, w, h, (param & FLAG_FILL), (param & FLAG_STROKE));
-        }
-        i += 8;
-        break;
-      case SCRIPT_OP_DRAW_RRECT:
-        {
-          float w = get_float(p, i);
-          float h = get_float(p, i + 4);
-          float radius = get_float(p, i + 8);
-          script_ops_draw_rrect(v_ctx, w, h, radius, (param & FLAG_FILL), (param & FLAG_STROKE));
-        }
-        i += 12;
-        break;
-      case SCRIPT_OP_DRAW_RRECTV:
-        {
-          float w = get_float(p, i);
-          float h = get_float(p, i + 4);
-          float ulr = get_float(p, i + 8);
-          float urr = get_float(p, i + 12);
-          float lrr = get_float(p, i + 16);
-          float llr = get_float(p, i + 20);
-          script_ops_draw_rrectv(v_ctx, w, h, ulr, urr, lrr, llr, (param & FLAG_FILL), (param & FLAG_STROKE));
-        }
-        i += 24;
-        break;
-      case SCRIPT_OP_DRAW_ARC:
-        {
-          float radius = get_float(p, i);
-          float radians = get_float(p, i + 4);
-          script_ops_draw_arc(v_ctx, radius, radians, (param & FLAG_FILL), (param & FLAG_STROKE));
-        }
-        i += 8;
-        break;
-      case SCRIPT_OP_DRAW_SECTOR:
-        {
-          float radius = get_float(p, i);
-          float radians = get_float(p, i + 4);
-          script_ops_draw_sector(v_ctx, radius, radians, (param & FLAG_FILL), (param & FLAG_STROKE));
-        }
-        i += 8;
-        break;
-      case SCRIPT_OP_DRAW_CIRCLE:
-        {
-          float radius = get_float(p, i);
-          script_ops_draw_circle(v_ctx, radius, (param & FLAG_FILL), (param & FLAG_STROKE));
-        }
-        i += 4;
-        break;
-      case SCRIPT_OP_DRAW_ELLIPSE:
-        {
-          float radius0 = get_float(p, i);
-          float radius1 = get_float(p, i + 4);
-          script_ops_draw_ellipse(v_ctx, radius0, radius1, (param & FLAG_FILL), (param & FLAG_STROKE));
-        }
-        i += 8;
-        break;
-      case SCRIPT_OP_DRAW_TEXT:
-        {
-          uint32_t size = param;
-          const char* text = p + i;
-          script_ops_draw_text(v_ctx, size, text);
-        }
-        i += padded_advance( param );
-        break;
-      case SCRIPT_OP_DRAW_SPRITES:
-        {
-          uint32_t count = get_uint32(p, i);
-          sprite_t* sprites = malloc(count * sizeof(sprite_t));
-
-          i += sizeof(uint32_t);
-
-          // get the id
-          sid_t id;
-          id.size = param;
-          id.p_data = p + i;
-          i += padded_advance(param);
-
-          // loop the draw commands and draw each
-          for (int n = 0; n < count; n++) {
-            sprites[n] = (sprite_t){
-              .sx = get_float(p, i),
-              .sy = get_float(p, i + 4),
-              .sw = get_float(p, i + 8),
-              .sh = get_float(p, i + 12),
-              .dx = get_float(p, i + 16),
-              .dy = get_float(p, i + 20),
-              .dw = get_float(p, i + 24),
-              .dh = get_float(p, i + 28),
-              .alpha = get_float( p, i + 32 )
-            };
-
-            i += 36;
-          }
-          script_ops_draw_sprites(v_ctx, id, count, sprites);
-          free(sprites);
-        }
-        break;
-      case SCRIPT_OP_DRAW_SCRIPT:
-        // we can reuse the passed in id struct
-        id.size = param;
-        id.p_data = p + i;
-        script_ops_draw_script(v_ctx, id);
-        i += padded_advance(param);
-        break;
-      case SCRIPT_OP_BEGIN_PATH:
-        script_ops_begin_path(v_ctx);
-        break;
-      case SCRIPT_OP_CLOSE_PATH:
-        script_ops_close_path(v_ctx);
-        break;
-      case SCRIPT_OP_FILL_PATH:
-        script_ops_fill_path(v_ctx);
-        break;
-      case SCRIPT_OP_STROKE_PATH:
-        script_ops_stroke_path(v_ctx);
-        break;
-      case SCRIPT_OP_MOVE_TO:
-        {
-          coordinates_t a = {get_float(p, i), get_float(p, i + 4)};
-          script_ops_move_to(v_ctx, a);
-        }
-        i += 8;
-        break;
-      case SCRIPT_OP_LINE_TO:
-        {
-          coordinates_t a = {get_float(p, i), get_float(p, i + 4)};
-          script_ops_line_to(v_ctx, a);
-        }
-        i += 8;
-        break;
-      case SCRIPT_OP_ARC_TO:
-        {
-          coordinates_t a = {get_float(p, i), get_float(p, i + 4)};
-          coordinates_t b = {get_float(p, i + 8), get_float(p, i + 12)};
-          float radius = get_float(p, i + 16);
-          script_ops_arc_to(v_ctx, a, b, radius);
-        }
-        i += 20;
-        break;
-      case SCRIPT_OP_BEZIER_TO:
-        {
-          coordinates_t c0 = {get_float(p, i), get_float(p, i + 4)};
-          coordinates_t c1 = {get_float(p, i + 8), get_float(p, i + 12)};
-          coordinates_t a = {get_float(p, i + 16), get_float(p, i + 20)};
-          script_ops_bezier_to(v_ctx, c0, c1, a);
-        }
-        i += 24;
-        break;
-      case SCRIPT_OP_QUADRATIC_TO:
-        {
-          coordinates_t c = {get_float(p, i), get_float(p, i + 4)};
-          coordinates_t a = {get_float(p, i + 8), get_float(p, i + 12)};
-          script_ops_quadratic_to(v_ctx, c, a);
-        }
-        i += 16;
-        break;
-      case SCRIPT_OP_ARC:
-        {
-          coordinates_t c = {get_float(p, i), get_float(p, i + 4)};
-          float radius = get_float(p, i + 8);
-          float a0 = get_float(p, i + 12);
-          float a1 = get_float(p, i + 16);
-          sweep_dir_t sweep_dir = get_uint32(p, i + 20);
-          script_ops_arc(v_ctx, c, radius, a0, a1, sweep_dir);
-        }
-        i += 24;
-        break;
-      case SCRIPT_OP_POP_STATE:
-        if (push_count > 0) {
-          push_count--;
-          script_ops_pop_state(v_ctx);
-        }
-        break;
-      case SCRIPT_OP_POP_PUSH_STATE:
-        if (push_count > 0) {
-          push_count--;
-          script_ops_pop_state(v_ctx);
-        }
-        // [[fallthrough]];
-      case SCRIPT_OP_PUSH_STATE:
-        push_count++;
-        script_ops_push_state(v_ctx);
-        break;
+    const op_info_t* p_info = (op < 256) ? &op_info[op] : NULL;
+    if (!p_info || !p_info->fn) WALK_FAIL("unknown op");
 
-      // case 0x43:        // clear
-      case SCRIPT_OP_SCISSOR:
-        {
-          float w = get_float(p, i);
-          float h = get_float(p, i + 4);
-          script_ops_scissor(v_ctx, w, h);
-        }
-        i += 8;
-        break;
+    uint32_t words = p_info->swap + p_info->raw;
+    uint32_t sprite_count = 0;
+    if (op == SCRIPT_OP_DRAW_SPRITES) {
+      if (size - i < 4) WALK_FAIL("truncated op");
+      memcpy(&sprite_count, p + i, sizeof(uint32_t));
+      sprite_count = ntoh_ui32(sprite_count);
+      i += 4;
+      if (sprite_count > (size - i) / sizeof(sprite_t)) WALK_FAIL("truncated op");
+      words = 1 + sprite_count * SPRITE_WORDS;
+    }
 
-      case SCRIPT_OP_TRANSFORM:
-        {
-          float a = get_float(p, i);
-          float b = get_float(p, i + 4);
-          float c = get_float(p, i + 8);
-          float d = get_float(p, i + 12);
-          float e = get_float(p, i + 16);
-          float f = get_float(p, i + 20);
-          script_ops_transform(v_ctx, a, b, c, d, e, f);
-        }
-        i += 24;
-        break;
-      case SCRIPT_OP_SCALE:
-        {
-          float x = get_float(p, i);
-          float y = get_float(p, i + 4);
-          script_ops_scale(v_ctx, x, y);
-        }
-        i += 8;
-        break;
-      case SCRIPT_OP_ROTATE:
-        {
-          float radians = get_float(p, i);
-          script_ops_rotate(v_ctx, radians);
-        }
-        i += 4;
-        break;
-      case SCRIPT_OP_TRANSLATE:
-        {
-          float x = get_float(p, i);
-          float y = get_float(p, i + 4);
-          script_ops_translate(v_ctx, x, y);
-        }
-        i += 8;
-        break;
-      case SCRIPT_OP_FILL_COLOR:
-        {
-          color_rgba_t color = {
-            get_byte(p,i),
-            get_byte(p,i+1),
-            get_byte(p,i+2),
-            get_byte(p,i+3)
-          };
-          script_ops_fill_color(v_ctx, color);
-        }
-        i += 4;
-        break;
-      case SCRIPT_OP_FILL_LINEAR:
-        {
-          coordinates_t start = {get_float(p, i), get_float(p, i + 4)};
-          coordinates_t end = {get_float(p, i + 8), get_float(p, i + 12)};
-          color_rgba_t color_start = {
-            get_byte(p, i + 16),
-            get_byte(p, i + 17),
-            get_byte(p, i + 18),
-            get_byte(p, i + 19)
-          };
-          color_rgba_t color_end = {
-            get_byte(p, i + 20),
-            get_byte(p, i + 21),
-            get_byte(p, i + 22),
-            get_byte(p, i + 23)
-          };
-          script_ops_fill_linear(v_ctx,
-                                 start, end,
-                                 color_start, color_end);
-        }
-        i += 24;
-        break;
-      case SCRIPT_OP_FILL_RADIAL:
-        {
-          coordinates_t center = {get_float(p, i), get_float(p, i + 4)};
-          float inner_radius = get_float(p, i + 8);
-          float outer_radius = get_float(p, i + 12);
-          color_rgba_t color_start = {
-            get_byte(p, i + 16),
-            get_byte(p, i + 17),
-            get_byte(p, i + 18),
-            get_byte(p, i + 19)
-          };
-          color_rgba_t color_end = {
-            get_byte(p, i + 20),
-            get_byte(p, i + 21),
-            get_byte(p, i + 22),
-            get_byte(p, i + 23)
-          };
-          script_ops_fill_radial(v_ctx, center,
-                                 inner_radius,
-                                 outer_radius,
-                                 color_start, color_end);
-        }
-        i += 24;
-        break;
-      case SCRIPT_OP_FILL_IMAGE:
-        // we can reuse the passed in id struct
-        id.size = param;
-        id.p_data = p + i;
-        script_ops_fill_image(v_ctx, id);
-        i += padded_advance(param);
-      break;
-      case SCRIPT_OP_FILL_STREAM:
-        // we can reuse the passed in id struct
-        id.size = param;
-        id.p_data = p + i;
-        script_ops_fill_stream(v_ctx, id);
-        i += padded_advance(param);
-      break;
-
-      case SCRIPT_OP_STROKE_WIDTH:
-        {
-          float w = param / 4.0;
-          script_ops_stroke_width(v_ctx, w);
-        }
-        break;
-      case SCRIPT_OP_STROKE_COLOR:
-        {
-          color_rgba_t color = {
-            get_byte(p, i),
-            get_byte(p, i + 1),
-            get_byte(p, i + 2),
-            get_byte(p, i + 3)
-          };
-          script_ops_stroke_color(v_ctx, color);
-        }
-        i += 4;
-        break;
-      case SCRIPT_OP_STROKE_LINEAR:
-        {
-          coordinates_t start = {get_float(p, i), get_float(p, i + 4)};
-          coordinates_t end = {get_float(p, i + 8), get_float(p, i + 12)};
-          color_rgba_t color_start = {
-            get_byte(p, i + 16),
-            get_byte(p, i + 17),
-            get_byte(p, i + 18),
-            get_byte(p, i + 19)
-          };
-          color_rgba_t color_end = {
-            get_byte(p, i + 20),
-            get_byte(p, i + 21),
-            get_byte(p, i + 22),
-            get_byte(p, i + 23)
-          };
-          script_ops_stroke_linear(v_ctx,
-                                   start, end,
-                                   color_start, color_end);
-        }
-        i += 24;
-        break;
-      case SCRIPT_OP_STROKE_RADIAL:
-        {
-          coordinates_t center = {get_float(p, i), get_float(p, i + 4)};
-          float inner_radius = get_float(p, i + 8);
-          float outer_radius = get_float(p, i + 12);
-          color_rgba_t color_start = {
-            get_byte(p, i + 16),
-            get_byte(p, i + 17),
-            get_byte(p, i + 18),
-            get_byte(p, i + 19)
-          };
-          color_rgba_t color_end = {
-            get_byte(p, i + 20),
-            get_byte(p, i + 21),
-            get_byte(p, i + 22),
-            get_byte(p, i + 23)
-          };
-          script_ops_stroke_radial(v_ctx, center,
-                                   inner_radius,
-                                   outer_radius,
-                                   color_start, color_end);
-        }
-        i += 24;
-        break;
-      case SCRIPT_OP_STROKE_IMAGE:
-        // we can reuse the passed in id struct
-        id.size = param;
-        id.p_data = p + i;
-        script_ops_stroke_image(v_ctx, id);
-        i += padded_advance(param);
-      break;
-      case SCRIPT_OP_STROKE_STREAM:
-        // we can reuse the passed in id struct
-        id.size = param;
-        id.p_data = p + i;
-        script_ops_stroke_stream(v_ctx, id);
-        i += padded_advance(param);
-      break;
-      case SCRIPT_OP_LINE_CAP:
-        {
-          line_cap_t line_cap = (line_cap_t)param;
-          script_ops_line_cap(v_ctx, line_cap);
-        }
-        break;
-      case SCRIPT_OP_LINE_JOIN:
-        {
-          line_join_t line_join = (line_join_t)param;
-          script_ops_line_join(v_ctx, line_join);
+    // text and ids come before any sprites
+    const uint8_t* p_bytes = NULL;
+    if (p_info->bytes) {
+      uint32_t advance = padded_advance(param);
+      if (advance > size - i) WALK_FAIL("truncated op");
+      p_bytes = p + i;
+      i += advance;
+    }
+
+    uint32_t arg_bytes = (op == SCRIPT_OP_DRAW_SPRITES)
+      ? sprite_count * sizeof(sprite_t)
+      : words * sizeof(word_t);
+    if (arg_bytes > size - i) WALK_FAIL("truncated op");
+
+    // room for the site, which doesn't come from the script
+    if (op == SCRIPT_OP_DRAW_SCRIPT) words = SITE_WORDS;
+
+    const char* error = check_op(op, param, p + i);
+    if (error) WALK_FAIL(error);
+
+    if (p_code) {
+      word_t* p_args = p_words + word_count;
+      if (op == SCRIPT_OP_DRAW_SPRITES) {
+        p_args[0].u = sprite_count;
+        swap_words(p_args + 1, p + i, sprite_count * SPRITE_WORDS);
+      } else {
+        swap_words(p_args, p + i, p_info->swap);
+        memcpy(p_args + p_info->swap, p + i + p_info->swap * 4, p_info->raw * 4);
+      }
+
+      p_code[instr_count] = (instr_t){
+        .fn = p_info->fn,
+        .op = op,
+        .param = param,
+        .handle = p_info->ref
+          ? handle_intern((sid_t){.size = param, .p_data = (void*)p_bytes})
+          : HANDLE_NONE,
+        .p_args = p_args,
+        .p_bytes = p_bytes
+      };
+    }
+
+    i += arg_bytes;
+    instr_count++;
+    word_count += words;
+  }
+
+  *p_instr_count = instr_count;
+  *p_word_count = word_count;
+  return NULL;
+}
+
+//---------------------------------------------------------
+// measuring
+
+// Text is measured without the font. No glyph, and no line of a
+// multi-line string, is more than this many ems for each byte of text,
+// and nothing sits further than the margin above or below a line.
+#define TEXT_EMS_PER_BYTE 2.0f
+#define TEXT_EMS_MARGIN 2.0f
+
+typedef struct {
+  affine_t tx;      // from the script's origin
+  float width;      // NAN until the script sets it
+  float join;
+  float size;
+  uint32_t styles;  // STYLE_ bits set so far
+  bool opaque_fill; // filling with an opaque color set here
+  bool clipped;     // a scissor has been set here
+} measure_state_t;
+
+static void measure_point(bounds_t* p_bounds, const measure_state_t* p_ms,
+                          float x, float y)
+{
+  box_add_point(&p_bounds->box, p_ms->tx, x, y);
+}
+
+static void measure_corners(bounds_t* p_bounds, const measure_state_t* p_ms,
+                            float x0, float y0, float x1, float y1)
+{
+  measure_point(p_bounds, p_ms, x0, y0);
+  measure_point(p_bounds, p_ms, x1, y0);
+  measure_point(p_bounds, p_ms, x0, y1);
+  measure_point(p_bounds, p_ms, x1, y1);
+}
+
+static void measure_stroke(bounds_t* p_bounds, const measure_state_t* p_ms)
+{
+  float k = affine_norm(p_ms->tx) / 2;
+  pad_t pad = {0};
+  if (!isnan(p_ms->width) && !isnan(p_ms->join)) pad.abs = p_ms->width * p_ms->join * k;
+  else if (!isnan(p_ms->width)) pad.join = p_ms->width * k;
+  else if (!isnan(p_ms->join)) pad.width = p_ms->join * k;
+  else pad.reach = k;
+  p_bounds->pad = pad_max(p_bounds->pad, pad);
+}
+
+static void measure_text(bounds_t* p_bounds, const measure_state_t* p_ms,
+                         uint32_t length)
+{
+  float ems = (length * TEXT_EMS_PER_BYTE + TEXT_EMS_MARGIN) * affine_norm(p_ms->tx);
+  pad_t pad = {0};
+  if (!isnan(p_ms->size)) pad.abs = ems * p_ms->size;
+  else pad.size = ems;
+  p_bounds->pad = pad_max(p_bounds->pad, pad);
+  measure_point(p_bounds, p_ms, 0, 0);
+}
+
+// does the op change state that push_state and pop_state save
+static bool changes_state(uint16_t op)
+{
+  switch (op) {
+  case SCRIPT_OP_SCISSOR:
+  case SCRIPT_OP_TRANSFORM:
+  case SCRIPT_OP_SCALE:
+  case SCRIPT_OP_ROTATE:
+  case SCRIPT_OP_TRANSLATE:
+    return true;
+  default:
+    // the styles
+    return op >= SCRIPT_OP_FILL_COLOR;
+  }
+}
+
+static bool is_path_op(uint16_t op)
+{
+  return op >= SCRIPT_OP_BEGIN_PATH && op <= SCRIPT_OP_ARC;
+}
+
+// the STYLE_ bits an instruction sets
+static uint32_t styles_set(uint16_t op)
+{
+  switch (op) {
+  case SCRIPT_OP_FILL_COLOR:
+  case SCRIPT_OP_FILL_LINEAR:
+  case SCRIPT_OP_FILL_RADIAL:
+  case SCRIPT_OP_FILL_IMAGE:
+  case SCRIPT_OP_FILL_STREAM:
+    return STYLE_FILL;
+  case SCRIPT_OP_STROKE_COLOR:
+  case SCRIPT_OP_STROKE_LINEAR:
+  case SCRIPT_OP_STROKE_RADIAL:
+  case SCRIPT_OP_STROKE_IMAGE:
+  case SCRIPT_OP_STROKE_STREAM:
+    return STYLE_STROKE;
+  case SCRIPT_OP_STROKE_WIDTH:    return STYLE_STROKE_WIDTH;
+  case SCRIPT_OP_LINE_CAP:        return STYLE_LINE_CAP;
+  case SCRIPT_OP_LINE_JOIN:       return STYLE_LINE_JOIN;
+  case SCRIPT_OP_MITER_LIMIT:     return STYLE_MITER_LIMIT;
+  case SCRIPT_OP_FONT:            return STYLE_FONT;
+  case SCRIPT_OP_FONT_SIZE:       return STYLE_FONT_SIZE;
+  case SCRIPT_OP_TEXT_ALIGN:      return STYLE_TEXT_ALIGN;
+  case SCRIPT_OP_TEXT_BASE:       return STYLE_TEXT_BASE;
+  default:                        return 0;
+  }
+}
+
+// the STYLE_ bits an instruction draws with
+static uint32_t styles_used(const instr_t* p_instr)
+{
+  switch (p_instr->op) {
+  case SCRIPT_OP_DRAW_LINE:
+  case SCRIPT_OP_DRAW_TRIANGLE:
+  case SCRIPT_OP_DRAW_QUAD:
+  case SCRIPT_OP_DRAW_RECT:
+  case SCRIPT_OP_DRAW_RRECT:
+  case SCRIPT_OP_DRAW_RRECTV:
+  case SCRIPT_OP_DRAW_ARC:
+  case SCRIPT_OP_DRAW_SECTOR:
+  case SCRIPT_OP_DRAW_CIRCLE:
+  case SCRIPT_OP_DRAW_ELLIPSE:
+    return ((p_instr->param & FLAG_FILL) ? STYLE_FILL : 0)
+      | ((p_instr->param & FLAG_STROKE) ? STYLES_STROKING : 0);
+  case SCRIPT_OP_DRAW_TEXT:
+    return STYLES_TEXT;
+  case SCRIPT_OP_FILL_PATH:
+    return STYLE_FILL;
+  case SCRIPT_OP_STROKE_PATH:
+    return STYLES_STROKING;
+  default:
+    return 0;
+  }
+}
+
+//---------------------------------------------------------
+// Work out the bounds of what the script draws itself, whether it
+// leaks state to whatever draws it, the opaque rects it fills, and
+// fill in its sites. Paths aren't expected to carry across
+// draw_script, so a script that uses a path it didn't begin could be
+// drawing anything.
+static void measure_script(script_t* p_script)
+{
+  bounds_t* p_bounds = &p_script->bounds;
+  *p_bounds = (bounds_t){.box = box_empty()};
+  p_script->leaks = false;
+  p_script->inherits = 0;
+
+  uint32_t push_count = 0;
+  uint32_t rect_count = 0;
+  for (uint32_t i = 0; i < p_script->instr_count; i++) {
+    uint16_t op = p_script->p_code[i].op;
+    if (op == SCRIPT_OP_PUSH_STATE || op == SCRIPT_OP_POP_PUSH_STATE) push_count++;
+    if (op == SCRIPT_OP_DRAW_RECT) rect_count++;
+  }
+  measure_state_t* p_saved = malloc((push_count + 1) * sizeof(measure_state_t));
+  if (!p_saved) {
+    p_bounds->unbounded = true;
+    p_script->leaks = true;
+    return;
+  }
+  // the sites follow the boxes in the same block
+  if (rect_count) {
+    p_script->p_occluders = malloc(rect_count * (sizeof(box_t) + sizeof(uint32_t)));
+    if (!p_script->p_occluders) {
+      // it still works without any occluders
+      p_script->p_occluder_sites = NULL;
+      rect_count = 0;
+    } else {
+      p_script->p_occluder_sites = (uint32_t*)(p_script->p_occluders + rect_count);
+    }
+  }
+  uint32_t site_count = 0;
+
+  measure_state_t ms = {
+    .tx = affine_identity(), .width = NAN, .join = NAN, .size = NAN,
+    .styles = 0, .opaque_fill = false, .clipped = false
+  };
+  uint32_t depth = 0;
+  bool path_begun = false;
+
+  for (uint32_t i = 0; i < p_script->instr_count; i++) {
+    instr_t* p_instr = &p_script->p_code[i];
+    const word_t* a = p_instr->p_args;
+    bool stroke = p_instr->param & FLAG_STROKE;
+
+    if (depth == 0 && changes_state(p_instr->op)) p_script->leaks = true;
+    p_script->inherits |= styles_used(p_instr) & ~ms.styles;
+    ms.styles |= styles_set(p_instr->op);
+    if (p_instr->handle != HANDLE_NONE && p_instr->op != SCRIPT_OP_DRAW_SCRIPT) {
+      p_script->has_media = true;
+    }
+    if (is_path_op(p_instr->op)) {
+      if (p_instr->op == SCRIPT_OP_BEGIN_PATH) path_begun = true;
+      else if (!path_begun) p_bounds->unbounded = true;
+    }
+
+    switch (p_instr->op) {
+    case SCRIPT_OP_DRAW_LINE:
+    case SCRIPT_OP_DRAW_TRIANGLE:
+    case SCRIPT_OP_DRAW_QUAD:
+      for (uint32_t n = 0; n < op_info[p_instr->op].swap; n += 2) {
+        measure_point(p_bounds, &ms, a[n].f, a[n + 1].f);
+      }
+      if (stroke) measure_stroke(p_bounds, &ms);
+      break;
+    case SCRIPT_OP_DRAW_RECT:
+      if ((p_instr->param & FLAG_FILL) && ms.opaque_fill && !ms.clipped
+          && ms.tx.b == 0 && ms.tx.c == 0 && p_script->p_occluders) {
+        box_t box = box_transform(ms.tx, box_from_corners(0, 0, a[0].f, a[1].f));
+        if (box_is_finite(box)) {
+          p_script->p_occluders[p_script->occluder_count] = box;
+          p_script->p_occluder_sites[p_script->occluder_count++] = site_count;
         }
-        break;
-      case SCRIPT_OP_MITER_LIMIT:
-        script_ops_miter_limit(v_ctx, param);
-        break;
-      case SCRIPT_OP_FONT:
-        // we can reuse the passed in id struct
-        id.size = param;
-        id.p_data = p + i;
-        script_ops_font(v_ctx, id);
-        i += padded_advance(param);
-        break;
-      case SCRIPT_OP_FONT_SIZE:
-        {
-          float size = param / 4.0;
-          script_ops_font_size(v_ctx, size);
+      }
+      // fall through
+    case SCRIPT_OP_DRAW_RRECT:
+    case SCRIPT_OP_DRAW_RRECTV:
+      measure_corners(p_bounds, &ms, 0, 0, a[0].f, a[1].f);
+      if (stroke) measure_stroke(p_bounds, &ms);
+      break;
+    case SCRIPT_OP_DRAW_ARC:
+    case SCRIPT_OP_DRAW_SECTOR:
+    case SCRIPT_OP_DRAW_CIRCLE:
+      measure_corners(p_bounds, &ms, -a[0].f, -a[0].f, a[0].f, a[0].f);
+      if (stroke) measure_stroke(p_bounds, &ms);
+      break;
+    case SCRIPT_OP_DRAW_ELLIPSE:
+      measure_corners(p_bounds, &ms, -a[0].f, -a[1].f, a[0].f, a[1].f);
+      if (stroke) measure_stroke(p_bounds, &ms);
+      break;
+    case SCRIPT_OP_DRAW_TEXT:
+      measure_text(p_bounds, &ms, p_instr->param);
+      break;
+    case SCRIPT_OP_DRAW_SPRITES:
+      {
+        const sprite_t* p_sprites = (const sprite_t*)(a + 1);
+        for (uint32_t n = 0; n < a[0].u; n++) {
+          measure_corners(p_bounds, &ms, p_sprites[n].dx, p_sprites[n].dy,
+                          p_sprites[n].dx + p_sprites[n].dw,
+                          p_sprites[n].dy + p_sprites[n].dh);
         }
-        break;
-      case SCRIPT_OP_TEXT_ALIGN:
-        {
-          text_align_t text_align = (text_align_t)param;
-          script_ops_text_align(v_ctx, text_align);
+      }
+      break;
+    case SCRIPT_OP_DRAW_SCRIPT:
+      {
+        // the script itself is added in by tree_bounds
+        site_t* p_site = (site_t*)a;
+        *p_site = (site_t){
+          .tx = ms.tx, .width = ms.width, .join = ms.join, .size = ms.size,
+          .styles = ms.styles
+        };
+        uint16_t next = (i + 1 < p_script->instr_count)
+          ? p_script->p_code[i + 1].op
+          : SCRIPT_OP_POP_STATE;
+        if (depth > 0
+            && (next == SCRIPT_OP_POP_STATE || next == SCRIPT_OP_POP_PUSH_STATE)) {
+          p_site->flags |= SITE_CONTAINED;
         }
+        if (ms.clipped) p_site->flags |= SITE_CLIPPED;
+        site_count++;
+        // the script could change the fill
+        ms.opaque_fill = false;
+      }
+      break;
+
+    case SCRIPT_OP_FILL_COLOR:
+      ms.opaque_fill = (a[0].c.alpha == 255);
+      break;
+    case SCRIPT_OP_FILL_LINEAR:
+    case SCRIPT_OP_FILL_RADIAL:
+    case SCRIPT_OP_FILL_IMAGE:
+    case SCRIPT_OP_FILL_STREAM:
+      ms.opaque_fill = false;
+      break;
+    case SCRIPT_OP_SCISSOR:
+      ms.clipped = true;
+      break;
+
+    case SCRIPT_OP_MOVE_TO:
+    case SCRIPT_OP_LINE_TO:
+    case SCRIPT_OP_BEZIER_TO:
+    case SCRIPT_OP_QUADRATIC_TO:
+      // curves stay inside their control points
+      for (uint32_t n = 0; n < op_info[p_instr->op].swap; n += 2) {
+        measure_point(p_bounds, &ms, a[n].f, a[n + 1].f);
+      }
+      break;
+    case SCRIPT_OP_ARC:
+      measure_corners(p_bounds, &ms, a[0].f - a[2].f, a[1].f - a[2].f,
+                      a[0].f + a[2].f, a[1].f + a[2].f);
+      break;
+    case SCRIPT_OP_ARC_TO:
+      // where the arc lands depends on the angle between the lines
+      // and can be a long way from any of the points
+      p_bounds->unbounded = true;
+      break;
+    case SCRIPT_OP_STROKE_PATH:
+      measure_stroke(p_bounds, &ms);
+      break;
+
+    case SCRIPT_OP_POP_PUSH_STATE:
+    case SCRIPT_OP_POP_STATE:
+      if (depth > 0) ms = p_saved[--depth];
+      if (p_instr->op == SCRIPT_OP_POP_STATE) break;
+      // fall through
+    case SCRIPT_OP_PUSH_STATE:
+      p_saved[depth++] = ms;
+      break;
+
+    case SCRIPT_OP_TRANSFORM:
+      ms.tx = affine_multiply(ms.tx, (affine_t){a[0].f, a[1].f, a[2].f,
+                                                a[3].f, a[4].f, a[5].f});
+      break;
+    case SCRIPT_OP_SCALE:
+      ms.tx = affine_scale(ms.tx, a[0].f, a[1].f);
+      break;
+    case SCRIPT_OP_ROTATE:
+      ms.tx = affine_rotate(ms.tx, a[0].f);
+      break;
+    case SCRIPT_OP_TRANSLATE:
+      ms.tx = affine_translate(ms.tx, a[0].f, a[1].f);
+      break;
+    case SCRIPT_OP_STROKE_WIDTH:
+      ms.width = p_instr->param / 4.0;
+      break;
+    case SCRIPT_OP_MITER_LIMIT:
+      ms.join = join_factor(p_instr->param);
+      break;
+    case SCRIPT_OP_FONT_SIZE:
+      ms.size = p_instr->param / 4.0;
+      break;
+    default:
+      break;
+    }
+  }
+  free(p_saved);
+
+  if (!box_is_finite(p_bounds->box) && !box_is_empty(p_bounds->box)) {
+    p_bounds->unbounded = true;
+  }
+  if (!pad_is_finite(p_bounds->pad)) p_bounds->unbounded = true;
+
+  // going backwards, note the sites after which the path is used
+  // again before it is begun again
+  bool path_used = false;
+  for (uint32_t i = p_script->instr_count; i-- > 0; ) {
+    instr_t* p_instr = &p_script->p_code[i];
+    if (p_instr->op == SCRIPT_OP_BEGIN_PATH) path_used = false;
+    else if (is_path_op(p_instr->op)) path_used = true;
+    else if (p_instr->op == SCRIPT_OP_DRAW_SCRIPT && path_used) {
+      ((site_t*)p_instr->p_args)->flags |= SITE_PATH_USED;
+    }
+  }
+}
+
+//---------------------------------------------------------
+// optimizing
+
+// Scripts as they are serialized set styles that are already set, or
+// are set again before anything is drawn with them, push and pop state
+// around nothing, and translate by nothing or in steps. Compiling
+// takes those out, so the device doesn't have to do them every frame.
+
+optimize_stats_t g_optimize_stats = {0};
+
+// does b set the style to what a already set it to
+static bool same_style(const instr_t* a, const instr_t* b)
+{
+  if (a->op != b->op) return false;
+  switch (a->op) {
+  case SCRIPT_OP_FILL_COLOR:
+  case SCRIPT_OP_STROKE_COLOR:
+    return a->p_args[0].u == b->p_args[0].u;
+  case SCRIPT_OP_FONT:
+    return a->handle == b->handle;
+  case SCRIPT_OP_STROKE_WIDTH:
+  case SCRIPT_OP_LINE_CAP:
+  case SCRIPT_OP_LINE_JOIN:
+  case SCRIPT_OP_MITER_LIMIT:
+  case SCRIPT_OP_FONT_SIZE:
+  case SCRIPT_OP_TEXT_ALIGN:
+  case SCRIPT_OP_TEXT_BASE:
+    return a->param == b->param;
+  default:
+    // gradients and images are made again every time they are set
+    return false;
+  }
+}
+
+static void drop_instr(instr_t* p_instr)
+{
+  handle_release(p_instr->handle);
+  p_instr->handle = HANDLE_NONE;
+  p_instr->fn = NULL;
+}
+
+// Take out the style changes that can't make a difference: setting a
+// style to what it already is, and setting it when it is set again,
+// or popped, before anything uses it.
+static void drop_dead_styles(script_t* p_script)
+{
+  const instr_t* known[STYLE_COUNT] = {0};  // what each style is set to
+  instr_t* unused[STYLE_COUNT] = {0};       // set, and not used since
+  uint32_t depth = 0;
+
+  for (uint32_t i = 0; i < p_script->instr_count; i++) {
+    instr_t* p_instr = &p_script->p_code[i];
+
+    uint32_t set = styles_set(p_instr->op);
+    if (set) {
+      int s = __builtin_ctz(set);
+      if (known[s] && same_style(known[s], p_instr)) {
+        drop_instr(p_instr);
+        continue;
+      }
+      if (unused[s]) drop_instr(unused[s]);
+      known[s] = unused[s] = p_instr;
+      continue;
+    }
+
+    uint32_t used = styles_used(p_instr);
+    switch (p_instr->op) {
+    case SCRIPT_OP_PUSH_STATE:
+      // what was set before is in effect again after the pop
+      used = STYLES_ALL;
+      depth++;
+      break;
+    case SCRIPT_OP_POP_STATE:
+    case SCRIPT_OP_POP_PUSH_STATE:
+      if (depth == 0) {
+        // the pop does nothing
+        used = STYLES_ALL;
+        if (p_instr->op == SCRIPT_OP_POP_PUSH_STATE) depth++;
         break;
-      case SCRIPT_OP_TEXT_BASE:
-        {
-          text_base_t text_base = (text_base_t)param;
-          script_ops_text_base(v_ctx, text_base);
+      }
+      for (int s = 0; s < STYLE_COUNT; s++) {
+        if (unused[s]) drop_instr(unused[s]);
+        unused[s] = NULL;
+        known[s] = NULL;
+      }
+      if (p_instr->op == SCRIPT_OP_POP_STATE) depth--;
+      break;
+    case SCRIPT_OP_DRAW_SCRIPT:
+      // the script could use any of them, or leak changes to them
+      used = STYLES_ALL;
+      memset(known, 0, sizeof(known));
+      break;
+    default:
+      break;
+    }
+
+    for (int s = 0; s < STYLE_COUNT; s++) {
+      if (used & (1 << s)) unused[s] = NULL;
+    }
+  }
+}
+
+//---------------------------------------------------------
+static void optimize_script(script_t* p_script)
+{
+  uint32_t count = p_script->instr_count;
+  drop_dead_styles(p_script);
+
+  // close up the gaps, and take out the transforms and state changes
+  // that cancel out with the instruction before them
+  instr_t* p_code = p_script->p_code;
+  uint32_t w = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    instr_t* p_instr = &p_code[i];
+    if (!p_instr->fn) continue;
+
+    instr_t* p_last = w ? &p_code[w - 1] : NULL;
+    uint16_t last_op = p_last ? p_last->op : 0;
+    word_t* a = (word_t*)p_instr->p_args;
+
+    switch (p_instr->op) {
+    case SCRIPT_OP_TRANSLATE:
+      if (a[0].f == 0 && a[1].f == 0) continue;
+      if (last_op == SCRIPT_OP_TRANSLATE) {
+        word_t* b = (word_t*)p_last->p_args;
+        b[0].f += a[0].f;
+        b[1].f += a[1].f;
+        if (b[0].f == 0 && b[1].f == 0) w--;
+        continue;
+      }
+      break;
+    case SCRIPT_OP_SCALE:
+      if (a[0].f == 1 && a[1].f == 1) continue;
+      break;
+    case SCRIPT_OP_ROTATE:
+      if (a[0].f == 0) continue;
+      break;
+    case SCRIPT_OP_POP_STATE:
+      if (last_op == SCRIPT_OP_PUSH_STATE) {
+        w--;
+        continue;
+      }
+      if (last_op == SCRIPT_OP_POP_PUSH_STATE) {
+        // pop, push, pop is one pop
+        p_last->op = SCRIPT_OP_POP_STATE;
+        p_last->fn = op_info[SCRIPT_OP_POP_STATE].fn;
+        continue;
+      }
+      break;
+    case SCRIPT_OP_POP_PUSH_STATE:
+      // push, pop, push is one push
+      if (last_op == SCRIPT_OP_PUSH_STATE || last_op == SCRIPT_OP_POP_PUSH_STATE) continue;
+      break;
+    default:
+      break;
+    }
+
+    p_code[w++] = *p_instr;
+  }
+
+  p_script->instr_count = w;
+  g_optimize_stats.ops += count;
+  g_optimize_stats.removed += count - w;
+}
+
+//---------------------------------------------------------
+// compile the raw script into its instruction array. The instructions
+// and their arguments share one allocation.
+static bool compile_script(script_t* p_script)
+{
+  uint32_t instr_count;
+  uint32_t word_count;
+  uint32_t offset;
+  const char* error = walk_script(p_script, &instr_count, &word_count,
+                                  &offset, NULL, NULL);
+  if (error) {
+    log_error("%s rejected script id:'%.*s' at offset %d: %s", __func__,
+              p_script->id.size, p_script->id.p_data, offset, error);
+    return false;
+  }
+
+  // the extra byte keeps an empty script from being a zero sized malloc
+  size_t code_size = instr_count * sizeof(instr_t);
+  p_script->p_code = malloc(code_size + word_count * sizeof(word_t) + 1);
+  if (!p_script->p_code) {
+    log_error("%s unable to allocate the compiled script", __func__);
+    return false;
+  }
+  p_script->instr_count = instr_count;
+
+  walk_script(p_script, &instr_count, &word_count, &offset,
+              p_script->p_code, (word_t*)((uint8_t*)p_script->p_code + code_size));
+  if (g_opts.optimize_scripts) optimize_script(p_script);
+  measure_script(p_script);
+  return true;
+}
+
+//---------------------------------------------------------
+// Returns true if drawing p_script would end up drawing the script
+// named by target. Each script is looked into at most once per walk,
+// so the walk is bounded by the number of scripts and needs no depth
+// limit. The scripts still to look into are kept on a stack of their
+// own rather than the C stack, since a chain can be any length.
+static uint32_t visit_epoch = 0;
+static script_t** p_walk_stack = NULL;
+static uint32_t walk_stack_size = 0;
+
+static bool draws_script(script_t* p_script, handle_t target)
+{
+  uint32_t count = 0;
+  visit_epoch++;
+
+  for (;;) {
+    for (uint32_t i = 0; i < p_script->instr_count; i++) {
+      const instr_t* p_instr = &p_script->p_code[i];
+      if (p_instr->op != SCRIPT_OP_DRAW_SCRIPT) continue;
+      if (p_instr->handle == target) return true;
+
+      script_t* p_child = handle_slot(p_instr->handle)->p_script;
+      if (!p_child || p_child->visit_epoch == visit_epoch) continue;
+      p_child->visit_epoch = visit_epoch;
+
+      if (count == walk_stack_size) {
+        uint32_t size = walk_stack_size ? walk_stack_size * 2 : 64;
+        script_t** p_stack = realloc(p_walk_stack, size * sizeof(script_t*));
+        if (!p_stack) {
+          // can't tell, so take it that it does
+          log_error("%s unable to allocate the walk stack", __func__);
+          return true;
         }
-        break;
+        p_walk_stack = p_stack;
+        walk_stack_size = size;
+      }
+      p_walk_stack[count++] = p_child;
+    }
 
-      default:
-        log_error("Unknown script_op: %d", op);
-        break;
+    if (count == 0) return false;
+    p_script = p_walk_stack[--count];
+  }
+}
+
+//---------------------------------------------------------
+// allocate a record to hold a script, with room for the id and the
+// script bytes in the same block
+static script_t* alloc_script(uint32_t id_length, uint32_t script_size)
+{
+  int struct_size = ALIGN_UP(sizeof(script_t), 8);
+  int id_size = ALIGN_UP(id_length, 8);
+  int alloc_size = struct_size + id_size + script_size;
+  script_t *p_script = malloc(alloc_size);
+  if ( !p_script ) {
+    log_error("Unable to allocate script");
+    return NULL;
+  }
+
+  p_script->id.size = id_length;
+  p_script->id.p_data = ((void*)p_script) + struct_size;
+  p_script->script.size = script_size;
+  p_script->script.p_data = ((void*)p_script) + struct_size + id_size;
+  p_script->handle = HANDLE_NONE;
+  p_script->p_code = NULL;
+  p_script->instr_count = 0;
+  p_script->visit_epoch = 0;
+  p_script->tree_epoch = 0;
+  p_script->tree_steps = 0;
+  p_script->p_occluders = NULL;
+  p_script->p_occluder_sites = NULL;
+  p_script->occluder_count = 0;
+  p_script->stamp_epoch = 0;
+  p_script->layer_stamp = 0;
+  p_script->layer_visits = 0;
+  p_script->layer_key = (layer_key_t){0};
+  p_script->has_media = false;
+  p_script->landing = box_empty();
+  p_script->last_landing = box_empty();
+  p_script->landing_epoch = 0;
+  p_script->media_stamp = 0;
+  p_script->damaged = false;
+  p_script->rejected = false;
+  return p_script;
+}
+
+//---------------------------------------------------------
+// The caller keeps a copy of every script it sent, to diff the next
+// one against. When an update is refused, that copy no longer matches
+// the script here, so it is told to send the next one in full. Until
+// then, patches to the script here are refused as well, since they
+// are against the copy the caller has.
+static void reject_script(sid_t id)
+{
+  script_t* p_old = get_script(id);
+  if (p_old) p_old->rejected = true;
+  send_script_rejected(id);
+}
+
+//---------------------------------------------------------
+// take ownership of a filled in script, replacing any existing
+// script with the same id
+static void insert_script(script_t* p_script)
+{
+  // putting the same script again changes nothing
+  script_t* p_old = get_script(p_script->id);
+  if (p_old && p_old->script.size == p_script->script.size
+      && !memcmp(p_old->script.p_data, p_script->script.p_data, p_script->script.size)) {
+    // the caller has the same copy as this one again
+    p_old->rejected = false;
+    free_script(p_script);
+    return;
+  }
+
+  if (!compile_script(p_script)) {
+    reject_script(p_script->id);
+    free_script(p_script);
+    return;
+  }
+
+  // the graph of resident scripts has no cycles, so the only way this
+  // one can make a cycle is by drawing, somewhere down, itself
+  handle_t self = handle_find(p_script->id);
+  if (self != HANDLE_NONE) {
+    if (draws_script(p_script, self)) {
+      log_error("%s rejected script id:'%.*s': it draws itself", __func__,
+                p_script->id.size, p_script->id.p_data);
+      reject_script(p_script->id);
+      free_script(p_script);
+      return;
     }
   }
 
+  // take the handle before deleting the old script, so the slot that
+  // other scripts are pointed at carries over to the new one
+  p_script->handle = handle_intern(p_script->id);
+
+  // if there is already is a script with the same id, delete it
+  do_delete_script(p_script->id);
+
+  handle_slot(p_script->handle)->p_script = p_script;
+  handle_touch(p_script->handle);
+  bounds_epoch++;
+
+  if (g_opts.debug_mode) {
+    log_debug("%s id:'%.*s'", __func__,
+              p_script->id.size, p_script->id.p_data);
+  }
+
+  // insert the script into the tommy hash
+  tommy_hashlin_insert(&scripts,
+                       &p_script->node,
+                       p_script,
+                       HASH_ID(p_script->id));
+}
+
+//---------------------------------------------------------
+void put_script(uint32_t* p_msg_length)
+{
+  // read in the length of the id, which is in the first four bytes
+  uint32_t id_length;
+  read_bytes_down(&id_length, sizeof(uint32_t), p_msg_length);
+  if (id_length > *p_msg_length) {
+    log_error("%s invalid id length: %d", __func__, id_length);
+    return;
+  }
+
+  // initialize a record to hold the script. The script is the rest of the message
+  script_t *p_script = alloc_script(id_length, *p_msg_length - id_length);
+  if ( !p_script ) {
+    sid_t id = {.size = id_length};
+    id.p_data = borrow_bytes_down(id_length, p_msg_length);
+    if (id.p_data) reject_script(id);
+    return;
+  }
+
+  read_bytes_down(p_script->id.p_data, id_length, p_msg_length);
+  read_bytes_down(p_script->script.p_data, p_script->script.size, p_msg_length);
+
+  insert_script(p_script);
+}
+
+//---------------------------------------------------------
+// same as put_script, but the script bytes are in a shared memory slot
+void put_script_shm(uint32_t* p_msg_length)
+{
+  uint32_t id_length;
+  uint32_t slot;
+  uint32_t script_size;
+  sid_t path;
+  read_bytes_down(&id_length, sizeof(uint32_t), p_msg_length);
+  read_bytes_down(&slot, sizeof(uint32_t), p_msg_length);
+  read_bytes_down(&script_size, sizeof(uint32_t), p_msg_length);
+  read_bytes_down(&path.size, sizeof(uint32_t), p_msg_length);
+
+  script_t *p_script = alloc_script(id_length, script_size);
+  if ( !p_script ) {
+    sid_t id = {.size = id_length};
+    id.p_data = borrow_bytes_down(id_length, p_msg_length);
+    if (id.p_data) reject_script(id);
+    shm_release(slot);
+    return;
+  }
+
+  read_bytes_down(p_script->id.p_data, id_length, p_msg_length);
+  path.p_data = borrow_bytes_down(path.size, p_msg_length);
+
+  void* p_shm = path.p_data ? shm_map(slot, path, script_size) : NULL;
+  if (p_shm) {
+    memcpy(p_script->script.p_data, p_shm, script_size);
+  }
+  shm_release(slot);
+
+  if (!p_shm) {
+    log_error("%s unable to read the script", __func__);
+    reject_script(p_script->id);
+    free_script(p_script);
+    return;
+  }
+
+  insert_script(p_script);
+}
+
+//---------------------------------------------------------
+// apply a set of (offset, bytes) edits to a resident script. The edits
+// are applied to a copy, which replaces the original only if every
+// edit was in range, so a bad patch leaves the old script in place.
+void patch_script(uint32_t* p_msg_length)
+{
+  uint32_t id_length;
+  uint32_t edit_count;
+  read_bytes_down(&id_length, sizeof(uint32_t), p_msg_length);
+  read_bytes_down(&edit_count, sizeof(uint32_t), p_msg_length);
+
+  // the id is only needed for the lookup
+  sid_t id;
+  id.size = id_length;
+  id.p_data = borrow_bytes_down(id_length, p_msg_length);
+  if (!id.p_data) {
+    log_error("%s unable to read the id", __func__);
+    return;
+  }
+
+  script_t* p_old = get_script(id);
+  if (!p_old) {
+    log_error("%s unknown script id:'%.*s'", __func__, id.size, id.p_data);
+    send_script_rejected(id);
+    return;
+  }
+  if (p_old->rejected) {
+    log_error("%s script id:'%.*s' is waiting for a full put", __func__,
+              id.size, id.p_data);
+    send_script_rejected(id);
+    return;
+  }
+
+  script_t* p_script = alloc_script(p_old->id.size, p_old->script.size);
+  if (!p_script) {
+    reject_script(id);
+    return;
+  }
+  memcpy(p_script->id.p_data, p_old->id.p_data, p_old->id.size);
+  memcpy(p_script->script.p_data, p_old->script.p_data, p_old->script.size);
+
+  for (uint32_t i = 0; i < edit_count; i++) {
+    uint32_t offset;
+    uint32_t size;
+    read_bytes_down(&offset, sizeof(uint32_t), p_msg_length);
+    read_bytes_down(&size, sizeof(uint32_t), p_msg_length);
+
+    if (offset > p_script->script.size
+        || size > p_script->script.size - offset
+        || size > *p_msg_length) {
+      log_error("%s edit out of range id:'%.*s' offset:%d size:%d",
+                __func__, p_script->id.size, p_script->id.p_data, offset, size);
+      reject_script(p_script->id);
+      free_script(p_script);
+      return;
+    }
+
+    read_bytes_down(p_script->script.p_data + offset, size, p_msg_length);
+  }
+
+  insert_script(p_script);
+}
+
+//---------------------------------------------------------
+void delete_script(uint32_t* p_msg_length)
+{
+  sid_t id;
+
+  // read in the length of the id, which is in the first four bytes
+  read_bytes_down(&id.size, sizeof(uint32_t), p_msg_length);
+
+  // the id is only needed for the lookup, so borrow it straight out
+  // of the input buffer
+  id.p_data = borrow_bytes_down(id.size, p_msg_length);
+  if (!id.p_data) {
+    log_error("Unable to read the id");
+    return;
+  }
+
+  // delete and free
+  do_delete_script(id);
+}
+
+//---------------------------------------------------------
+static void reset_script(void* p_script)
+{
+  unbind_script(p_script);
+  free_script(p_script);
+}
+
+//---------------------------------------------------------
+void reset_scripts() {
+  // deallocates all the objects iterating the hashtable
+  tommy_hashlin_foreach( &scripts, reset_script );
+
+  // deallocates the hashtable
+  tommy_hashlin_done( &scripts );
+
+  // re-init the hash table
+  tommy_hashlin_init( &scripts );
+
+  layer_clear();
+  bounds_epoch++;
+  damage_all();
+}
+
+
+//=============================================================================
+// rendering
+
+// What the devices start every frame with, or more. Cairo's default
+// stroke width is 2 and nanovg's font size is 16. Both use a miter
+// limit of 10.
+#define DEFAULT_STROKE_WIDTH 2.0f
+#define DEFAULT_MITER_LIMIT 10.0f
+#define DEFAULT_FONT_SIZE 16.0f
+
+// drawing can spill over its edges by a pixel when it is antialiased
+#define ANTIALIAS_MARGIN 1.0f
+
+// one for each band that can be drawn at the same time
+static view_stack_t views[MAX_RENDER_BANDS] = {0};
+
+//---------------------------------------------------------
+static void push_view(view_stack_t* p_views)
+{
+  if (p_views->depth == p_views->size) {
+    int size = p_views->size ? p_views->size * 2 : 32;
+    view_t* p_saved = realloc(p_views->p_saved, size * sizeof(view_t));
+    if (!p_saved) {
+      // can't follow along any more, so stop culling for this frame
+      // but keep the pushes and pops balanced
+      p_views->culling = false;
+      p_views->depth++;
+      return;
+    }
+    p_views->p_saved = p_saved;
+    p_views->size = size;
+  }
+  p_views->p_saved[p_views->depth++] = p_views->view;
+}
+
+//---------------------------------------------------------
+static void pop_view(view_stack_t* p_views)
+{
+  if (p_views->depth == 0) return;
+  p_views->depth--;
+  if (p_views->depth < p_views->size) {
+    p_views->view = p_views->p_saved[p_views->depth];
+  }
+}
+
+//---------------------------------------------------------
+// The bounds of everything drawing the script would draw, in its own
+// space. Worked out again only when some script has changed since,
+// along with the styles and the size of the tree. Those two are only
+// complete when the tree is bounded.
+static const bounds_t* tree_bounds(script_t* p_script, int depth)
+{
+  if (p_script->tree_epoch == bounds_epoch) return &p_script->tree_bounds;
+
+  bounds_t tree = p_script->bounds;
+  uint32_t inherits = p_script->inherits;
+  uint32_t size = p_script->instr_count;
+  for (uint32_t i = 0; i < p_script->instr_count && !tree.unbounded; i++) {
+    const instr_t* p_instr = &p_script->p_code[i];
+    if (p_instr->op != SCRIPT_OP_DRAW_SCRIPT) continue;
+
+    script_t* p_child = handle_slot(p_instr->handle)->p_script;
+    if (!p_child) continue;
+
+    // state the child leaks changes how the rest of this script draws
+    const site_t* p_site = (const site_t*)p_instr->p_args;
+    if (depth >= MAX_SCRIPT_DEPTH
+        || (p_child->leaks && !(p_site->flags & SITE_CONTAINED))) {
+      tree.unbounded = true;
+      break;
+    }
+
+    const bounds_t* p_child_bounds = tree_bounds(p_child, depth + 1);
+    inherits |= p_child->tree_inherits & ~p_site->styles;
+    size = (size + p_child->tree_size < size) ? UINT32_MAX : size + p_child->tree_size;
+    pad_t pad = pad_resolve(p_child_bounds->pad,
+                            p_site->width, p_site->join, p_site->size);
+    bounds_t placed = {
+      .box = box_transform(p_site->tx, p_child_bounds->box),
+      .pad = pad_scale(pad, affine_norm(p_site->tx)),
+      .unbounded = p_child_bounds->unbounded
+    };
+    if (!box_is_empty(placed.box)
+        && (!box_is_finite(placed.box) || !pad_is_finite(placed.pad))) {
+      placed.unbounded = true;
+    }
+    bounds_union(&tree, &placed);
+  }
+
+  p_script->tree_bounds = tree;
+  p_script->tree_inherits = inherits;
+  p_script->tree_size = size;
+  p_script->tree_epoch = bounds_epoch;
+  return &p_script->tree_bounds;
+}
+
+//---------------------------------------------------------
+// true if drawing the script at this site can be skipped without
+// changing what ends up on the screen
+static bool out_of_view(const view_stack_t* p_views, const site_t* p_site,
+                        script_t* p_script)
+{
+  if (!p_views->culling) return false;
+  if (p_site->flags & SITE_PATH_USED) return false;
+  if (p_script->leaks && !(p_site->flags & SITE_CONTAINED)) return false;
+
+  const bounds_t* p_bounds = tree_bounds(p_script, 0);
+  if (p_bounds->unbounded) return false;
+  if (box_is_empty(p_bounds->box)) return true;
+
+  const view_t* p_view = &p_views->view;
+  float pad = pad_eval(p_bounds->pad, p_view->width, p_view->join, p_view->size);
+  box_t box = box_transform(p_view->tx, box_expand(p_bounds->box, pad));
+  return !box_overlaps(box_expand(box, ANTIALIAS_MARGIN), p_view->clip);
+}
+
+//---------------------------------------------------------
+// occlusion
+
+// Rects filled with an opaque color hide whatever was drawn under them
+// before, so plan_frame collects the biggest of them in device space
+// and scripts that would be drawn entirely under one are skipped.
+//
+// Where each one is drawn is counted in steps. Going into a script and
+// coming back out of it are a step each, which rendering counts the
+// same way, so a script is under an occluder that was drawn after it
+// if the occluder's step is past the script's last one.
+
+// the most occluders kept for a frame
+#define MAX_OCCLUDERS 16
+// smaller ones are not worth checking against, in device pixels
+#define OCCLUDER_MIN_AREA 1024.0f
+
+typedef struct {
+  box_t box;      // whole pixels, all of them covered
+  uint32_t step;  // drawn after this many steps
+} occluder_t;
+
+static occluder_t occluders[MAX_OCCLUDERS];
+static int occluder_count = 0;
+
+//---------------------------------------------------------
+static void add_occluder(box_t box, uint32_t step)
+{
+  // only the pixels the rect covers all of are hidden
+  box = (box_t){ceilf(box.x0), ceilf(box.y0), floorf(box.x1), floorf(box.y1)};
+  float area = (box.x1 - box.x0) * (box.y1 - box.y0);
+  if (box_is_empty(box) || !(area >= OCCLUDER_MIN_AREA)) return;
+
+  // keep the biggest
+  int slot = occluder_count;
+  if (occluder_count == MAX_OCCLUDERS) {
+    slot = 0;
+    float smallest = INFINITY;
+    for (int i = 0; i < occluder_count; i++) {
+      box_t b = occluders[i].box;
+      float a = (b.x1 - b.x0) * (b.y1 - b.y0);
+      if (a < smallest) {
+        smallest = a;
+        slot = i;
+      }
+    }
+    if (area <= smallest) return;
+  } else {
+    occluder_count++;
+  }
+  occluders[slot] = (occluder_t){.box = box, .step = step};
+}
+
+//---------------------------------------------------------
+static bool box_contains(box_t outer, box_t inner)
+{
+  return outer.x0 <= inner.x0 && outer.y0 <= inner.y0
+    && inner.x1 <= outer.x1 && inner.y1 <= outer.y1;
+}
+
+//---------------------------------------------------------
+// Returns true if everything drawing the script could touch is under
+// an occluder drawn at or after step after. Only the scene is checked.
+// The cursor goes on top of it, and layers are drawn whole.
+static bool occluded(const view_stack_t* p_views, const site_t* p_site,
+                     script_t* p_script, uint32_t after)
+{
+  if (!occluder_count || !p_views->culling || p_views->recording) return false;
+  if (p_site->flags & SITE_PATH_USED) return false;
+  if (p_script->leaks && !(p_site->flags & SITE_CONTAINED)) return false;
+
+  const bounds_t* p_bounds = tree_bounds(p_script, 0);
+  if (p_bounds->unbounded) return false;
+
+  const view_t* p_view = &p_views->view;
+  float pad = pad_eval(p_bounds->pad, p_view->width, p_view->join, p_view->size);
+  box_t box = box_transform(p_view->tx, box_expand(p_bounds->box, pad));
+  // only what lands inside the clip is drawn
+  box = box_intersect(box_expand(box, ANTIALIAS_MARGIN), p_view->clip);
+  if (!box_is_finite(box)) return false;
+
+  for (int i = 0; i < occluder_count; i++) {
+    if (occluders[i].step >= after && box_contains(occluders[i].box, box)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+//---------------------------------------------------------
+bool frame_covers_damage()
+{
+  if (g_damage.count == 0) return false;
+  for (int r = 0; r < g_damage.count; r++) {
+    bool covered = false;
+    for (int i = 0; i < occluder_count && !covered; i++) {
+      covered = box_contains(occluders[i].box, g_damage.rects[r]);
+    }
+    if (!covered) return false;
+  }
+  return true;
+}
+
+//---------------------------------------------------------
+// layers
+
+// smaller trees are quicker to draw than to composite
+#define LAYER_MIN_SIZE 16
+// the most pixels on a side
+#define LAYER_MAX_SIDE 2048
+// draws with nothing changing before a tree is put in a layer
+#define LAYER_STABLE_VISITS 3
+// recordings are clipped to the bounds, plus this in script space
+#define RECORDING_MARGIN 1.0f
+// what a recording is counted as taking up in the cache, roughly
+#define RECORDING_BYTES_PER_INSTR 256
+
+//---------------------------------------------------------
+// Sums the generations of everything the tree refers to. They only
+// ever go up, so the sum changes whenever anything in it does.
+static uint32_t tree_stamp(script_t* p_script, int depth)
+{
+  if (p_script->stamp_epoch == g_handle_epoch) return p_script->tree_stamp;
+
+  uint32_t stamp = handle_slot(p_script->handle)->generation;
+  for (uint32_t i = 0; i < p_script->instr_count; i++) {
+    const instr_t* p_instr = &p_script->p_code[i];
+    if (p_instr->handle == HANDLE_NONE) continue;
+
+    script_t* p_child = handle_slot(p_instr->handle)->p_script;
+    if (p_instr->op == SCRIPT_OP_DRAW_SCRIPT && p_child && depth < MAX_SCRIPT_DEPTH) {
+      stamp += tree_stamp(p_child, depth + 1);
+    } else {
+      stamp += handle_slot(p_instr->handle)->generation;
+    }
+  }
+
+  p_script->tree_stamp = stamp;
+  p_script->stamp_epoch = g_handle_epoch;
+  return stamp;
+}
+
+//---------------------------------------------------------
+// Set things up so the tree draws into a layer the device has begun,
+// in the space tx maps it to, with nothing culled outside box.
+static void record_tree(render_state_t* p_state, script_t* p_script,
+                        affine_t tx, box_t box)
+{
+  view_stack_t* p_views = p_state->p_views;
+  box_t viewport = p_views->viewport;
+  p_views->viewport = box;
+  p_views->recording = true;
+  push_view(p_views);
+  p_views->view.tx = tx;
+  p_views->view.clip = box;
+
+  script_ops_push_state(p_state->v_ctx);
+  script_ops_transform(p_state->v_ctx, tx.a, tx.b, tx.c, tx.d, tx.e, tx.f);
+  run_script(p_state, p_script);
+  script_ops_pop_state(p_state->v_ctx);
+
+  pop_view(p_views);
+  p_views->recording = false;
+  p_views->viewport = viewport;
+}
+
+//---------------------------------------------------------
+// draw the tree into a new raster layer, with its origin at
+// (phase_x, phase_y) from the corner of a pixel
+static layer_t* record_raster(render_state_t* p_state, script_t* p_script,
+                              const layer_key_t* p_key, uint32_t stamp)
+{
+  const bounds_t* p_bounds = tree_bounds(p_script, 0);
+
+  float scale = (float)p_key->scale / LAYER_SCALE_STEPS;
+  affine_t tx = {scale, 0, 0, scale,
+                 (float)p_key->phase_x / LAYER_PHASE_STEPS,
+                 (float)p_key->phase_y / LAYER_PHASE_STEPS};
+  const view_t* p_view = &p_state->p_views->view;
+  float pad = pad_eval(p_bounds->pad, p_view->width, p_view->join, p_view->size);
+  box_t box = box_transform(tx, box_expand(p_bounds->box, pad));
+  box = box_expand(box, ANTIALIAS_MARGIN);
+  if (!box_is_finite(box)) return NULL;
+
+  box = (box_t){floorf(box.x0), floorf(box.y0), ceilf(box.x1), ceilf(box.y1)};
+  int width = box.x1 - box.x0;
+  int height = box.y1 - box.y0;
+  size_t bytes = (size_t)width * height * 4;
+  if (width <= 0 || height <= 0
+      || width > LAYER_MAX_SIDE || height > LAYER_MAX_SIDE
+      || bytes > LAYER_CACHE_BUDGET / 4) {
+    return NULL;
+  }
+
+  void* p_surface = device_layer_begin(p_state->v_ctx, box.x0, box.y0,
+                                       width, height);
+  if (!p_surface) return NULL;
+  record_tree(p_state, p_script, tx, box);
+  device_layer_end(p_state->v_ctx, p_surface);
+
+  layer_t* p_layer = layer_add(p_key, stamp, p_surface, bytes);
+  if (p_layer) {
+    p_layer->x = box.x0;
+    p_layer->y = box.y0;
+  }
+  return p_layer;
+}
+
+//---------------------------------------------------------
+// record what the tree draws, in its own space
+static layer_t* record_vector(render_state_t* p_state, script_t* p_script,
+                              const layer_key_t* p_key, uint32_t stamp)
+{
+  const bounds_t* p_bounds = tree_bounds(p_script, 0);
+  const view_t* p_view = &p_state->p_views->view;
+  float pad = pad_eval(p_bounds->pad, p_view->width, p_view->join, p_view->size);
+  box_t box = box_expand(p_bounds->box, pad + RECORDING_MARGIN);
+  if (!box_is_finite(box)) return NULL;
+
+  void* p_surface = device_recording_begin(p_state->v_ctx, box.x0, box.y0,
+                                           box.x1 - box.x0, box.y1 - box.y0);
+  if (!p_surface) return NULL;
+  record_tree(p_state, p_script, affine_identity(), box);
+  device_layer_end(p_state->v_ctx, p_surface);
+
+  size_t bytes = (size_t)p_script->tree_size * RECORDING_BYTES_PER_INSTR;
+  return layer_add(p_key, stamp, p_surface, bytes);
+}
+
+//---------------------------------------------------------
+// Draw the script from a layer instead of running it, if that comes
+// out the same. It has to draw the same from anywhere, so it can't
+// inherit any styles, and it has to have stopped changing.
+//
+// Under a uniform scale and a translation that stay put, it goes in a
+// raster layer that is put down on whole pixels. Otherwise, when it
+// is being rotated or skewed, or is moving or zooming, the drawing is
+// recorded once and played back under whatever the transform is.
+// Returns false if it has to be drawn.
+static bool draw_layer(render_state_t* p_state, const site_t* p_site,
+                       script_t* p_script)
+{
+  view_stack_t* p_views = p_state->p_views;
+  if (!p_views->culling || !p_views->layering || p_views->recording) return false;
+  if (p_site->flags & SITE_PATH_USED) return false;
+  if (p_script->leaks && !(p_site->flags & SITE_CONTAINED)) return false;
+
+  const bounds_t* p_bounds = tree_bounds(p_script, 0);
+  if (p_bounds->unbounded || box_is_empty(p_bounds->box)) return false;
+  if (p_script->tree_inherits || p_script->tree_size < LAYER_MIN_SIZE) return false;
+
+  const affine_t* p_tx = &p_views->view.tx;
+  if (!isfinite(p_tx->a) || !isfinite(p_tx->b) || !isfinite(p_tx->c)
+      || !isfinite(p_tx->d) || !isfinite(p_tx->e) || !isfinite(p_tx->f)) {
+    return false;
+  }
+
+  // where a raster layer would go
+  float base_x = floorf(p_tx->e);
+  float base_y = floorf(p_tx->f);
+  layer_key_t key = {.handle = p_script->handle};
+  if (p_tx->b == 0 && p_tx->c == 0 && p_tx->a == p_tx->d && p_tx->a > 0) {
+    key.scale = lroundf(p_tx->a * LAYER_SCALE_STEPS);
+    key.phase_x = lroundf((p_tx->e - base_x) * LAYER_PHASE_STEPS);
+    key.phase_y = lroundf((p_tx->f - base_y) * LAYER_PHASE_STEPS);
+    // rounding up into the next pixel
+    if (key.phase_x == LAYER_PHASE_STEPS) {
+      key.phase_x = 0;
+      base_x++;
+    }
+    if (key.phase_y == LAYER_PHASE_STEPS) {
+      key.phase_y = 0;
+      base_y++;
+    }
+  }
+  bool moving = memcmp(&key, &p_script->layer_key, sizeof(layer_key_t)) != 0;
+  p_script->layer_key = key;
+
+  // only once it has stopped changing
+  uint32_t stamp = tree_stamp(p_script, 0);
+  if (stamp != p_script->layer_stamp) {
+    p_script->layer_stamp = stamp;
+    p_script->layer_visits = 0;
+    return false;
+  }
+  if (p_script->layer_visits < LAYER_STABLE_VISITS) {
+    p_script->layer_visits++;
+    return false;
+  }
+
+  if (key.scale > 0 && !moving) {
+    layer_t* p_layer = layer_find(&key, stamp);
+    if (!p_layer) p_layer = record_raster(p_state, p_script, &key, stamp);
+    if (p_layer) {
+      device_layer_draw(p_state->v_ctx, p_layer->p_surface,
+                        base_x + p_layer->x, base_y + p_layer->y);
+      return true;
+    }
+  }
+
+  layer_key_t vector_key = {.handle = p_script->handle};
+  layer_t* p_layer = layer_find(&vector_key, stamp);
+  if (!p_layer) p_layer = record_vector(p_state, p_script, &vector_key, stamp);
+  if (!p_layer) {
+    // wait a while before trying again
+    p_script->layer_visits = 0;
+    return false;
+  }
+
+  device_recording_draw(p_state->v_ctx, p_layer->p_surface);
+  return true;
+}
+
+//---------------------------------------------------------
+// planning the frame
+
+// where a script is drawn from, and what it inherits there
+typedef struct {
+  affine_t tx;
+  float width;
+  float join;
+  float size;
+  bool clipped;     // under a scissor
+} place_t;
+
+static uint32_t frame_epoch = 0;
+// steps taken so far in the walk
+static uint32_t frame_steps = 0;
+// whether the walk is collecting occluders
+static bool collecting = false;
+
+//---------------------------------------------------------
+// goes up whenever any of the images or fonts the script uses change
+static uint32_t media_stamp(const script_t* p_script)
+{
+  uint32_t stamp = 0;
+  for (uint32_t i = 0; i < p_script->instr_count; i++) {
+    const instr_t* p_instr = &p_script->p_code[i];
+    if (p_instr->handle != HANDLE_NONE && p_instr->op != SCRIPT_OP_DRAW_SCRIPT) {
+      stamp += handle_slot(p_instr->handle)->generation;
+    }
+  }
+  return stamp;
+}
+
+//---------------------------------------------------------
+// the device space box that drawing the script from here could touch
+static box_t landing_box(script_t* p_script, const place_t* p_place)
+{
+  const bounds_t* p_bounds = tree_bounds(p_script, 0);
+  if (p_bounds->unbounded) return (box_t){-INFINITY, -INFINITY, INFINITY, INFINITY};
+
+  float pad = pad_eval(p_bounds->pad, p_place->width, p_place->join, p_place->size);
+  box_t box = box_transform(p_place->tx, box_expand(p_bounds->box, pad));
+  return box_expand(box, ANTIALIAS_MARGIN);
+}
+
+//---------------------------------------------------------
+// Follow the scene down from a script the way rendering it would,
+// noting where every script lands. A script that is new, or whose
+// images or fonts changed, damages where it was and where it is now.
+// That covers everything under it too. Scripts drawn after one that
+// leaks state can't be placed from the sites alone, so if one of
+// those is damaged, so is everything, and their rects can't be used
+// as occluders.
+static void place_script(script_t* p_script, const place_t* p_place,
+                         bool reliable, int depth)
+{
+  uint32_t start = frame_steps;
+
+  bool first_visit = (p_script->landing_epoch != frame_epoch);
+  if (first_visit) {
+    p_script->damaged = (p_script->landing_epoch == 0);
+    if (p_script->has_media) {
+      uint32_t stamp = media_stamp(p_script);
+      if (stamp != p_script->media_stamp) p_script->damaged = true;
+      p_script->media_stamp = stamp;
+    }
+    p_script->last_landing = p_script->landing;
+    p_script->landing = box_empty();
+    p_script->landing_epoch = frame_epoch;
+  }
+
+  box_t box = landing_box(p_script, p_place);
+  p_script->landing = box_union(p_script->landing, box);
+  if (p_script->damaged) {
+    if (!reliable) {
+      damage_all();
+    } else {
+      damage_add(box);
+      if (first_visit) damage_add(p_script->last_landing);
+    }
+  }
+
+  if (depth >= MAX_SCRIPT_DEPTH) {
+    // a script can be cut off here and not somewhere else, so its
+    // steps aren't the same everywhere
+    if (collecting) occluder_count = 0;
+    collecting = false;
+    p_script->tree_steps = 0;
+    return;
+  }
+
+  bool occluding = !p_place->clipped
+    && p_place->tx.b == 0 && p_place->tx.c == 0;
+  uint32_t next_occluder = 0;
+  uint32_t site = 0;
+  for (uint32_t i = 0; i <= p_script->instr_count; i++) {
+    // the rects drawn before this site, or after the last one
+    while (next_occluder < p_script->occluder_count
+           && (i == p_script->instr_count
+               || p_script->p_occluder_sites[next_occluder] <= site)) {
+      if (collecting && reliable && occluding) {
+        add_occluder(box_transform(p_place->tx, p_script->p_occluders[next_occluder]),
+                     frame_steps);
+      }
+      next_occluder++;
+    }
+    if (i == p_script->instr_count) break;
+
+    const instr_t* p_instr = &p_script->p_code[i];
+    if (p_instr->op != SCRIPT_OP_DRAW_SCRIPT) continue;
+    site++;
+
+    script_t* p_child = handle_slot(p_instr->handle)->p_script;
+    if (!p_child) continue;
+
+    const site_t* p_site = (const site_t*)p_instr->p_args;
+    place_t place = {
+      .tx = affine_multiply(p_place->tx, p_site->tx),
+      .width = isnan(p_site->width) ? p_place->width : p_site->width,
+      .join = isnan(p_site->join) ? p_place->join : p_site->join,
+      .size = isnan(p_site->size) ? p_place->size : p_site->size,
+      .clipped = p_place->clipped || (p_site->flags & SITE_CLIPPED)
+    };
+    frame_steps++;
+    place_script(p_child, &place, reliable, depth + 1);
+    frame_steps++;
+
+    if (p_child->leaks && !(p_site->flags & SITE_CONTAINED)) {
+      // what it leaks could have changed how everything after it draws
+      if (p_child->damaged) damage_all();
+      reliable = false;
+    }
+  }
+
+  p_script->tree_steps = frame_steps - start;
+}
+
+//---------------------------------------------------------
+static place_t root_place(const float* p_root_tx)
+{
+  return (place_t){
+    .tx = {p_root_tx[0], p_root_tx[1], p_root_tx[2],
+           p_root_tx[3], p_root_tx[4], p_root_tx[5]},
+    .width = DEFAULT_STROKE_WIDTH,
+    .join = join_factor(DEFAULT_MITER_LIMIT),
+    .size = DEFAULT_FONT_SIZE,
+    .clipped = false
+  };
+}
+
+//---------------------------------------------------------
+// The cursor is drawn over the scene at its position, and damages
+// where it was and where it is whenever it moves
+static void place_cursor(const script_t* p_root, sid_t cursor_id,
+                         const place_t* p_root_place, const float* p_cursor_pos)
+{
+  static box_t last_cursor = {INFINITY, INFINITY, -INFINITY, -INFINITY};
+
+  box_t cursor = box_empty();
+  script_t* p_cursor = p_cursor_pos ? get_script(cursor_id) : NULL;
+  if (p_cursor) {
+    place_t place = *p_root_place;
+    place.tx = affine_translate(place.tx, p_cursor_pos[0], p_cursor_pos[1]);
+    place_script(p_cursor, &place, !(p_root && p_root->leaks), 0);
+    cursor = p_cursor->landing;
+  }
+  if (memcmp(&cursor, &last_cursor, sizeof(box_t))) {
+    damage_add(last_cursor);
+    damage_add(cursor);
+    last_cursor = cursor;
+  }
+}
+
+//---------------------------------------------------------
+void plan_frame(sid_t root_id, sid_t cursor_id,
+                const float* p_root_tx, const float* p_cursor_pos)
+{
+  if (++frame_epoch == 0) frame_epoch = 1;
+  frame_steps = 0;
+  occluder_count = 0;
+
+  place_t root = root_place(p_root_tx);
+  script_t* p_root = get_script(root_id);
+  collecting = true;
+  if (p_root) place_script(p_root, &root, true, 0);
+  collecting = false;
+
+  place_cursor(p_root, cursor_id, &root, p_cursor_pos);
+}
+
+//---------------------------------------------------------
+void plan_cursor_frame(sid_t root_id, sid_t cursor_id,
+                       const float* p_root_tx, const float* p_cursor_pos)
+{
+  if (++frame_epoch == 0) frame_epoch = 1;
+  occluder_count = 0;
+
+  place_t root = root_place(p_root_tx);
+  place_cursor(get_script(root_id), cursor_id, &root, p_cursor_pos);
+}
+
+//---------------------------------------------------------
+static void render_view(view_stack_t* p_views, void* v_ctx, script_t* p_script,
+                        const float* p_root_tx, box_t viewport, bool layering)
+{
+  p_views->depth = 0;
+  p_views->culling = (p_root_tx != NULL);
+  p_views->layering = layering;
+  p_views->recording = false;
+  p_views->step = 0;
+  p_views->viewport = viewport;
+  p_views->view = (view_t){
+    .tx = affine_identity(),
+    .clip = viewport,
+    .width = DEFAULT_STROKE_WIDTH,
+    .join = join_factor(DEFAULT_MITER_LIMIT),
+    .size = DEFAULT_FONT_SIZE
+  };
+  if (p_root_tx) {
+    p_views->view.tx = (affine_t){p_root_tx[0], p_root_tx[1], p_root_tx[2],
+                                  p_root_tx[3], p_root_tx[4], p_root_tx[5]};
+  }
+
+  render_state_t root = {.v_ctx = v_ctx, .depth = -1, .p_views = p_views};
+  run_script(&root, p_script);
+}
+
+//---------------------------------------------------------
+void render_script(void* v_ctx, sid_t id, const float* p_root_tx)
+{
+  // get the script
+  script_t* p_script = get_script(id);
+  if ( !p_script ) {
+    return;
+  }
+
+  // nothing outside the damage is going to be drawn
+  render_view(&views[0], v_ctx, p_script, p_root_tx, g_damage.bounds, true);
+}
+
+//---------------------------------------------------------
+// Everything a band reads was brought up to date by plan_frame, and it
+// doesn't use the layers, so bands can be drawn at the same time.
+void render_script_band(void* v_ctx, sid_t id, const float* p_root_tx,
+                        int band, int y0, int y1)
+{
+  script_t* p_script = get_script(id);
+  if (!p_script) return;
+
+  box_t viewport = g_damage.bounds;
+  if (viewport.y0 < y0) viewport.y0 = y0;
+  if (viewport.y1 > y1) viewport.y1 = y1;
+  render_view(&views[band], v_ctx, p_script, p_root_tx, viewport, false);
+}
+
+//---------------------------------------------------------
+static void run_script(render_state_t* p_parent, script_t* p_script)
+{
+  // track the state pushes
+  render_state_t state = {
+    .v_ctx = p_parent->v_ctx,
+    .push_count = 0,
+    .depth = p_parent->depth + 1,
+    .p_views = p_parent->p_views
+  };
+
+  const instr_t* p_instr = p_script->p_code;
+  const instr_t* p_end = p_instr + p_script->instr_count;
+  for (; p_instr < p_end; p_instr++) {
+    p_instr->fn(&state, p_instr);
+  }
+
   // if there are unbalanced pushes, clear them
-  while (push_count > 0) {
-    push_count--;
-    script_ops_pop_state(v_ctx);
+  while (state.push_count > 0) {
+    state.push_count--;
+    pop_view(state.p_views);
+    script_ops_pop_state(state.v_ctx);
   }
 }
@@ -10,8 +10,41 @@
 
 void init_scripts(void);
 
+// what the optimizer has done since startup
+typedef struct {
+  uint64_t ops;       // looked at
+  uint64_t removed;
+} optimize_stats_t;
+
+extern optimize_stats_t g_optimize_stats;
+
 void put_script(uint32_t* p_msg_length);
+void put_script_shm(uint32_t* p_msg_length);
+void patch_script(uint32_t* p_msg_length);
 void delete_script(uint32_t* p_msg_length);
 
 void reset_scripts();
-void render_script(void* v_ctx, sid_t id);
+// Work out which parts of the screen the next frame has to draw again,
+// and which opaque rects in it hide what is under them.
+// p_cursor_pos is NULL when the cursor isn't shown.
+void plan_frame(sid_t root_id, sid_t cursor_id,
+                const float* p_root_tx, const float* p_cursor_pos);
+
+// The same, for a frame where only the cursor moved and the scene is
+// put back from what the device kept of it.
+void plan_cursor_frame(sid_t root_id, sid_t cursor_id,
+                       const float* p_root_tx, const float* p_cursor_pos);
+
+// true if the opaque rects cover all of the damage, so the device
+// doesn't have to clear it first
+bool frame_covers_damage();
+
+// p_root_tx is the transform the device starts the frame with. Without
+// one nothing is skipped for being out of view.
+void render_script(void* v_ctx, sid_t id, const float* p_root_tx);
+
+// Draw only the rows from y0 up to y1, for one of the bands in
+// bands.h. Bands that are drawn at the same time use different
+// numbers. Layers aren't used.
+void render_script_band(void* v_ctx, sid_t id, const float* p_root_tx,
+                        int band, int y0, int y1);
@@ -235,17 +235,17 @@ void log_script_ops_draw_text(const char* prefix, const char* func, log_level_t
 }
 
 __attribute__((weak))
-void script_ops_draw_sprites(void* v_ctx, sid_t id, uint32_t count, const sprite_t* sprites)
+void script_ops_draw_sprites(void* v_ctx, image_t* p_image, uint32_t count, const sprite_t* sprites)
 {
-  log_script_ops_draw_sprites(log_prefix, __func__, log_level_warn, id, count, sprites);
+  log_script_ops_draw_sprites(log_prefix, __func__, log_level_warn, p_image, count, sprites);
 }
-void log_script_ops_draw_sprites(const char* prefix, const char* func, log_level_t level, sid_t id, uint32_t count, const sprite_t* sprites)
+void log_script_ops_draw_sprites(const char* prefix, const char* func, log_level_t level, image_t* p_image, uint32_t count, const sprite_t* sprites)
 {
   log_message(level, "%s %s: %{"
               "id: '%.*s', "
               "count: %d"
               "}", prefix, func,
-              id.size, id.p_data,
+              p_image->id.size, p_image->id.p_data,
               count);
   for (int i = 0; i < count; i++) {
     log_message(level, "%s %s: index: %d %{"
@@ -259,17 +259,6 @@ void log_script_ops_draw_sprites(const char* prefix, const char* func, log_level
   }
 }
 
-__attribute__((weak))
-void script_ops_draw_script(void* v_ctx, sid_t id)
-{
-  if (g_opts.debug_mode) {
-    log_debug("%s id: '%.*s'", __func__,
-              id.size, id.p_data);
-  }
-
-  render_script(v_ctx, id);
-}
-
 __attribute__((weak))
 void script_ops_begin_path(void* v_ctx)
 {
@@ -573,21 +562,21 @@ void log_script_ops_fill_radial(const char* prefix, const char* func, log_level_
 }
 
 __attribute__((weak))
-void script_ops_fill_image(void* v_ctx, sid_t id)
+void script_ops_fill_image(void* v_ctx, image_t* p_image)
 {
-  log_script_ops_fill_image(log_prefix, __func__, log_level_warn, id);
+  log_script_ops_fill_image(log_prefix, __func__, log_level_warn, p_image);
 }
-void log_script_ops_fill_image(const char* prefix, const char* func, log_level_t level, sid_t id)
+void log_script_ops_fill_image(const char* prefix, const char* func, log_level_t level, image_t* p_image)
 {
   log_message(level, "%s %s", prefix, func);
 }
 
 __attribute__((weak))
-void script_ops_fill_stream(void* v_ctx, sid_t id)
+void script_ops_fill_stream(void* v_ctx, image_t* p_image)
 {
-  log_script_ops_fill_stream(log_prefix, __func__, log_level_warn, id);
+  log_script_ops_fill_stream(log_prefix, __func__, log_level_warn, p_image);
 }
-void log_script_ops_fill_stream(const char* prefix, const char* func, log_level_t level, sid_t id)
+void log_script_ops_fill_stream(const char* prefix, const char* func, log_level_t level, image_t* p_image)
 {
   log_message(level, "%s %s", prefix, func);
 }
@@ -663,21 +652,21 @@ void log_script_ops_stroke_radial(const char* prefix, const char* func, log_leve
 }
 
 __attribute__((weak))
-void script_ops_stroke_image(void* v_ctx, sid_t id)
+void script_ops_stroke_image(void* v_ctx, image_t* p_image)
 {
-  log_script_ops_stroke_image(log_prefix, __func__, log_level_warn, id);
+  log_script_ops_stroke_image(log_prefix, __func__, log_level_warn, p_image);
 }
-void log_script_ops_stroke_image(const char* prefix, const char* func, log_level_t level, sid_t id)
+void log_script_ops_stroke_image(const char* prefix, const char* func, log_level_t level, image_t* p_image)
 {
   log_message(level, "%s %s", prefix, func);
 }
 
 __attribute__((weak))
-void script_ops_stroke_stream(void* v_ctx, sid_t id)
+void script_ops_stroke_stream(void* v_ctx, image_t* p_image)
 {
-  log_script_ops_stroke_stream(log_prefix, __func__, log_level_warn, id);
+  log_script_ops_stroke_stream(log_prefix, __func__, log_level_warn, p_image);
 }
-void log_script_ops_stroke_stream(const char* prefix, const char* func, log_level_t level, sid_t id)
+void log_script_ops_stroke_stream(const char* prefix, const char* func, log_level_t level, image_t* p_image)
 {
   log_message(level, "%s %s:", __func__);
 }
@@ -745,11 +734,11 @@ void log_script_ops_miter_limit(const char* prefix, const char* func, log_level_
 }
 
 __attribute__((weak))
-void script_ops_font(void* v_ctx, sid_t id)
+void script_ops_font(void* v_ctx, font_t* p_font)
 {
-  log_script_ops_font(log_prefix, __func__, log_level_warn, id);
+  log_script_ops_font(log_prefix, __func__, log_level_warn, p_font);
 }
-void log_script_ops_font(const char* prefix, const char* func, log_level_t level, sid_t id)
+void log_script_ops_font(const char* prefix, const char* func, log_level_t level, font_t* p_font)
 {
   log_message(level, "%s %s", prefix, func);
 }
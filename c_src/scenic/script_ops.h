@@ -1,5 +1,7 @@
 #pragma once
 #include "comms.h"
+#include "font.h"
+#include "image.h"
 #include "scenic_types.h"
 
 typedef enum {
@@ -145,8 +147,7 @@ SCRIPT_FUNC(draw_sector, float radius, float radians, bool fill, bool stroke);
 SCRIPT_FUNC(draw_circle, float radius, bool fill, bool stroke);
 SCRIPT_FUNC(draw_ellipse, float radius0, float radius1, bool fill, bool stroke);
 SCRIPT_FUNC(draw_text, uint32_t size, const char* text);
-SCRIPT_FUNC(draw_sprites, sid_t id, uint32_t count, const sprite_t* sprites);
-SCRIPT_FUNC(draw_script, sid_t id);
+SCRIPT_FUNC(draw_sprites, image_t* p_image, uint32_t count, const sprite_t* sprites);
 
 SCRIPT_FUNC(begin_path);
 SCRIPT_FUNC(close_path);
@@ -171,21 +172,21 @@ SCRIPT_FUNC(translate, float x, float y);
 SCRIPT_FUNC(fill_color, color_rgba_t color);
 SCRIPT_FUNC(fill_linear, coordinates_t start, coordinates_t end, color_rgba_t color_start, color_rgba_t color_end);
 SCRIPT_FUNC(fill_radial, coordinates_t center, float inner_radius, float outer_radius, color_rgba_t color_start, color_rgba_t color_end);
-SCRIPT_FUNC(fill_image, sid_t id);
-SCRIPT_FUNC(fill_stream, sid_t id);
+SCRIPT_FUNC(fill_image, image_t* p_image);
+SCRIPT_FUNC(fill_stream, image_t* p_image);
 
 SCRIPT_FUNC(stroke_width, float w);
 SCRIPT_FUNC(stroke_color, color_rgba_t color);
 SCRIPT_FUNC(stroke_linear, coordinates_t start, coordinates_t end, color_rgba_t color_start, color_rgba_t color_end);
 SCRIPT_FUNC(stroke_radial, coordinates_t center, float inner_radius, float outer_radius, color_rgba_t color_start, color_rgba_t color_end);
-SCRIPT_FUNC(stroke_image, sid_t id);
-SCRIPT_FUNC(stroke_stream, sid_t id);
+SCRIPT_FUNC(stroke_image, image_t* p_image);
+SCRIPT_FUNC(stroke_stream, image_t* p_image);
 
 SCRIPT_FUNC(line_cap, line_cap_t type);
 SCRIPT_FUNC(line_join, line_join_t type);
 SCRIPT_FUNC(miter_limit, uint32_t limit);
 
-SCRIPT_FUNC(font, sid_t id);
+SCRIPT_FUNC(font, font_t* p_font);
 SCRIPT_FUNC(font_size, float size);
 SCRIPT_FUNC(text_align, text_align_t type);
 SCRIPT_FUNC(text_base, text_base_t type);
@@ -0,0 +1,111 @@
+/*
+# Shared memory regions used to hand large payloads to the driver.
+
+The caller writes a payload into a file in /dev/shm and sends a message
+naming the slot and file instead of the bytes themselves. The file is
+mapped once per slot and unlinked right away, so it disappears when
+both sides have let go of it. Once the payload has been consumed, the
+slot is released back to the caller with MSG_OUT_SHM_RELEASE.
+*/
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "shm.h"
+
+typedef struct {
+  int fd;
+  void* p_map;
+  size_t map_size;
+} shm_slot_t;
+
+static shm_slot_t shm_slots[SHM_MAX_SLOTS] = {0};
+
+//---------------------------------------------------------
+static void unmap_slot(shm_slot_t* p_slot)
+{
+  if (p_slot->p_map) {
+    munmap(p_slot->p_map, p_slot->map_size);
+  }
+  if (p_slot->fd > 0) {
+    close(p_slot->fd);
+  }
+  memset(p_slot, 0, sizeof(shm_slot_t));
+}
+
+//---------------------------------------------------------
+void* shm_map(uint32_t slot, sid_t path, uint32_t size)
+{
+  if (slot >= SHM_MAX_SLOTS) {
+    log_error("%s invalid slot: %d", __func__, slot);
+    return NULL;
+  }
+  shm_slot_t* p_slot = &shm_slots[slot];
+
+  // first use of the slot. Open the file and take the name away
+  if (!p_slot->p_map) {
+    char name[256];
+    if (path.size == 0 || path.size >= sizeof(name)) {
+      log_error("%s invalid path", __func__);
+      return NULL;
+    }
+    memcpy(name, path.p_data, path.size);
+    name[path.size] = 0;
+
+    p_slot->fd = open(name, O_RDONLY);
+    if (p_slot->fd < 0) {
+      log_error("%s unable to open %s", __func__, name);
+      p_slot->fd = 0;
+      return NULL;
+    }
+    unlink(name);
+  }
+
+  // the caller may have grown the file since it was last mapped
+  if (!p_slot->p_map || p_slot->map_size < size) {
+    struct stat st;
+    if (fstat(p_slot->fd, &st) < 0 || (size_t)st.st_size < size) {
+      log_error("%s slot %d is smaller than %d bytes", __func__, slot, size);
+      return NULL;
+    }
+
+    if (p_slot->p_map) {
+      munmap(p_slot->p_map, p_slot->map_size);
+    }
+    p_slot->map_size = st.st_size;
+    p_slot->p_map = mmap(NULL, p_slot->map_size, PROT_READ, MAP_SHARED, p_slot->fd, 0);
+    if (p_slot->p_map == MAP_FAILED) {
+      log_error("%s unable to map slot %d", __func__, slot);
+      p_slot->p_map = NULL;
+      unmap_slot(p_slot);
+      return NULL;
+    }
+  }
+
+  return p_slot->p_map;
+}
+
+//---------------------------------------------------------
+PACK(typedef struct msg_shm_release_t
+{
+  uint32_t msg_id;
+  uint32_t slot;
+}) msg_shm_release_t;
+
+void shm_release(uint32_t slot)
+{
+  msg_shm_release_t msg = { MSG_OUT_SHM_RELEASE, slot };
+  write_cmd((uint8_t*) &msg, sizeof(msg_shm_release_t));
+}
+
+//---------------------------------------------------------
+void shm_reset()
+{
+  for (int i = 0; i < SHM_MAX_SLOTS; i++) {
+    unmap_slot(&shm_slots[i]);
+  }
+}
@@ -0,0 +1,21 @@
+/*
+# Shared memory regions used to hand large payloads to the driver
+# without copying them through the port pipe.
+*/
+
+#pragma once
+
+#include "scenic_types.h"
+
+#define SHM_MAX_SLOTS 16
+
+// Returns a pointer to the first "size" bytes of the region for a slot,
+// mapping the file at "path" the first time the slot is seen. Returns
+// NULL if the region can't be mapped or is too small.
+void* shm_map(uint32_t slot, sid_t path, uint32_t size);
+
+// Tell the caller the slot's contents have been consumed, so it can
+// write the next payload into it.
+void shm_release(uint32_t slot);
+
+void shm_reset();
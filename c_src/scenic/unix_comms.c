@@ -1,24 +1,292 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "capture.h"
 #include "common.h"
 
 //=============================================================================
 // raw comms with host app
 // from erl_comm.c
 // http://erlang.org/doc/tutorial/c_port.html#id64377
+
 //---------------------------------------------------------
-int read_exact(uint8_t* buf, int len)
+// The reader thread reads input from the caller in large chunks into
+// stdin_buffer and frames messages out of it from memory. Scenic sends
+// lots of small messages, so this turns a couple of read syscalls per
+// message into roughly one per chunk. The buffer is kept contiguous
+// (unread bytes are slid to the front when more room is needed).
+#define STDIN_BUFFER_SIZE (256 * 1024)
+
+static uint8_t stdin_buffer[STDIN_BUFFER_SIZE];
+static uint32_t stdin_head = 0;   // offset of the first unread byte
+static uint32_t stdin_tail = 0;   // offset just past the last buffered byte
+
+//---------------------------------------------------------
+static inline uint32_t stdin_buffered()
+{
+  return stdin_tail - stdin_head;
+}
+
+//---------------------------------------------------------
+// make sure at least "len" bytes are sitting in the buffer. len must
+// not be bigger than the buffer. Reads as much as the pipe will give
+// in one go. Returns the number of bytes buffered, or <= 0 if the pipe
+// was closed or errored before enough data arrived.
+static int fill_stdin(uint32_t len)
 {
-  int i, got = 0;
+  if (stdin_head == stdin_tail) {
+    stdin_head = stdin_tail = 0;
+  }
 
-  do
-  {
-    if ((i = read(0, buf + got, len - got)) <= 0)
-      return (i);
-    got += i;
-  } while (got < len);
+  // slide the unread bytes to the front if the request won't fit
+  if (stdin_head + len > STDIN_BUFFER_SIZE) {
+    uint32_t buffered = stdin_buffered();
+    memmove(stdin_buffer, stdin_buffer + stdin_head, buffered);
+    stdin_head = 0;
+    stdin_tail = buffered;
+  }
+
+  while (stdin_buffered() < len) {
+    int i = read(0, stdin_buffer + stdin_tail, STDIN_BUFFER_SIZE - stdin_tail);
+    if (i <= 0) {
+      if (i < 0 && errno == EINTR) continue;
+      return i;
+    }
+    capture_chunk(stdin_buffer + stdin_tail, i);
+    stdin_tail += i;
+  }
+
+  return stdin_buffered();
+}
+
+//---------------------------------------------------------
+// blocking read of exactly len bytes from stdin. Returns len, or what
+// the failed read returned.
+static int read_stdin(uint8_t* buf, uint32_t len)
+{
+  int i;
+  uint32_t got = 0;
+
+  if (len == 0) return 0;
+
+  // requests larger than the buffer are copied out of whatever is
+  // buffered, then read straight into the destination
+  if (len > STDIN_BUFFER_SIZE) {
+    got = stdin_buffered();
+    memcpy(buf, stdin_buffer + stdin_head, got);
+    stdin_head = stdin_tail = 0;
+
+    do
+    {
+      if ((i = read(0, buf + got, len - got)) <= 0) {
+        if (i < 0 && errno == EINTR) continue;
+        return (i);
+      }
+      capture_chunk(buf + got, i);
+      got += i;
+    } while (got < len);
+
+    return (len);
+  }
+
+  if ((i = fill_stdin(len)) < (int)len)
+    return (i);
+
+  memcpy(buf, stdin_buffer + stdin_head, len);
+  stdin_head += len;
 
   return (len);
 }
 
+//=============================================================================
+// Messages are read by their own thread into a queue, so a slow render
+// never holds up reading and a big message never holds up rendering.
+// The scenic thread takes them off the queue one at a time, and the ops
+// read their arguments out of the message in memory.
+
+// the reader waits when this much is queued and not yet handled
+#define MAX_QUEUED_BYTES (64 * 1024 * 1024)
+
+typedef struct msg_t {
+  struct msg_t* p_next;
+  uint32_t size;
+  uint8_t data[];
+} msg_t;
+
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static msg_t* p_queue_head = NULL;
+static msg_t* p_queue_tail = NULL;
+static uint64_t queued_bytes = 0;
+static bool reader_done = false;
+
+// written to whenever a message is queued, so poll can wait on it
+static int wake_fds[2] = {-1, -1};
+
+// the message being handled
+static msg_t* p_current = NULL;
+static uint32_t current_offset = 0;
+
+//---------------------------------------------------------
+static void wake_scenic()
+{
+  uint8_t b = 0;
+  // if the pipe is full, the scenic thread already has a wakeup coming
+  if (write(wake_fds[1], &b, 1) < 0) {}
+}
+
+//---------------------------------------------------------
+static void push_msg(msg_t* p_msg)
+{
+  pthread_mutex_lock(&queue_mutex);
+  while (p_queue_head && queued_bytes + p_msg->size > MAX_QUEUED_BYTES) {
+    pthread_cond_wait(&queue_cond, &queue_mutex);
+  }
+
+  p_msg->p_next = NULL;
+  if (p_queue_tail) p_queue_tail->p_next = p_msg;
+  else p_queue_head = p_msg;
+  p_queue_tail = p_msg;
+  queued_bytes += p_msg->size;
+  pthread_mutex_unlock(&queue_mutex);
+
+  wake_scenic();
+}
+
+//---------------------------------------------------------
+static void* reader_loop(void* user_data)
+{
+  for (;;) {
+    // length from erlang is always big endian
+    uint32_t len;
+    if (read_stdin((uint8_t*)&len, sizeof(uint32_t)) != sizeof(uint32_t)) break;
+    len = ntoh_ui32(len);
+
+    // every message starts with its op
+    if (len < sizeof(uint32_t)) {
+      log_error("%s dropping a message of %d bytes", __func__, len);
+      uint8_t skip[sizeof(uint32_t)];
+      if (read_stdin(skip, len) != (int)len) break;
+      continue;
+    }
+
+    msg_t* p_msg = malloc(sizeof(msg_t) + len);
+    if (!p_msg) {
+      log_error("%s unable to allocate a message of %d bytes", __func__, len);
+      break;
+    }
+    p_msg->size = len;
+
+    if (read_stdin(p_msg->data, len) != (int)len) {
+      free(p_msg);
+      break;
+    }
+
+    push_msg(p_msg);
+  }
+
+  // the caller hung up
+  pthread_mutex_lock(&queue_mutex);
+  reader_done = true;
+  pthread_mutex_unlock(&queue_mutex);
+  wake_scenic();
+
+  return NULL;
+}
+
+//---------------------------------------------------------
+int start_reader()
+{
+  if (pipe(wake_fds) != 0) {
+    log_error("%s unable to create the wake pipe", __func__);
+    return -1;
+  }
+  fcntl(wake_fds[0], F_SETFL, O_NONBLOCK);
+  fcntl(wake_fds[1], F_SETFL, O_NONBLOCK);
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, reader_loop, NULL) != 0) {
+    log_error("%s unable to start the reader thread", __func__);
+    return -1;
+  }
+  pthread_detach(thread);
+
+  return wake_fds[0];
+}
+
+//---------------------------------------------------------
+void clear_reader_wake()
+{
+  uint8_t buf[64];
+  while (read(wake_fds[0], buf, sizeof(buf)) > 0) {}
+}
+
+//---------------------------------------------------------
+bool take_msg(uint32_t* p_len)
+{
+  release_msg();
+
+  pthread_mutex_lock(&queue_mutex);
+  msg_t* p_msg = p_queue_head;
+  if (p_msg) {
+    p_queue_head = p_msg->p_next;
+    if (!p_queue_head) p_queue_tail = NULL;
+  }
+  pthread_mutex_unlock(&queue_mutex);
+
+  if (!p_msg) return false;
+
+  p_current = p_msg;
+  current_offset = 0;
+  *p_len = p_msg->size;
+  return true;
+}
+
+//---------------------------------------------------------
+void release_msg()
+{
+  if (!p_current) return;
+
+  pthread_mutex_lock(&queue_mutex);
+  queued_bytes -= p_current->size;
+  pthread_cond_signal(&queue_cond);
+  pthread_mutex_unlock(&queue_mutex);
+
+  free(p_current);
+  p_current = NULL;
+}
+
+//---------------------------------------------------------
+// copy the next len bytes of the current message
+int read_exact(uint8_t* buf, int len)
+{
+  if (!p_current || len <= 0) return 0;
+
+  uint32_t left = p_current->size - current_offset;
+  if ((uint32_t)len > left) len = left;
+
+  memcpy(buf, p_current->data + current_offset, len);
+  current_offset += len;
+  return len;
+}
+
+//---------------------------------------------------------
+// Zero-copy version of read_exact. Returns a pointer to the next "len"
+// bytes of the current message and consumes them. The pointer is only
+// valid until the message is released. Returns NULL, without consuming
+// anything, if the message doesn't have that many bytes left.
+uint8_t* borrow_exact(int len)
+{
+  if (!p_current || len < 0 || (uint32_t)len > p_current->size - current_offset)
+    return NULL;
+
+  uint8_t* p = p_current->data + current_offset;
+  current_offset += len;
+  return p;
+}
+
 //---------------------------------------------------------
 int write_exact(uint8_t* buf, int len)
 {
@@ -35,57 +303,22 @@ int write_exact(uint8_t* buf, int len)
 }
 
 //---------------------------------------------------------
-// Starts by using select to see if there is any data to be read
-// if not in timeout, then returns with -1
-// Setting the timeout too high means input will be laggy as you
-// are starving the input polling. Setting it too low means using
-// energy for no purpose. Probably best if set similar to the
-// frame rate
-int read_msg_length(struct timeval * ptv)
+// true if messages have been read that haven't been handled yet
+bool has_buffered_input()
 {
-  uint8_t buff[4];
-
-  fd_set rfds;
-  int    retval;
-
-  // Watch stdin (fd 0) to see when it has input.
-  FD_ZERO(&rfds);
-  FD_SET(0, &rfds);
-
-  // look for data
-  retval = select(1, &rfds, NULL, NULL, ptv);
-  if (retval == -1)
-  {
-    return -1; // error
-  }
-  else if (retval)
-  {
-    if (read_exact(buff, 4) != 4)
-      return (-1);
-    // length from erlang is always big endian
-    uint32_t len = *((uint32_t*) &buff);
-
-    return ntoh_ui32(len);
-  }
-  else
-  {
-    // no data within the timeout
-    return -1;
-  }
+  pthread_mutex_lock(&queue_mutex);
+  bool pending = (p_queue_head != NULL);
+  pthread_mutex_unlock(&queue_mutex);
+  return pending;
 }
 
 //---------------------------------------------------------
-// return true if the caller side of the stdin pipe has hung up
-// http://pubs.opengroup.org/onlinepubs/7908799/xsh/poll.html
-// see
-// https://stackoverflow.com/questions/25147181/pollhup-vs-pollnval-or-what-is-pollhup
+// return true once the caller has hung up and everything it sent
+// before that has been handled
 bool isCallerDown()
 {
-  struct pollfd ufd;
-  memset(&ufd, 0, sizeof ufd);
-  ufd.fd     = STDIN_FILENO;
-  ufd.events = POLLIN;
-  if (poll(&ufd, 1, 0) < 0)
-    return true;
-  return ufd.revents & POLLHUP;
+  pthread_mutex_lock(&queue_mutex);
+  bool down = reader_done && !p_queue_head;
+  pthread_mutex_unlock(&queue_mutex);
+  return down;
 }
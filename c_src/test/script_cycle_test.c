@@ -0,0 +1,128 @@
+/*
+# Checks that putting a script that would close a cycle of draw_script
+# references is refused, however long the cycle is.
+
+Built and run with `make c_test`. The script module is included whole
+so its private functions can be called straight, and the device is a
+stand-in that draws nothing.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../scenic/script.c"
+
+device_info_t g_device_info = {0};
+device_opts_t g_opts = {0};
+
+//---------------------------------------------------------
+// a device that draws nothing
+
+int device_init(const device_opts_t* p_opts, device_info_t* p_info,
+                driver_data_t* p_data) { return 0; }
+int device_close(device_info_t* p_info) { return 0; }
+void device_poll() {}
+void device_loop(driver_data_t* p_data) {}
+void device_begin_render(driver_data_t* p_data) {}
+void device_begin_cursor_render(driver_data_t* p_data) {}
+void device_end_render(driver_data_t* p_data) {}
+void device_clear_color(float red, float green, float blue, float alpha) {}
+char* device_gl_error() { return NULL; }
+int32_t font_ops_create(void* v_ctx, font_t* p_font, uint32_t size) { return 1; }
+int32_t image_ops_create(void* v_ctx, uint32_t width, uint32_t height,
+                         void* p_pixels) { return 1; }
+void image_ops_update(void* v_ctx, int32_t image_id, void* p_pixels) {}
+void image_ops_delete(void* v_ctx, int32_t image_id) {}
+void take_screenshot(uint32_t* p_msg_length, driver_data_t* p_data) {}
+
+//---------------------------------------------------------
+// the scripts are big-endian, as they come from the caller
+
+static uint8_t* put_be16(uint8_t* p, uint16_t v)
+{
+  p[0] = v >> 8;
+  p[1] = v;
+  return p + 2;
+}
+
+static uint8_t* put_be32(uint8_t* p, uint32_t v)
+{
+  p = put_be16(p, v >> 16);
+  return put_be16(p, v);
+}
+
+static sid_t make_id(char* buff, int n)
+{
+  sid_t id;
+  id.size = sprintf(buff, "s%d", n);
+  id.p_data = buff;
+  return id;
+}
+
+// a script that fills a rect and, if next is not negative, draws the
+// script named by it
+static script_t* chain_script(int n, int next)
+{
+  char name[16];
+  char next_name[16];
+  sid_t id = make_id(name, n);
+
+  uint8_t bytes[64];
+  uint8_t* p = bytes;
+  p = put_be16(p, SCRIPT_OP_FILL_COLOR);
+  p = put_be16(p, 0);
+  p = put_be32(p, 0x102030ff);
+  p = put_be16(p, SCRIPT_OP_DRAW_RECT);
+  p = put_be16(p, 1);
+  p = put_be32(p, 0x3f800000);    // 1.0f
+  p = put_be32(p, 0x3f800000);
+  if (next >= 0) {
+    sid_t next_id = make_id(next_name, next);
+    p = put_be16(p, SCRIPT_OP_DRAW_SCRIPT);
+    p = put_be16(p, next_id.size);
+    memset(p, 0, ALIGN_UP(next_id.size, 4));
+    memcpy(p, next_id.p_data, next_id.size);
+    p += ALIGN_UP(next_id.size, 4);
+  }
+
+  script_t* p_script = alloc_script(id.size, p - bytes);
+  if (!p_script) exit(1);
+  memcpy(p_script->id.p_data, id.p_data, id.size);
+  memcpy(p_script->script.p_data, bytes, p - bytes);
+  return p_script;
+}
+
+//---------------------------------------------------------
+#define CHAIN_LENGTH 300
+
+int main()
+{
+  init_handles();
+  init_scripts();
+
+  // s0 draws s1 ... draws s299, put from the far end so every
+  // draw_script finds its script already there
+  for (int i = CHAIN_LENGTH - 1; i >= 0; i--) {
+    insert_script(chain_script(i, i + 1 < CHAIN_LENGTH ? i + 1 : -1));
+  }
+
+  // a long chain isn't a cycle
+  char name[16];
+  script_t* p_last = get_script(make_id(name, CHAIN_LENGTH - 1));
+  if (!p_last || p_last->rejected) {
+    fprintf(stderr, "FAIL: the chain was refused\n");
+    return 1;
+  }
+
+  // closing it, so that s299 draws s0, is
+  insert_script(chain_script(CHAIN_LENGTH - 1, 0));
+  p_last = get_script(make_id(name, CHAIN_LENGTH - 1));
+  if (!p_last || !p_last->rejected || p_last->instr_count != 2) {
+    fprintf(stderr, "FAIL: a cycle of %d scripts was let in\n", CHAIN_LENGTH);
+    return 1;
+  }
+
+  fprintf(stderr, "script_cycle_test passed\n");
+  return 0;
+}
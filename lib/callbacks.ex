@@ -13,6 +13,8 @@ defmodule Scenic.Driver.Local.Callbacks do
   alias Scenic.Assets.Stream
   alias Scenic.Math.Vector2
 
+  alias Scenic.Driver.Local.ScriptDiff
+  alias Scenic.Driver.Local.Shm
   alias Scenic.Driver.Local.ToPort
 
   import Driver,
@@ -35,7 +37,7 @@ defmodule Scenic.Driver.Local.Callbacks do
 
     # state changes
     fonts = Map.get(media, :fonts, [])
-    driver = assign(driver, :media, %{fonts: fonts})
+    driver = assign(driver, media: %{fonts: fonts}, sent_scripts: %{}, pending: [])
     {:ok, driver}
   end
 
@@ -49,13 +51,13 @@ defmodule Scenic.Driver.Local.Callbacks do
             rel_x: 0,
             rel_y: 0,
             cursor_pos: pos,
-            cursor_showing: show?,
-            port: port
+            cursor_showing: show?
           }
         } = driver
       ) do
-    ToPort.update_cursor(show?, pos, port)
-    do_update_scene(ids, driver)
+    driver
+    |> queue(ToPort.update_cursor_msg(show?, pos))
+    |> then(&do_update_scene(ids, &1))
   end
 
   def update_scene(
@@ -72,9 +74,8 @@ defmodule Scenic.Driver.Local.Callbacks do
             # inv_rel_tx: inv_rel_tx,
 
             cursor_pos: {cx, cy},
-            window_size: {width, height},
+            window_size: {width, height}
             # logical_size: {width, height},
-            port: port
           }
         } = driver
       ) do
@@ -109,8 +110,7 @@ defmodule Scenic.Driver.Local.Callbacks do
       |> send_input({:relative, {dx, dy}})
       |> send_input({:cursor_pos, scene_pos})
       |> assign(cursor_showing: true, cursor_pos: screen_pos)
-
-    ToPort.update_cursor(true, scene_pos, port)
+      |> queue(ToPort.update_cursor_msg(true, scene_pos))
 
     # Finally, update the scripts
     do_update_scene(ids, driver)
@@ -120,30 +120,44 @@ defmodule Scenic.Driver.Local.Callbacks do
 
   defp do_update_scene(ids, %{assigns: %{port: port, dirty_streams: streams}} = driver) do
     # update any pending streams
-    streams
-    |> Enum.uniq()
-    |> Enum.each(&do_put_stream(&1, port))
+    driver =
+      streams
+      |> Enum.uniq()
+      |> Enum.reduce(driver, &do_put_stream(&2, &1))
 
     driver =
       driver
       |> do_put_scripts(ids)
+      |> queue(ToPort.render_msg())
+
+    # the whole update goes to the port as one message
+    ToPort.batch(Enum.reverse(driver.assigns.pending), port)
+
+    driver =
+      driver
       |> assign(
         cursor_update: false,
         rel_x: 0,
         rel_y: 0,
-        dirty_streams: []
+        dirty_streams: [],
+        pending: []
       )
       |> set_busy(true)
 
-    ToPort.render(port)
     {:ok, driver}
   end
 
+  # hold a message for the batch sent with the next scene update
+  defp queue(%{assigns: %{pending: pending}} = driver, msg) do
+    assign(driver, :pending, [msg | pending])
+  end
+
   # --------------------------------------------------------
   @doc false
-  def del_scripts(ids, %{assigns: %{port: port}} = driver) do
-    Enum.each(ids, &ToPort.del_script(&1, port))
-    {:ok, driver}
+  def del_scripts(ids, %{assigns: %{sent_scripts: sent}} = driver) do
+    # deletes go out with the next update so they land in the same frame
+    driver = Enum.reduce(ids, driver, &queue(&2, ToPort.del_script_msg(&1)))
+    {:ok, assign(driver, :sent_scripts, Map.drop(sent, ids))}
   end
 
   # --------------------------------------------------------
@@ -164,16 +178,62 @@ defmodule Scenic.Driver.Local.Callbacks do
 
   # --------------------------------------------------------
   # streaming asset updates
-  defp do_put_stream(id, port) do
+  defp do_put_stream(driver, id) do
     case Stream.fetch(id) do
       {:ok, {Stream.Image, {w, h, _mime}, bin}} ->
-        ToPort.put_texture(port, id, :file, w, h, bin)
+        put_texture(driver, id, :file, w, h, bin)
 
       {:ok, {Stream.Bitmap, {w, h, type}, bin}} ->
-        ToPort.put_texture(port, id, type, w, h, bin)
+        put_texture(driver, id, type, w, h, bin)
 
       _ ->
-        :ok
+        driver
+    end
+  end
+
+  # --------------------------------------------------------
+  # large payloads go through shared memory when a slot is free
+  defp put_texture(driver, _id, _format, _w, _h, nil), do: driver
+
+  defp put_texture(%{assigns: %{shm: shm}} = driver, id, format, w, h, bin) do
+    case Shm.write(shm, bin) do
+      {:ok, slot, path, shm} ->
+        driver
+        |> queue(ToPort.put_texture_shm_msg(id, format, w, h, byte_size(bin), slot, path))
+        |> assign(:shm, shm)
+
+      :error ->
+        queue(driver, ToPort.put_texture_msg(id, format, w, h, bin))
+    end
+  end
+
+  # scripts that only changed in a few places are sent as a patch against
+  # the copy the port already has
+  defp update_script(%{assigns: %{sent_scripts: sent}} = driver, id, bin) do
+    driver =
+      case ScriptDiff.diff(Map.get(sent, id), bin) do
+        :same ->
+          driver
+
+        {:patch, edits} ->
+          queue(driver, ToPort.patch_script_msg(edits, id))
+
+        :put ->
+          put_script(driver, id, bin)
+      end
+
+    assign(driver, :sent_scripts, Map.put(sent, id, bin))
+  end
+
+  defp put_script(%{assigns: %{shm: shm}} = driver, id, bin) do
+    case Shm.write(shm, bin) do
+      {:ok, slot, path, shm} ->
+        driver
+        |> queue(ToPort.put_script_shm_msg(IO.iodata_length(bin), slot, path, id))
+        |> assign(:shm, shm)
+
+      :error ->
+        queue(driver, ToPort.put_script_msg(bin, id))
     end
   end
 
@@ -193,17 +253,12 @@ defmodule Scenic.Driver.Local.Callbacks do
   # rendering specific functions
 
   # --------------------------------------------------------
-  defp do_put_scripts(%{assigns: %{port: port}, viewport: vp} = driver, ids) do
+  defp do_put_scripts(%{viewport: vp} = driver, ids) do
     Enum.reduce(ids, driver, fn id, driver ->
       case ViewPort.get_script(vp, id) do
         {:ok, script} ->
           driver = ensure_media(script, driver)
-
-          script
-          |> Script.serialize()
-          |> ToPort.put_script(id, port)
-
-          driver
+          update_script(driver, id, IO.iodata_to_binary(Script.serialize(script)))
 
         _ ->
           driver
@@ -222,19 +277,18 @@ defmodule Scenic.Driver.Local.Callbacks do
 
   defp ensure_fonts(driver, []), do: driver
 
-  defp ensure_fonts(%{assigns: %{port: port, media: media}} = driver, ids) do
+  defp ensure_fonts(%{assigns: %{media: media}} = driver, ids) do
     fonts = Map.get(media, :fonts, [])
 
-    fonts =
-      Enum.reduce(ids, fonts, fn id, fonts ->
+    {fonts, driver} =
+      Enum.reduce(ids, {fonts, driver}, fn id, {fonts, driver} ->
         with false <- Enum.member?(fonts, id),
              {:ok, {Static.Font, _}} <- Static.meta(id),
              {:ok, str_hash} <- Static.to_hash(id),
              {:ok, bin} <- Static.load(id) do
-          ToPort.put_font(port, str_hash, bin)
-          [id | fonts]
+          {[id | fonts], queue(driver, ToPort.put_font_msg(str_hash, bin))}
         else
-          _ -> fonts
+          _ -> {fonts, driver}
         end
       end)
 
@@ -243,19 +297,18 @@ defmodule Scenic.Driver.Local.Callbacks do
 
   defp ensure_images(driver, []), do: driver
 
-  defp ensure_images(%{assigns: %{port: port, media: media}} = driver, ids) do
+  defp ensure_images(%{assigns: %{media: media}} = driver, ids) do
     images = Map.get(media, :images, [])
 
-    images =
-      Enum.reduce(ids, images, fn id, images ->
+    {images, driver} =
+      Enum.reduce(ids, {images, driver}, fn id, {images, driver} ->
         with false <- Enum.member?(images, id),
              {:ok, {Static.Image, {w, h, _}}} <- Static.meta(id),
              {:ok, str_hash} <- Static.to_hash(id),
              {:ok, bin} <- Static.load(id) do
-          ToPort.put_texture(port, str_hash, :file, w, h, bin)
-          [id | images]
+          {[id | images], put_texture(driver, str_hash, :file, w, h, bin)}
         else
-          _ -> images
+          _ -> {images, driver}
         end
       end)
 
@@ -264,27 +317,25 @@ defmodule Scenic.Driver.Local.Callbacks do
 
   defp ensure_streams(driver, []), do: driver
 
-  defp ensure_streams(%{assigns: %{port: port, media: media}} = driver, ids) do
+  defp ensure_streams(%{assigns: %{media: media}} = driver, ids) do
     streams = Map.get(media, :streams, [])
 
-    streams =
-      Enum.reduce(ids, streams, fn id, streams ->
+    {streams, driver} =
+      Enum.reduce(ids, {streams, driver}, fn id, {streams, driver} ->
         with false <- Enum.member?(streams, id),
              :ok <- Stream.subscribe(id) do
           case Stream.fetch(id) do
             {:ok, {Stream.Image, {w, h, _format}, bin}} ->
-              ToPort.put_texture(port, id, :file, w, h, bin)
-              [id | streams]
+              {[id | streams], put_texture(driver, id, :file, w, h, bin)}
 
             {:ok, {Stream.Bitmap, {w, h, format}, bin}} ->
-              ToPort.put_texture(port, id, format, w, h, bin)
-              [id | streams]
+              {[id | streams], put_texture(driver, id, format, w, h, bin)}
 
             _err ->
-              streams
+              {streams, driver}
           end
         else
-          _ -> streams
+          _ -> {streams, driver}
         end
       end)
 
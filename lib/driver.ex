@@ -8,6 +8,9 @@ defmodule Scenic.Driver.Local do
   @default_layer 0
   @default_opacity 255
 
+  # how often the port's log level is brought in line with Logger's
+  @log_level_check_ms 1000
+
   @position_schema [
     scaled: [type: :boolean, default: false],
     centered: [type: :boolean, default: false],
@@ -42,7 +45,11 @@ defmodule Scenic.Driver.Local do
         {:or, [:mfa, {:in, [:restart, :stop_driver, :stop_viewport, :stop_system, :halt_system]}]},
       default: :restart
     ],
-    input_blacklist: [type: {:list, :string}, default: []]
+    input_blacklist: [type: {:list, :string}, default: []],
+    shared_memory: [type: :boolean, default: false],
+    capture: [type: :string, default: ""],
+    optimize_scripts: [type: :boolean, default: true],
+    render_threads: [type: :non_neg_integer, default: 1]
   ]
 
   # @mix_target Mix.Tasks.Compile.ScenicDriverLocal.target()
@@ -52,6 +59,10 @@ defmodule Scenic.Driver.Local do
 
   Supported config options:\n#{NimbleOptions.docs(@opts_schema)}
 
+  The port only sends up the log lines that the Logger level lets
+  through. The level is checked about once a second, so a change made
+  with `Logger.configure/1` reaches the port shortly after.
+
   """
 
   use Scenic.Driver
@@ -66,6 +77,7 @@ defmodule Scenic.Driver.Local do
   alias Scenic.Driver.Local.ToPort
   alias Scenic.Driver.Local.FromPort
   alias Scenic.Driver.Local.Cursor
+  alias Scenic.Driver.Local.Shm
 
   alias Scenic.Math.Matrix
   alias Scenic.Math.Vector2
@@ -221,6 +233,12 @@ defmodule Scenic.Driver.Local do
         false -> 0
       end
 
+    optimize_scripts =
+      case opts[:optimize_scripts] do
+        true -> 1
+        false -> 0
+      end
+
     {:ok, debugger} = Keyword.fetch(opts, :debugger)
     {:ok, debug_fps} = Keyword.fetch(opts, :debug_fps)
     {:ok, layer} = Keyword.fetch(opts, :layer)
@@ -229,6 +247,8 @@ defmodule Scenic.Driver.Local do
     {:ok, window_opts} = Keyword.fetch(opts, :window)
     {:ok, title} = Keyword.fetch(window_opts, :title)
     fbdev = Keyword.get(window_opts, :fbdev, "/dev/fb0")
+    {:ok, capture} = Keyword.fetch(opts, :capture)
+    {:ok, render_threads} = Keyword.fetch(opts, :render_threads)
 
     resizeable =
       case window_opts[:resizeable] do
@@ -238,7 +258,8 @@ defmodule Scenic.Driver.Local do
 
     args =
       " #{internal_cursor} #{layer} #{opacity} #{antialias} #{debug_mode} #{debug_fps}" <>
-        " #{width} #{height} #{resizeable} #{fbdev} \"#{title}\""
+        " #{width} #{height} #{resizeable} #{fbdev} \"#{title}\" \"#{capture}\"" <>
+        " #{optimize_scripts} #{render_threads}"
 
     # open and initialize the window
     Process.flag(:trap_exit, true)
@@ -278,9 +299,17 @@ defmodule Scenic.Driver.Local do
         rel_x: 0,
         rel_y: 0,
         dirty_streams: [],
-        input_blacklist: opts[:input_blacklist]
+        sent_scripts: %{},
+        log_formats: %{},
+        pending: [],
+        input_blacklist: opts[:input_blacklist],
+        shm: Shm.init(opts[:shared_memory]),
+        log_level: Logger.level()
       )
 
+    ToPort.log_level(driver.assigns.log_level, port)
+    Process.send_after(self(), :_check_log_level_, @log_level_check_ms)
+
     # send message to set up the cursor later
     send(self(), {:_set_cursor_, :touch_spot})
 
@@ -419,6 +448,23 @@ defmodule Scenic.Driver.Local do
     {:noreply, driver}
   end
 
+  # keep the port's log level in step with Logger's, until it closes
+  def handle_info(
+        :_check_log_level_,
+        %{assigns: %{port: port, log_level: old, closing: false}} = driver
+      ) do
+    Process.send_after(self(), :_check_log_level_, @log_level_check_ms)
+
+    case Logger.level() do
+      ^old ->
+        {:noreply, driver}
+
+      level ->
+        ToPort.log_level(level, port)
+        {:noreply, assign(driver, :log_level, level)}
+    end
+  end
+
   def handle_info(_msg, driver) do
     # Logger.warn("#{inspect(__MODULE__)} ignoring #{inspect(msg)}")
     {:noreply, driver}
@@ -8,6 +8,8 @@ defmodule Scenic.Driver.Local.FromPort do
 
   alias Scenic.ViewPort
   alias Scenic.Driver
+  alias Scenic.Driver.Local.LogFormat
+  alias Scenic.Driver.Local.Shm
 
   # import IEx
 
@@ -35,6 +37,8 @@ defmodule Scenic.Driver.Local.FromPort do
   @msg_warn_id 0xA1
   @msg_error_id 0xA2
   @msg_debug_id 0xA3
+  @msg_log_format_id 0xA4
+  @msg_log_batch_id 0xA5
 
   # @msg_draw_ready_id 0x07
 
@@ -44,6 +48,7 @@ defmodule Scenic.Driver.Local.FromPort do
   @msg_mouse_button_id 0x0D
   @msg_mouse_scroll_id 0x0E
   @msg_cursor_enter_id 0x0F
+  @msg_input_batch_id 0x11
 
   # @msg_static_texture_miss 0x20
   # @msg_dynamic_texture_miss 0x21
@@ -51,6 +56,9 @@ defmodule Scenic.Driver.Local.FromPort do
   # @msg_font_miss 0x22
   # @msg_texture_miss 0x23
 
+  @msg_shm_release_id 0x30
+  @msg_script_rejected_id 0x33
+
   @keymap_glfw 0x01
   @keymap_gdk 0x02
 
@@ -71,6 +79,27 @@ defmodule Scenic.Driver.Local.FromPort do
     {:noreply, set_busy(driver, false)}
   end
 
+  # --------------------------------------------------------
+  def handle_port_message(
+        <<
+          @msg_shm_release_id::unsigned-integer-size(32)-native,
+          slot::unsigned-integer-size(32)-native
+        >>,
+        %{assigns: %{shm: shm}} = driver
+      ) do
+    {:noreply, assign(driver, :shm, Shm.release(shm, slot))}
+  end
+
+  # --------------------------------------------------------
+  # the port refused an update to the script, so the copy kept to diff
+  # against is wrong. The next update is sent in full.
+  def handle_port_message(
+        <<@msg_script_rejected_id::unsigned-integer-size(32)-native>> <> id,
+        %{assigns: %{sent_scripts: sent}} = driver
+      ) do
+    {:noreply, assign(driver, :sent_scripts, Map.delete(sent, id))}
+  end
+
   # --------------------------------------------------------
   def handle_port_message(
         <<
@@ -168,6 +197,29 @@ defmodule Scenic.Driver.Local.FromPort do
     {:noreply, driver}
   end
 
+  # --------------------------------------------------------
+  # log formats are sent once, the first time they are used
+  def handle_port_message(
+        <<
+          @msg_log_format_id::unsigned-integer-size(32)-native,
+          id::unsigned-integer-size(32)-native,
+          format::binary
+        >>,
+        %{assigns: %{log_formats: formats}} = driver
+      ) do
+    {:noreply, assign(driver, :log_formats, Map.put(formats, id, format))}
+  end
+
+  # --------------------------------------------------------
+  # binary log records, only formatted if the logger wants them
+  def handle_port_message(
+        <<@msg_log_batch_id::unsigned-integer-size(32)-native>> <> records,
+        %{assigns: %{log_formats: formats}} = driver
+      ) do
+    log_records(records, formats)
+    {:noreply, driver}
+  end
+
   # --------------------------------------------------------
   def handle_port_message(
         <<@msg_write_id::unsigned-integer-size(32)-native>> <> msg,
@@ -338,6 +390,30 @@ defmodule Scenic.Driver.Local.FromPort do
     {:noreply, driver}
   end
 
+  # --------------------------------------------------------
+  # Input events arrive in batches. Each event is stamped with the
+  # monotonic time, in microseconds, at which the port received it,
+  # and the batch with the time it was sent.
+  def handle_port_message(
+        <<
+          @msg_input_batch_id::unsigned-integer-size(32)-native,
+          count::unsigned-integer-size(32)-native,
+          sent_at::unsigned-integer-size(64)-native,
+          events::binary
+        >>,
+        driver
+      ) do
+    {driver, oldest} = handle_input_batch(events, driver, sent_at)
+
+    :telemetry.execute([:input, :batch], %{
+      count: count,
+      queue_time: sent_at - oldest,
+      timestamp: :erlang.system_time()
+    })
+
+    {:noreply, driver}
+  end
+
   # --------------------------------------------------------
   def handle_port_message(
         <<id::unsigned-integer-size(32)-native, bin::binary>>,
@@ -347,6 +423,51 @@ defmodule Scenic.Driver.Local.FromPort do
     {:noreply, driver}
   end
 
+  defp handle_input_batch(
+         <<
+           size::unsigned-integer-size(32)-native,
+           timestamp::unsigned-integer-size(64)-native,
+           event::binary-size(size),
+           rest::binary
+         >>,
+         driver,
+         oldest
+       ) do
+    {:noreply, driver} = handle_port_message(event, driver)
+    handle_input_batch(rest, driver, min(timestamp, oldest))
+  end
+
+  defp handle_input_batch(_, driver, oldest), do: {driver, oldest}
+
+  defp log_records(
+         <<
+           size::unsigned-integer-size(32)-native,
+           record::binary-size(size),
+           rest::binary
+         >>,
+         formats
+       ) do
+    with <<
+           level::unsigned-integer-size(32)-native,
+           format_id::unsigned-integer-size(32)-native,
+           args::binary
+         >> <- record,
+         {:ok, format} <- Map.fetch(formats, format_id) do
+      Logger.log(log_level(level), fn ->
+        "scenic_driver_local: " <> LogFormat.format(format, LogFormat.decode_args(args))
+      end)
+    end
+
+    log_records(rest, formats)
+  end
+
+  defp log_records(_, _formats), do: :ok
+
+  defp log_level(@msg_debug_id), do: :debug
+  defp log_level(@msg_info_id), do: :info
+  defp log_level(@msg_warn_id), do: :warning
+  defp log_level(_), do: :error
+
   # ============================================================================
   # utilities to translate GDK input to standardized input
 
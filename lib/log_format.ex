@@ -0,0 +1,146 @@
+defmodule Scenic.Driver.Local.LogFormat do
+  @moduledoc false
+
+  # The port sends log lines as the id of a printf format string plus
+  # the raw arguments (see c_src/scenic/log.h), so that nothing is
+  # formatted unless the logger is going to use it. This decodes the
+  # arguments and does the formatting for the part of printf the port
+  # uses. Anything that doesn't parse as a conversion is left as is,
+  # same as printf.
+
+  import Bitwise
+
+  @conversion ~r/%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?(?:hh|h|ll|l|L|q|j|z|t)?([diouxXeEfFgGaAcsp%])/
+  @whole_conversion ~r/\A%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?(?:hh|h|ll|l|L|q|j|z|t)?([diouxXeEfFgGaAcsp%])\z/
+
+  @doc false
+  @spec decode_args(binary) :: list
+  def decode_args(bin), do: decode_args(bin, [])
+
+  defp decode_args(<<?i, value::signed-integer-size(64)-native, rest::binary>>, acc) do
+    decode_args(rest, [value | acc])
+  end
+
+  defp decode_args(<<?f, value::binary-size(8), rest::binary>>, acc) do
+    # nan and inf don't match as floats
+    value =
+      case value do
+        <<f::float-size(64)-native>> -> f
+        _ -> :nan
+      end
+
+    decode_args(rest, [value | acc])
+  end
+
+  defp decode_args(
+         <<?s, len::unsigned-integer-size(32)-native, str::binary-size(len), rest::binary>>,
+         acc
+       ) do
+    decode_args(rest, [str | acc])
+  end
+
+  defp decode_args(_, acc), do: Enum.reverse(acc)
+
+  @doc false
+  @spec format(format :: String.t(), args :: list) :: String.t()
+  def format(format, args) do
+    {iodata, _} =
+      @conversion
+      |> Regex.split(format, include_captures: true)
+      |> Enum.map_reduce(args, &expand/2)
+
+    IO.iodata_to_binary(iodata)
+  end
+
+  defp expand(piece, args) do
+    case Regex.run(@whole_conversion, piece) do
+      [_, _, _, _, "%"] ->
+        {"%", args}
+
+      [_ | spec] ->
+        convert(spec, args)
+
+      nil ->
+        {piece, args}
+    end
+  end
+
+  defp convert([flags, width, precision, conversion], args) do
+    {width, args} = star(width, args)
+    {precision, args} = star(precision, args)
+
+    case args do
+      [value | args] -> {pad(conv(conversion, value, precision, flags), width, flags), args}
+      [] -> {"", []}
+    end
+  end
+
+  defp star("*", [n | args]), do: {n, args}
+  defp star("", args), do: {nil, args}
+  defp star(n, args), do: {String.to_integer(n), args}
+
+  defp conv(c, n, _prec, flags) when c in ["d", "i"] and is_integer(n),
+    do: sign(n, flags) <> Integer.to_string(abs(n))
+
+  defp conv("u", n, _prec, _flags) when is_integer(n), do: Integer.to_string(unsigned(n))
+  defp conv("o", n, _prec, _flags) when is_integer(n), do: Integer.to_string(unsigned(n), 8)
+
+  defp conv("x", n, _prec, flags) when is_integer(n),
+    do: alt(flags, "0x") <> String.downcase(Integer.to_string(unsigned(n), 16))
+
+  defp conv("X", n, _prec, flags) when is_integer(n),
+    do: alt(flags, "0X") <> Integer.to_string(unsigned(n), 16)
+
+  defp conv("p", n, _prec, _flags) when is_integer(n),
+    do: "0x" <> String.downcase(Integer.to_string(unsigned(n), 16))
+
+  defp conv("c", n, _prec, _flags) when is_integer(n) and n in 0..255, do: <<n>>
+  defp conv("s", str, _prec, _flags) when is_binary(str), do: str
+
+  defp conv(c, f, prec, flags) when c in ["f", "F"] and is_float(f),
+    do: sign(f, flags) <> :erlang.float_to_binary(abs(f), decimals: prec || 6)
+
+  defp conv(c, f, prec, flags) when c in ["e", "E"] and is_float(f) do
+    str = sign(f, flags) <> :erlang.float_to_binary(abs(f), scientific: prec || 6)
+    if c == "E", do: String.upcase(str), else: str
+  end
+
+  defp conv(_c, f, _prec, flags) when is_float(f), do: sign(f, flags) <> Float.to_string(abs(f))
+  defp conv(_c, value, _prec, _flags), do: to_string(value)
+
+  defp sign(n, _flags) when n < 0, do: "-"
+
+  defp sign(_n, flags) do
+    cond do
+      String.contains?(flags, "+") -> "+"
+      String.contains?(flags, " ") -> " "
+      true -> ""
+    end
+  end
+
+  defp alt(flags, prefix) do
+    if String.contains?(flags, "#"), do: prefix, else: ""
+  end
+
+  # the port sends every integer as a signed 64 bit value
+  defp unsigned(n) when n < 0, do: n + (1 <<< 64)
+  defp unsigned(n), do: n
+
+  defp pad(str, nil, _flags), do: str
+
+  defp pad(str, width, flags) do
+    cond do
+      String.contains?(flags, "-") ->
+        String.pad_trailing(str, width)
+
+      String.contains?(flags, "0") ->
+        case str do
+          "-" <> digits -> "-" <> String.pad_leading(digits, width - 1, "0")
+          _ -> String.pad_leading(str, width, "0")
+        end
+
+      true ->
+        String.pad_leading(str, width)
+    end
+  end
+end
@@ -0,0 +1,72 @@
+defmodule Scenic.Driver.Local.ScriptDiff do
+  @moduledoc false
+
+  # Works out how to bring the port's copy of a script up to date. A
+  # script that kept its size is compared word by word (the serialized
+  # ops are all 4 byte aligned) and the changed runs are sent as edits.
+  # If the edits would cost more than half of a full put, or the size
+  # changed, the whole script is sent instead.
+
+  # changed runs closer together than this are sent as one edit
+  @merge_gap 16
+
+  # each edit carries an offset and a length
+  @edit_overhead 8
+
+  @type edit :: {offset :: non_neg_integer, bytes :: binary}
+
+  @doc false
+  @spec diff(old :: binary | nil, new :: binary) :: :same | :put | {:patch, [edit]}
+  def diff(nil, _new), do: :put
+  def diff(same, same), do: :same
+  def diff(old, new) when byte_size(old) != byte_size(new), do: :put
+
+  def diff(old, new) do
+    size = byte_size(new)
+
+    # skip the common ends without walking them word by word
+    start = :binary.longest_common_prefix([old, new])
+    start = start - rem(start, 4)
+    stop = size - :binary.longest_common_suffix([old, new])
+    stop = min(stop + rem(4 - rem(stop, 4), 4), size)
+
+    edits =
+      binary_part(old, start, stop - start)
+      |> scan(binary_part(new, start, stop - start), start, nil, [])
+      |> Enum.map(fn {from, to} -> {from, binary_part(new, from, to - from)} end)
+
+    cost = Enum.reduce(edits, 0, fn {_, bin}, acc -> acc + @edit_overhead + byte_size(bin) end)
+
+    case cost * 2 > size do
+      true -> :put
+      false -> {:patch, edits}
+    end
+  end
+
+  defp scan(<<a::32, old::binary>>, <<b::32, new::binary>>, pos, run, runs) do
+    case a == b do
+      true ->
+        scan(old, new, pos + 4, run, runs)
+
+      false ->
+        {run, runs} = extend(run, runs, pos, pos + 4)
+        scan(old, new, pos + 4, run, runs)
+    end
+  end
+
+  # a trailing partial word
+  defp scan(old, new, pos, run, runs) when old != new do
+    {run, runs} = extend(run, runs, pos, pos + byte_size(new))
+    scan(<<>>, <<>>, pos, run, runs)
+  end
+
+  defp scan(_old, _new, _pos, nil, runs), do: Enum.reverse(runs)
+  defp scan(_old, _new, _pos, run, runs), do: Enum.reverse([run | runs])
+
+  defp extend(nil, runs, from, to), do: {{from, to}, runs}
+
+  defp extend({r_from, r_to}, runs, from, to) when from - r_to <= @merge_gap,
+    do: {{r_from, to}, runs}
+
+  defp extend(run, runs, from, to), do: {{from, to}, [run | runs]}
+end
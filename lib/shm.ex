@@ -0,0 +1,77 @@
+defmodule Scenic.Driver.Local.Shm do
+  @moduledoc false
+
+  # Large textures and scripts can be handed to the port through files in
+  # /dev/shm instead of being copied through the port pipe. Each slot is a
+  # file that is opened once and rewritten in place. The port maps it,
+  # unlinks it, and sends a release message once it has consumed the
+  # payload, at which point the slot can be written again. If no slot is
+  # free, the payload goes through the pipe as usual.
+
+  @shm_dir "/dev/shm"
+  @slot_count 4
+
+  # below this size the pipe is cheap enough
+  @min_size 64 * 1024
+
+  @type t :: nil | %{prefix: String.t(), free: [non_neg_integer], files: map}
+
+  @doc false
+  @spec init(enabled :: boolean) :: t()
+  def init(false), do: nil
+
+  def init(true) do
+    case File.dir?(@shm_dir) do
+      true ->
+        prefix =
+          "#{@shm_dir}/scenic_driver_local-#{System.pid()}-#{:erlang.unique_integer([:positive])}"
+
+        %{prefix: prefix, free: Enum.to_list(0..(@slot_count - 1)), files: %{}}
+
+      false ->
+        nil
+    end
+  end
+
+  @doc false
+  @spec write(shm :: t(), bin :: iodata) ::
+          {:ok, slot :: non_neg_integer, path :: String.t(), t()} | :error
+  def write(nil, _bin), do: :error
+  def write(%{free: []}, _bin), do: :error
+
+  def write(%{free: [slot | free], files: files} = shm, bin) do
+    with true <- IO.iodata_length(bin) >= @min_size,
+         {:ok, path, fd} <- open(shm, slot),
+         :ok <- :file.pwrite(fd, 0, bin) do
+      {:ok, slot, path, %{shm | free: free, files: Map.put(files, slot, {path, fd})}}
+    else
+      _ -> :error
+    end
+  end
+
+  @doc false
+  @spec release(shm :: t(), slot :: non_neg_integer) :: t()
+  def release(nil, _slot), do: nil
+
+  def release(%{free: free} = shm, slot) do
+    case Enum.member?(free, slot) do
+      true -> shm
+      false -> %{shm | free: [slot | free]}
+    end
+  end
+
+  defp open(%{files: files, prefix: prefix}, slot) do
+    case Map.fetch(files, slot) do
+      {:ok, {path, fd}} ->
+        {:ok, path, fd}
+
+      :error ->
+        path = "#{prefix}-#{slot}"
+
+        case :file.open(path, [:read, :write, :raw, :binary]) do
+          {:ok, fd} -> {:ok, path, fd}
+          err -> err
+        end
+    end
+  end
+end
@@ -16,8 +16,12 @@ defmodule Scenic.Driver.Local.ToPort do
   @cmd_render 0x06
   @cmd_update_cursor 0x07
   @cmd_clear_color 0x08
+  @cmd_put_script_shm 0x09
 
   @cmd_request_input 0x0A
+  @cmd_patch_script 0x0B
+  @cmd_batch 0x0C
+  @cmd_log_level 0x0D
 
   @cmd_close 0x20
   # @cmd_query_stats 0x21
@@ -32,6 +36,7 @@ defmodule Scenic.Driver.Local.ToPort do
 
   @cmd_put_font 0x40
   @cmd_put_img 0x41
+  @cmd_put_img_shm 0x42
   @cmd_screenshot 0x50
 
   @min_window_width 40
@@ -116,7 +121,12 @@ defmodule Scenic.Driver.Local.ToPort do
   end
 
   @doc false
-  def update_cursor(showing?, {x, y}, port) do
+  def update_cursor(showing?, pos, port) do
+    Port.command(port, update_cursor_msg(showing?, pos))
+  end
+
+  @doc false
+  def update_cursor_msg(showing?, {x, y}) do
     showing? =
       case showing? do
         true -> 1
@@ -129,13 +139,16 @@ defmodule Scenic.Driver.Local.ToPort do
       x::float-size(32)-native,
       y::float-size(32)-native
     >>
-
-    Port.command(port, msg)
   end
 
   @doc false
   def put_script(script, id, port) do
-    msg = [
+    Port.command(port, put_script_msg(script, id))
+  end
+
+  @doc false
+  def put_script_msg(script, id) do
+    [
       <<
         @cmd_put_script::unsigned-integer-size(32)-native,
         byte_size(id)::integer-size(32)-native
@@ -143,19 +156,77 @@ defmodule Scenic.Driver.Local.ToPort do
       id,
       script
     ]
+  end
 
-    Port.command(port, msg)
+  @doc false
+  def put_script_shm(size, slot, path, id, port) do
+    Port.command(port, put_script_shm_msg(size, slot, path, id))
+  end
+
+  @doc false
+  def put_script_shm_msg(size, slot, path, id) do
+    [
+      <<
+        @cmd_put_script_shm::unsigned-integer-size(32)-native,
+        byte_size(id)::integer-size(32)-native,
+        slot::integer-size(32)-native,
+        size::integer-size(32)-native,
+        byte_size(path)::integer-size(32)-native
+      >>,
+      id,
+      path
+    ]
+  end
+
+  @doc false
+  def patch_script(edits, id, port) do
+    Port.command(port, patch_script_msg(edits, id))
+  end
+
+  @doc false
+  def patch_script_msg(edits, id) do
+    [
+      <<
+        @cmd_patch_script::unsigned-integer-size(32)-native,
+        byte_size(id)::integer-size(32)-native,
+        length(edits)::integer-size(32)-native
+      >>,
+      id,
+      Enum.map(edits, fn {offset, bin} ->
+        [<<offset::integer-size(32)-native, byte_size(bin)::integer-size(32)-native>>, bin]
+      end)
+    ]
   end
 
   @doc false
   def del_script(id, port) do
-    msg = [
+    Port.command(port, del_script_msg(id))
+  end
+
+  @doc false
+  def del_script_msg(id) do
+    [
       <<@cmd_del_script::unsigned-integer-size(32)-native>>,
-      <<byte_size(id)::integer-size(32)-big>>,
+      <<byte_size(id)::integer-size(32)-native>>,
       id
     ]
+  end
 
-    Port.command(port, msg)
+  # the port drops log lines below this before doing any work on them
+  @doc false
+  def log_level(level, port) do
+    level =
+      case level do
+        :debug -> 0
+        l when l in [:info, :notice] -> 1
+        l when l in [:warning, :warn] -> 2
+        _ -> 3
+      end
+
+    Port.command(port, <<
+      @cmd_log_level::unsigned-integer-size(32)-native,
+      level::unsigned-integer-size(32)-native
+    >>)
   end
 
   @doc false
@@ -165,8 +236,34 @@ defmodule Scenic.Driver.Local.ToPort do
 
   @doc false
   def render(port) do
+    Port.command(port, render_msg())
+  end
+
+  @doc false
+  def render_msg() do
     :telemetry.execute([:render, :start], %{timestamp: :erlang.system_time()})
-    Port.command(port, <<@cmd_render::unsigned-integer-size(32)-native>>)
+    <<@cmd_render::unsigned-integer-size(32)-native>>
+  end
+
+  # Wrap several messages into one. The port applies all of them, in
+  # order, before it reads the next message, so a scene update that ends
+  # in a render can never be seen half applied. Batches don't nest.
+  @doc false
+  def batch([], _port), do: :ok
+
+  def batch(msgs, port) when is_list(msgs) do
+    Port.command(port, batch_msg(msgs))
+  end
+
+  @doc false
+  def batch_msg(msgs) when is_list(msgs) do
+    [
+      <<
+        @cmd_batch::unsigned-integer-size(32)-native,
+        length(msgs)::unsigned-integer-size(32)-native
+      >>
+      | Enum.map(msgs, &[<<IO.iodata_length(&1)::unsigned-integer-size(32)-native>>, &1])
+    ]
   end
 
   @doc false
@@ -255,61 +352,70 @@ defmodule Scenic.Driver.Local.ToPort do
     Port.command(port, <<@cmd_hide::unsigned-integer-size(32)-native>>)
   end
 
-  def put_font(port, name, bin) when is_binary(name) and is_binary(bin) do
-    msg = [
+  def put_font(port, name, bin) do
+    Port.command(port, put_font_msg(name, bin))
+  end
+
+  def put_font_msg(name, bin) when is_binary(name) and is_binary(bin) do
+    [
       <<@cmd_put_font::unsigned-integer-size(32)-native>>,
       <<byte_size(name)::unsigned-integer-size(32)-native>>,
       <<byte_size(bin)::unsigned-integer-size(32)-native>>,
       name,
       bin
     ]
-
-    Port.command(port, msg)
-  end
-
-  def put_texture(port, id, format, w, h, bin)
-
-  def put_texture(_port, _id, _kind, _w, _h, nil) do
-  end
-
-  def put_texture(port, id, :file, w, h, bin) do
-    do_put_texture(port, id, 0, w, h, bin)
-  end
-
-  def put_texture(port, id, :g, w, h, bin) do
-    do_put_texture(port, id, 1, w, h, bin)
-  end
-
-  def put_texture(port, id, :ga, w, h, bin) do
-    do_put_texture(port, id, 2, w, h, bin)
   end
 
-  def put_texture(port, id, :rgb, w, h, bin) do
-    do_put_texture(port, id, 3, w, h, bin)
-  end
+  def put_texture(_port, _id, _format, _w, _h, nil), do: :ok
 
-  def put_texture(port, id, :rgba, w, h, bin) do
-    do_put_texture(port, id, 4, w, h, bin)
+  def put_texture(port, id, format, w, h, bin) do
+    Port.command(port, put_texture_msg(id, format, w, h, bin))
   end
 
-  def do_put_texture(port, id, format, w, h, bin)
+  def put_texture_msg(id, format, w, h, bin)
       when is_integer(w) and is_integer(h) and is_binary(bin) and is_binary(id) do
-    msg = [
+    [
       <<@cmd_put_img::unsigned-integer-size(32)-native>>,
       <<
         byte_size(id)::unsigned-integer-size(32)-native,
         byte_size(bin)::unsigned-integer-size(32)-native,
         w::unsigned-integer-size(32)-native,
         h::unsigned-integer-size(32)-native,
-        format::unsigned-integer-size(32)-native
+        texture_format(format)::unsigned-integer-size(32)-native
       >>,
       id,
       bin
     ]
+  end
 
-    Port.command(port, msg)
+  def put_texture_shm(port, id, format, w, h, size, slot, path) do
+    Port.command(port, put_texture_shm_msg(id, format, w, h, size, slot, path))
+  end
+
+  def put_texture_shm_msg(id, format, w, h, size, slot, path)
+      when is_integer(w) and is_integer(h) and is_binary(id) and is_binary(path) do
+    [
+      <<@cmd_put_img_shm::unsigned-integer-size(32)-native>>,
+      <<
+        byte_size(id)::unsigned-integer-size(32)-native,
+        size::unsigned-integer-size(32)-native,
+        w::unsigned-integer-size(32)-native,
+        h::unsigned-integer-size(32)-native,
+        texture_format(format)::unsigned-integer-size(32)-native,
+        slot::unsigned-integer-size(32)-native,
+        byte_size(path)::unsigned-integer-size(32)-native
+      >>,
+      id,
+      path
+    ]
   end
 
+  defp texture_format(:file), do: 0
+  defp texture_format(:g), do: 1
+  defp texture_format(:ga), do: 2
+  defp texture_format(:rgb), do: 3
+  defp texture_format(:rgba), do: 4
+
   @doc false
   def screenshot(path, port) when is_binary(path) do
     msg = [
@@ -24,7 +24,11 @@ defmodule Scenic.Driver.LocalTest do
       cursor: false,
       key_map: Scenic.KeyMap.USEnglish,
       on_close: :stop_system,
-      input_blacklist: []
+      input_blacklist: [],
+      shared_memory: false,
+      capture: "",
+      optimize_scripts: true,
+      render_threads: 1
     ]
 
     assert Scenic.Driver.Local.validate_opts(opts) == {:ok, opts}
@@ -0,0 +1,30 @@
+defmodule Scenic.Driver.Local.LogFormatTest do
+  use ExUnit.Case, async: true
+
+  alias Scenic.Driver.Local.LogFormat
+
+  defp int(n), do: <<?i, n::signed-integer-size(64)-native>>
+  defp float(f), do: <<?f, f::float-size(64)-native>>
+  defp str(s), do: <<?s, byte_size(s)::unsigned-integer-size(32)-native>> <> s
+
+  test "decode_args reads the tagged arguments in order" do
+    bin = int(-3) <> float(1.5) <> str("abc")
+    assert LogFormat.decode_args(bin) == [-3, 1.5, "abc"]
+  end
+
+  test "format handles the conversions the port uses" do
+    assert LogFormat.format("%s %d", ["id", -12]) == "id -12"
+    assert LogFormat.format("%.1f, %f", [1.26, 2.0]) == "1.3, 2.000000"
+    assert LogFormat.format("r:%02x %x", [10, 255]) == "r:0a ff"
+    assert LogFormat.format("%.*s!", [2, "ab"]) == "ab!"
+    assert LogFormat.format("100%%", []) == "100%"
+  end
+
+  test "format leaves things that aren't conversions alone" do
+    assert LogFormat.format("%s: %{w: %.1f}", ["op", 3.0]) == "op: %{w: 3.0}"
+  end
+
+  test "format pads to the width" do
+    assert LogFormat.format("[%4d][%-4d][%04d]", [7, 7, -7]) == "[   7][7   ][-007]"
+  end
+end
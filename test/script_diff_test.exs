@@ -0,0 +1,49 @@
+defmodule Scenic.Driver.Local.ScriptDiffTest do
+  use ExUnit.Case, async: true
+
+  alias Scenic.Driver.Local.ScriptDiff
+
+  @size 1024
+
+  defp script(), do: :binary.copy(<<1, 2, 3, 4>>, div(@size, 4))
+
+  defp poke(bin, offset, bytes) do
+    <<head::binary-size(offset), _::binary-size(byte_size(bytes)), tail::binary>> = bin
+    head <> bytes <> tail
+  end
+
+  test "a script that was never sent is put" do
+    assert ScriptDiff.diff(nil, script()) == :put
+  end
+
+  test "an unchanged script is not sent" do
+    assert ScriptDiff.diff(script(), script()) == :same
+  end
+
+  test "a script that changed size is put" do
+    assert ScriptDiff.diff(script(), script() <> <<0, 0, 0, 0>>) == :put
+  end
+
+  test "changed words become word aligned edits" do
+    new = script() |> poke(10, <<9>>) |> poke(500, <<9, 9, 9, 9, 9, 9>>)
+
+    assert ScriptDiff.diff(script(), new) ==
+             {:patch, [{8, binary_part(new, 8, 4)}, {500, binary_part(new, 500, 8)}]}
+  end
+
+  test "nearby changes are merged into one edit" do
+    new = script() |> poke(100, <<9>>) |> poke(112, <<9>>)
+    assert ScriptDiff.diff(script(), new) == {:patch, [{100, binary_part(new, 100, 16)}]}
+  end
+
+  test "a mostly changed script is put" do
+    new = :binary.copy(<<9>>, @size)
+    assert ScriptDiff.diff(script(), new) == :put
+  end
+
+  test "applying the edits reproduces the new script" do
+    new = script() |> poke(0, <<7>>) |> poke(301, <<7, 7>>) |> poke(1022, <<7, 7>>)
+    {:patch, edits} = ScriptDiff.diff(script(), new)
+    assert Enum.reduce(edits, script(), fn {offset, bin}, acc -> poke(acc, offset, bin) end) == new
+  end
+end